@@ -16,15 +16,10 @@ class AggregatedFeatureTemplateGenerator : public FeatureTemplateGenerator<T>
 public:
     AggregatedFeatureTemplateGenerator<T>() {};
     
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<T> &observationList) const {
-        std::vector<std::vector<HighOrderCRF::FeatureTemplate>> templateListList(observationList.size());
+    virtual void generateFeatureTemplates(const std::vector<T> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const {
         for (auto &generator : generatorList) {
-            auto generatedListList = generator->generateFeatureTemplates(observationList);
-            for (size_t i = 0; i < observationList.size(); ++i) {
-                std::move(generatedListList[i].begin(), generatedListList[i].end(), std::back_inserter(templateListList[i]));
-            }
+            generator->generateFeatureTemplates(observationList, featureTemplateBuffer);
         }
-        return templateListList;
     }
 
     void addFeatureTemplateGenerator(std::shared_ptr<FeatureTemplateGenerator<T>> generator) {
@@ -14,7 +14,7 @@ namespace DataConverter {
 class CharWithSpaceFeatureGenerator : public FeatureTemplateGenerator<Utility::CharWithSpace> {
 public:
     CharWithSpaceFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength);
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<Utility::CharWithSpace> &observationList) const;
+    virtual void generateFeatureTemplates(const std::vector<Utility::CharWithSpace> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const;
 
 private:
     size_t maxNgram;
@@ -1,22 +1,19 @@
 #include <algorithm>
 #include <cassert>
-#include <sstream>
-#include <string>
 #include <vector>
 
 #include "CharWithSpaceTypeFeatureGenerator.h"
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/CharWithSpace.h"
+#include "../Utility/CharacterCluster.h"
 
 namespace DataConverter {
 
 using std::max;
 using std::min;
-using std::showpos;
-using std::string;
-using std::stringstream;
 using std::vector;
 
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 using Utility::CharWithSpace;
 
 CharWithSpaceTypeFeatureGenerator::CharWithSpaceTypeFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength) {
@@ -25,8 +22,7 @@ CharWithSpaceTypeFeatureGenerator::CharWithSpaceTypeFeatureGenerator(size_t maxN
     this->maxLabelLength = maxLabelLength;
 }
 
-vector<vector<FeatureTemplate>> CharWithSpaceTypeFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList(observationList.size());
+void CharWithSpaceTypeFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
     for (size_t pos = 0; pos < observationList.size(); ++pos) {
         int startPos = max(0, (int)pos - (int)maxWindow);
         size_t endPos = min(observationList.size(), pos + maxWindow);
@@ -36,31 +32,30 @@ vector<vector<FeatureTemplate>> CharWithSpaceTypeFeatureGenerator::generateFeatu
             size_t maxN = min(endPos - curPos, maxNgram);
             int curPosOffset = curPos - pos + (curPos >= pos ? 1 : 0);
         
-            stringstream prefix;
-            prefix << "TS" << showpos << curPosOffset << "/";
+            featureTemplateBuffer->startTag();
+            featureTemplateBuffer->appendToTag("TS");
+            featureTemplateBuffer->appendSignedNumberToTag(curPosOffset);
+            featureTemplateBuffer->appendToTag('/');
             for (size_t n = 1; n <= maxN; ++n) {
+                // extends the tag of the (n-1)-gram
+                if (n > 1) {
+                    featureTemplateBuffer->appendToTag('_');
+                }
+                auto &cs = observationList[curPos + n - 1];
+                if (cs.hasSpace()) {
+                    featureTemplateBuffer->appendToTag("SPACE_");
+                }
+                featureTemplateBuffer->appendToTag(cs.getCharacterCluster().getFirstCharacterTypeString());
                 if (curPos + n < pos || curPos > pos) {
                     continue;
                 }
-                string obs(prefix.str());
-                for (size_t offset = 0; offset < n; ++offset) {
-                    auto &cs = observationList[curPos + offset];
-                    if (cs.hasSpace()) {
-                        obs += "SPACE_";
-                    }
-                    obs += cs.getCharacterCluster().getFirstCharacterType();
-                    if (offset < n - 1) {
-                        obs += "_";
-                    }
-                }
                 size_t maxLen = min(maxLabelLength, pos - curPos + 1);
                 for (size_t labelLength = 1; labelLength <= maxLen; ++labelLength) {
-                    featureTemplateListList[pos].emplace_back(obs, labelLength);
+                    featureTemplateBuffer->addFeatureTemplate(pos, labelLength);
                 }
             }
         }
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
@@ -1,24 +1,29 @@
 #include <algorithm>
 #include <cassert>
-#include <sstream>
-#include <string>
 #include <vector>
 
 #include "CharacterFeatureGenerator.h"
 
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/CharWithSpace.h"
+#include "../Utility/CharacterCluster.h"
 
 namespace DataConverter {
 
 using std::max;
 using std::min;
-using std::showpos;
-using std::string;
-using std::stringstream;
 using std::vector;
 
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 using Utility::CharWithSpace;
+using Utility::CharacterCluster;
+
+static void appendToTag(FeatureTemplateBuffer *featureTemplateBuffer, const CharacterCluster &cluster) {
+    for (const auto &c : cluster.getCharacterList()) {
+        char utf8[4];
+        featureTemplateBuffer->appendToTag(utf8, c.toUtf8(utf8));
+    }
+}
 
 CharacterFeatureGenerator::CharacterFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength) {
     this->maxNgram = maxNgram;
@@ -26,8 +31,7 @@ CharacterFeatureGenerator::CharacterFeatureGenerator(size_t maxNgram, size_t max
     this->maxLabelLength = maxLabelLength;
 }
 
-vector<vector<FeatureTemplate>> CharacterFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList(observationList.size());
+void CharacterFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
     for (size_t pos = 0; pos < observationList.size(); ++pos) {
         int startPos = max(0, (int)pos - (int)maxWindow);
         size_t endPos = min(observationList.size(), pos + maxWindow);
@@ -37,24 +41,23 @@ vector<vector<FeatureTemplate>> CharacterFeatureGenerator::generateFeatureTempla
             size_t maxN = min(endPos - curPos, maxNgram);
             int curPosOffset = curPos - pos + (curPos >= pos ? 1 : 0);
 
-            stringstream prefix;
-            prefix << "C" << showpos << curPosOffset << "/";
+            featureTemplateBuffer->startTag();
+            featureTemplateBuffer->appendToTag('C');
+            featureTemplateBuffer->appendSignedNumberToTag(curPosOffset);
+            featureTemplateBuffer->appendToTag('/');
             for (size_t n = 1; n <= maxN; ++n) {
+                // extends the tag of the (n-1)-gram
+                appendToTag(featureTemplateBuffer, observationList[curPos + n - 1].getCharacterCluster());
                 if (curPos + n < pos || curPos > pos) {
                     continue;
                 }
-                string obs(prefix.str());
-                for (size_t offset = 0; offset < n; ++offset) {
-                    obs += observationList[curPos + offset].getCharacterCluster().toString();
-                }
                 size_t maxLen = min(maxLabelLength, pos - curPos + 1);
                 for (size_t labelLength = 1; labelLength <= maxLen; ++labelLength) {
-                    featureTemplateListList[pos].emplace_back(obs, labelLength);
+                    featureTemplateBuffer->addFeatureTemplate(pos, labelLength);
                 }
             }
         }
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
@@ -1,24 +1,21 @@
 #include <algorithm>
 #include <cassert>
 #include <memory>
-#include <sstream>
-#include <string>
 #include <vector>
 
 #include "CharacterTypeFeatureGenerator.h"
 
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/CharWithSpace.h"
+#include "../Utility/CharacterCluster.h"
 
 namespace DataConverter {
 
 using std::max;
 using std::min;
-using std::showpos;
-using std::string;
-using std::stringstream;
 using std::vector;
 
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 using Utility::CharWithSpace;
 
 CharacterTypeFeatureGenerator::CharacterTypeFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength) {
@@ -27,8 +24,7 @@ CharacterTypeFeatureGenerator::CharacterTypeFeatureGenerator(size_t maxNgram, si
     this->maxLabelLength = maxLabelLength;
 }
 
-vector<vector<FeatureTemplate>> CharacterTypeFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList(observationList.size());
+void CharacterTypeFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
     for (size_t pos = 0; pos < observationList.size(); ++pos) {
         int startPos = max(0, (int)pos - (int)maxWindow);
         size_t endPos = min(observationList.size(), pos + maxWindow);
@@ -38,27 +34,26 @@ vector<vector<FeatureTemplate>> CharacterTypeFeatureGenerator::generateFeatureTe
             size_t maxN = min(endPos - curPos, maxNgram);
             int curPosOffset = curPos - pos + (curPos >= pos ? 1 : 0);
         
-            stringstream prefix;
-            prefix << "T" << showpos << curPosOffset << "/";
+            featureTemplateBuffer->startTag();
+            featureTemplateBuffer->appendToTag('T');
+            featureTemplateBuffer->appendSignedNumberToTag(curPosOffset);
+            featureTemplateBuffer->appendToTag('/');
             for (size_t n = 1; n <= maxN; ++n) {
+                // extends the tag of the (n-1)-gram
+                if (n > 1) {
+                    featureTemplateBuffer->appendToTag('_');
+                }
+                featureTemplateBuffer->appendToTag(observationList[curPos + n - 1].getCharacterCluster().getFirstCharacterTypeString());
                 if (curPos + n < pos || curPos > pos) {
                     continue;
                 }
-                string obs(prefix.str());
-                for (size_t offset = 0; offset < n; ++offset) {
-                    obs += observationList[curPos + offset].getCharacterCluster().getFirstCharacterType();
-                    if (offset < n - 1) {
-                        obs += "_";
-                    }
-                }
                 size_t maxLen = min(maxLabelLength, pos - curPos + 1);
                 for (size_t labelLength = 1; labelLength <= maxLen; ++labelLength) {
-                    featureTemplateListList[pos].emplace_back(obs, labelLength);
+                    featureTemplateBuffer->addFeatureTemplate(pos, labelLength);
                 }
             }
         }
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
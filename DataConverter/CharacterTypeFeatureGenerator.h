@@ -15,7 +15,7 @@ namespace DataConverter {
 class CharacterTypeFeatureGenerator : public FeatureTemplateGenerator<Utility::CharWithSpace> {
 public:
     CharacterTypeFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength);
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<Utility::CharWithSpace> &observationList) const;
+    virtual void generateFeatureTemplates(const std::vector<Utility::CharWithSpace> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const;
 
 private:
     size_t maxNgram;
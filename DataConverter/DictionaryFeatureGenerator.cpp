@@ -1,7 +1,7 @@
 #include "DictionaryFeatureGenerator.h"
 
 #include "../Dictionary/DictionaryClass.h"
-#include "../HighOrderCRF/FeatureTemplate.h"
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 
 #include <algorithm>
 #include <cassert>
@@ -18,25 +18,25 @@ using std::string;
 using std::vector;
 
 using Dictionary::DictionaryClass;
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 
 DictionaryFeatureGenerator::DictionaryFeatureGenerator(shared_ptr<DictionaryClass> dict) {
     dictionary = dict;
 }
 
-vector<vector<FeatureTemplate>> DictionaryFeatureGenerator::generateFeatureTemplates(const vector<string> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList(observationList.size());
-
+void DictionaryFeatureGenerator::generateFeatureTemplates(const vector<string> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
     // Generates all the templates
-    for (size_t i = 0; i < featureTemplateListList.size(); ++i) {
+    for (size_t i = 0; i < observationList.size(); ++i) {
         // Looks up the words
         auto resultListList = dictionary->lookup(observationList[i]);
         for (const auto &resultList : resultListList) {
             assert(resultList.size() == 1);
-            featureTemplateListList[i].emplace_back(string("D-") + resultList[0], 1);
+            featureTemplateBuffer->startTag();
+            featureTemplateBuffer->appendToTag("D-");
+            featureTemplateBuffer->appendToTag(resultList[0]);
+            featureTemplateBuffer->addFeatureTemplate(i, 1);
         }
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
@@ -14,7 +14,7 @@ namespace DataConverter {
 class DictionaryFeatureGenerator : public FeatureTemplateGenerator<std::string> {
 public:
     DictionaryFeatureGenerator(std::shared_ptr<Dictionary::DictionaryClass> dictionary);
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<std::string> &observationList) const;
+    virtual void generateFeatureTemplates(const std::vector<std::string> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const;
 
 private:
     std::shared_ptr<Dictionary::DictionaryClass> dictionary;
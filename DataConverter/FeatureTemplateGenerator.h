@@ -4,7 +4,7 @@
 #include <memory>
 #include <vector>
 
-#include "../HighOrderCRF/FeatureTemplate.h"
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 
 namespace DataConverter {
 
@@ -12,7 +12,9 @@ template <typename T>
 class FeatureTemplateGenerator
 {
 public:
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<T> &observationList) const = 0;
+    // Adds the feature templates for observationList to featureTemplateBuffer,
+    // which has been reset to the length of observationList.
+    virtual void generateFeatureTemplates(const std::vector<T> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const = 0;
 };
 
 }  // namespace DataConverter
@@ -37,7 +37,10 @@ public:
     }
 
     std::vector<std::string> generateFeatureTemplates(std::shared_ptr<FeatureTemplateGenerator<T>> featureTemplateGenerator) {
-        auto featureTemplateListList = featureTemplateGenerator->generateFeatureTemplates(observationList);
+        HighOrderCRF::FeatureTemplateBuffer featureTemplateBuffer;
+        featureTemplateBuffer.reset(observationList.size());
+        featureTemplateGenerator->generateFeatureTemplates(observationList, &featureTemplateBuffer);
+        featureTemplateBuffer.finish();
         std::vector<std::string> ret;
         ret.reserve(observationList.size());
 
@@ -65,13 +68,15 @@ public:
             ss << "\t";
 
             bool isFirst = true;
-            for (const auto featureTemplate : featureTemplateListList[pos]) {
+            for (size_t i = 0; i < featureTemplateBuffer.getFeatureTemplateCount(pos); ++i) {
                 if (!isFirst) {
                     ss << "\t";
                 }
-                ss << featureTemplate.getLabelLength();
+                size_t tagLength;
+                const char *tag = featureTemplateBuffer.getTag(pos, i, &tagLength);
+                ss << featureTemplateBuffer.getLabelLength(pos, i);
                 ss << ":";
-                ss << featureTemplate.getTag();
+                ss.write(tag, tagLength);
                 isFirst = false;
             }
             ret.emplace_back(ss.str());
@@ -1,7 +1,7 @@
 #include "SegmenterDataConverter.h"
 
 #include "../HighOrderCRF/DataSequence.h"
-#include "../HighOrderCRF/FeatureTemplate.h"
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/CharWithSpace.h"
 #include "../Utility/StringUtil.h"
 #include "AggregatedFeatureTemplateGenerator.h"
@@ -110,7 +110,11 @@ shared_ptr<HighOrderCRF::DataSequence> SegmenterDataConverter::toDataSequence(co
         labelList.emplace_back(move(label));
         observationList.emplace_back(cl, hasSpace);
     }
-    return make_shared<HighOrderCRF::DataSequence>(move(originalStringList), move(labelList), move(possibleLabelSetList), generator->generateFeatureTemplates(observationList));
+    static thread_local HighOrderCRF::FeatureTemplateBuffer featureTemplateBuffer;
+    featureTemplateBuffer.reset(observationList.size());
+    generator->generateFeatureTemplates(observationList, &featureTemplateBuffer);
+    featureTemplateBuffer.finish();
+    return make_shared<HighOrderCRF::DataSequence>(move(originalStringList), move(labelList), move(possibleLabelSetList), featureTemplateBuffer.release());
 }
 
 }  // namespace DataConverter
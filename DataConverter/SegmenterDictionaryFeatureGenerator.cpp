@@ -1,7 +1,9 @@
 #include "SegmenterDictionaryFeatureGenerator.h"
 
 #include "../Dictionary/DictionaryClass.h"
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/CharWithSpace.h"
+#include "../Utility/CharacterCluster.h"
 
 #include <algorithm>
 #include <cassert>
@@ -21,7 +23,7 @@ using std::unordered_set;
 using std::vector;
 
 using Dictionary::DictionaryClass;
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 using Utility::CharWithSpace;
 
 SegmenterDictionaryFeatureGenerator::SegmenterDictionaryFeatureGenerator(const unordered_set<string> &dictionaries, size_t maxLabelLength) {
@@ -29,18 +31,22 @@ SegmenterDictionaryFeatureGenerator::SegmenterDictionaryFeatureGenerator(const u
     this->maxLabelLength = maxLabelLength;
 }
 
-vector<vector<FeatureTemplate>> SegmenterDictionaryFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList(observationList.size());
-
+void SegmenterDictionaryFeatureGenerator::generateFeatureTemplates(const vector<CharWithSpace> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
     // Generates all the templates
         
     // Reconstructs the whole sentence, recording the start positions
     string sentence;
     vector<size_t> startPosList;
         
-    for (const auto uchar : observationList) {
+    for (const auto &uchar : observationList) {
         startPosList.emplace_back(sentence.length());
-        sentence += uchar.toString();
+        if (uchar.hasSpace()) {
+            sentence += ' ';
+        }
+        for (const auto &c : uchar.getCharacterCluster().getCharacterList()) {
+            char utf8[4];
+            sentence.append(utf8, c.toUtf8(utf8));
+        }
     }
     startPosList.emplace_back(sentence.length());
 
@@ -52,7 +58,7 @@ vector<vector<FeatureTemplate>> SegmenterDictionaryFeatureGenerator::generateFea
 
     for (size_t i = 0; i < startPosList.size() - 1; ++i) {
         size_t startUtf8Pos = startPosList[i];
-        auto ch = observationList[i];
+        const auto &ch = observationList[i];
         // skip the space if there is one
         if (ch.hasSpace()) {
             ++startUtf8Pos;
@@ -83,21 +89,20 @@ vector<vector<FeatureTemplate>> SegmenterDictionaryFeatureGenerator::generateFea
             }
             bool hasLeftSpace = ch.hasSpace();
             bool hasRightSpace = (endCharPos < observationList.size() ? observationList[endCharPos].hasSpace() : true);
-            string spaceStr;
-            if (hasLeftSpace) {
-                spaceStr += "LS";
-            }
-            if (hasRightSpace) {
-                spaceStr += "RS";
-            }
-            spaceStr += "-";
+            const char *spaceStr = hasLeftSpace ? (hasRightSpace ? "LSRS-" : "LS-") : (hasRightSpace ? "RS-" : "-");
 
             // Feature template for the left position
-            auto &leftTemplateList = featureTemplateListList[i];
             for (const auto &featureStr : featureSet) {
-                leftTemplateList.emplace_back(string("Rw-") + featureStr, 1);
+                featureTemplateBuffer->startTag();
+                featureTemplateBuffer->appendToTag("Rw-");
+                featureTemplateBuffer->appendToTag(featureStr);
+                featureTemplateBuffer->addFeatureTemplate(i, 1);
                 if (hasLeftSpace || hasRightSpace) {
-                    leftTemplateList.emplace_back(string("Rw") + spaceStr + featureStr, 1);
+                    featureTemplateBuffer->startTag();
+                    featureTemplateBuffer->appendToTag("Rw");
+                    featureTemplateBuffer->appendToTag(spaceStr);
+                    featureTemplateBuffer->appendToTag(featureStr);
+                    featureTemplateBuffer->addFeatureTemplate(i, 1);
                 }
             }
 
@@ -105,18 +110,30 @@ vector<vector<FeatureTemplate>> SegmenterDictionaryFeatureGenerator::generateFea
                 continue;
             }
             // Feature templates for the right position
-            auto &rightTemplateList = featureTemplateListList[endCharPos];
             for (const auto &featureStr : featureSet) {
-                rightTemplateList.emplace_back(string("Lw-") + featureStr, 1);
-                rightTemplateList.emplace_back(string("LW-") + featureStr, labelLength);
+                featureTemplateBuffer->startTag();
+                featureTemplateBuffer->appendToTag("Lw-");
+                featureTemplateBuffer->appendToTag(featureStr);
+                featureTemplateBuffer->addFeatureTemplate(endCharPos, 1);
+                featureTemplateBuffer->startTag();
+                featureTemplateBuffer->appendToTag("LW-");
+                featureTemplateBuffer->appendToTag(featureStr);
+                featureTemplateBuffer->addFeatureTemplate(endCharPos, labelLength);
                 if (hasLeftSpace || hasRightSpace) {
-                    rightTemplateList.emplace_back(string("Lw") + spaceStr + featureStr, 1);
-                    rightTemplateList.emplace_back(string("LW") + spaceStr + featureStr, labelLength);
+                    featureTemplateBuffer->startTag();
+                    featureTemplateBuffer->appendToTag("Lw");
+                    featureTemplateBuffer->appendToTag(spaceStr);
+                    featureTemplateBuffer->appendToTag(featureStr);
+                    featureTemplateBuffer->addFeatureTemplate(endCharPos, 1);
+                    featureTemplateBuffer->startTag();
+                    featureTemplateBuffer->appendToTag("LW");
+                    featureTemplateBuffer->appendToTag(spaceStr);
+                    featureTemplateBuffer->appendToTag(featureStr);
+                    featureTemplateBuffer->addFeatureTemplate(endCharPos, labelLength);
                 }
             }
         }
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
@@ -20,7 +20,7 @@ namespace DataConverter {
 class SegmenterDictionaryFeatureGenerator : public FeatureTemplateGenerator<Utility::CharWithSpace> {
 public:
     SegmenterDictionaryFeatureGenerator(const std::unordered_set<std::string> &dictionaries, size_t maxLabelLength);
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<Utility::CharWithSpace> &observationList) const;
+    virtual void generateFeatureTemplates(const std::vector<Utility::CharWithSpace> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const;
 
 private:
     std::shared_ptr<Dictionary::DictionaryClass> dictionary;
@@ -1,6 +1,7 @@
 #include "TaggerDataConverter.h"
 
 #include "../Dictionary/DictionaryClass.h"
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/StringUtil.h"
 #include "AggregatedFeatureTemplateGenerator.h"
 #include "DictionaryFeatureGenerator.h"
@@ -105,7 +106,11 @@ shared_ptr<HighOrderCRF::DataSequence> TaggerDataConverter::toDataSequence(const
         observationList.emplace_back(move(word));
     }
     
-    return make_shared<HighOrderCRF::DataSequence>(move(originalStringList), move(labelList), move(possibleLabelSetList), generator->generateFeatureTemplates(observationList));
+    static thread_local HighOrderCRF::FeatureTemplateBuffer featureTemplateBuffer;
+    featureTemplateBuffer.reset(observationList.size());
+    generator->generateFeatureTemplates(observationList, &featureTemplateBuffer);
+    featureTemplateBuffer.finish();
+    return make_shared<HighOrderCRF::DataSequence>(move(originalStringList), move(labelList), move(possibleLabelSetList), featureTemplateBuffer.release());
 }
 
 }  // namespace DataConverter
@@ -14,14 +14,12 @@ class UnconditionalFeatureTemplateGenerator : public FeatureTemplateGenerator<T>
 {
 public:
     UnconditionalFeatureTemplateGenerator(size_t maxLabelLength) : maxLabelLength(maxLabelLength) {};
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<T> &observationList) const {
-        std::vector<std::vector<HighOrderCRF::FeatureTemplate>> featureTemplateListList(observationList.size());
+    virtual void generateFeatureTemplates(const std::vector<T> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const {
         for (size_t pos = 0; pos < observationList.size(); ++pos) {
             for (size_t i = 1; i <= std::min(maxLabelLength, pos + 1); ++i) {
-                featureTemplateListList[pos].emplace_back("*", i);
+                featureTemplateBuffer->addFeatureTemplate(pos, "*", 1, i);
             }
         }
-        return featureTemplateListList;
     }
 private:
     size_t maxLabelLength;
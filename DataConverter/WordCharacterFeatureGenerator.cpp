@@ -1,69 +1,52 @@
 #include "WordCharacterFeatureGenerator.h"
 
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
 #include "../Utility/UnicodeCharacter.h"
 
 #include <algorithm>
 #include <cassert>
 #include <memory>
-#include <sstream>
 #include <string>
-#include <unordered_set>
-#include <utility>
 #include <vector>
 
 namespace DataConverter {
 
-using std::move;
 using std::string;
-using std::stringstream;
-using std::unordered_set;
 using std::vector;
 
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 using Utility::UnicodeCharacter;
 
 WordCharacterFeatureGenerator::WordCharacterFeatureGenerator(size_t maxLength) {
     this->maxLength = maxLength;
 }
 
-static string utf8Substr(const string &str, size_t len, bool fromTail) {
-    vector<UnicodeCharacter> unicodeList;
-    for (auto it = str.begin(); it != str.end(); ) {
-        size_t charCount;
-        unicodeList.emplace_back(it, str.end(), &charCount);
-        it += charCount;
-    }
-    if (len > unicodeList.size()) {
-        return "";
-    }
-    stringstream ss;
-    for (size_t i = 0; i < len; ++i) {
-        ss << unicodeList[fromTail ? unicodeList.size() - len + i : i].toString();
-    }
-    return ss.str();
-}
-
-vector<vector<FeatureTemplate>> WordCharacterFeatureGenerator::generateFeatureTemplates(const vector<string> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList;
-    featureTemplateListList.reserve(observationList.size());
+void WordCharacterFeatureGenerator::generateFeatureTemplates(const vector<string> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
+    static thread_local vector<UnicodeCharacter> unicodeList;
     for (size_t pos = 0; pos < observationList.size(); ++pos) {
-        vector<FeatureTemplate> featureTemplateList;
+        const auto &str = observationList[pos];
+        unicodeList.clear();
+        for (auto it = str.begin(); it != str.end(); ) {
+            size_t charCount;
+            unicodeList.emplace_back(it, str.end(), &charCount);
+            it += charCount;
+        }
         bool ft[] = { false, true };
-        size_t wordLen = observationList[pos].size();
-        unordered_set<size_t> usedPosSet;
         for (auto fromTail : ft) {
-            for (size_t len = 1; len <= maxLength; ++len) {
-                string str = utf8Substr(observationList[pos], len, fromTail);
-                if (!str.empty()) {
-                    stringstream ss;
-                    ss << "C" << (fromTail ? "-" : "+") << len << "/" << str;
-                    featureTemplateList.emplace_back(ss.str(), 1);
+            for (size_t len = 1; len <= maxLength && len <= unicodeList.size(); ++len) {
+                // e.g. "C+2/" for the first 2 characters and "C-2/" for the last 2
+                featureTemplateBuffer->startTag();
+                featureTemplateBuffer->appendToTag('C');
+                featureTemplateBuffer->appendSignedNumberToTag(fromTail ? -(int)len : (int)len);
+                featureTemplateBuffer->appendToTag('/');
+                for (size_t i = 0; i < len; ++i) {
+                    char utf8[4];
+                    featureTemplateBuffer->appendToTag(utf8, unicodeList[fromTail ? unicodeList.size() - len + i : i].toUtf8(utf8));
                 }
+                featureTemplateBuffer->addFeatureTemplate(pos, 1);
             }
         }
-        featureTemplateListList.emplace_back(move(featureTemplateList));
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
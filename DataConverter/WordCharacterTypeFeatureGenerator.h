@@ -12,7 +12,7 @@ namespace DataConverter {
 class WordCharacterTypeFeatureGenerator : public FeatureTemplateGenerator<std::string> {
 public:
     WordCharacterTypeFeatureGenerator(size_t maxLength);
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<std::string> &observationList) const;
+    virtual void generateFeatureTemplates(const std::vector<std::string> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const;
 
 private:
     size_t maxLength;
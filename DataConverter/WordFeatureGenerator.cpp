@@ -1,21 +1,20 @@
 #include <algorithm>
 #include <cassert>
-#include <sstream>
 #include <string>
 #include <vector>
 
 #include "WordFeatureGenerator.h"
 
+#include "../HighOrderCRF/FeatureTemplateBuffer.h"
+
 namespace DataConverter {
 
 using std::max;
 using std::min;
-using std::showpos;
 using std::string;
-using std::stringstream;
 using std::vector;
 
-using HighOrderCRF::FeatureTemplate;
+using HighOrderCRF::FeatureTemplateBuffer;
 
 WordFeatureGenerator::WordFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength) {
     this->maxNgram = maxNgram;
@@ -23,8 +22,7 @@ WordFeatureGenerator::WordFeatureGenerator(size_t maxNgram, size_t maxWindow, si
     this->maxLabelLength = maxLabelLength;
 }
 
-vector<vector<FeatureTemplate>> WordFeatureGenerator::generateFeatureTemplates(const vector<string> &observationList) const {
-    vector<vector<FeatureTemplate>> featureTemplateListList(observationList.size());
+void WordFeatureGenerator::generateFeatureTemplates(const vector<string> &observationList, FeatureTemplateBuffer *featureTemplateBuffer) const {
     for (size_t pos = 0; pos < observationList.size(); ++pos) {
         int startPos = max(0, (int)pos - (int)maxWindow);
         size_t endPos = min(observationList.size(), pos + maxWindow + 1);
@@ -34,27 +32,26 @@ vector<vector<FeatureTemplate>> WordFeatureGenerator::generateFeatureTemplates(c
             size_t maxN = min(endPos - curPos, maxNgram);
             int curPosOffset = curPos - pos;
 
-            stringstream prefix;
-            prefix << "W" << showpos << curPosOffset << "/";
+            featureTemplateBuffer->startTag();
+            featureTemplateBuffer->appendToTag('W');
+            featureTemplateBuffer->appendSignedNumberToTag(curPosOffset);
+            featureTemplateBuffer->appendToTag('/');
             for (size_t n = 1; n <= maxN; ++n) {
+                // extends the tag of the (n-1)-gram
+                if (n > 1) {
+                    featureTemplateBuffer->appendToTag('_');
+                }
+                featureTemplateBuffer->appendToTag(observationList[curPos + n - 1]);
                 if (curPos + n < pos || curPos > pos + 1) {
                     continue;
                 }
-                string obs(prefix.str());
-                for (size_t offset = 0; offset < n; ++offset) {
-                    obs += observationList[curPos + offset];
-                    if (offset < n - 1) {
-                        obs += "_";
-                    }
-                }
                 size_t maxLen = min(maxLabelLength, pos - curPos + 1);
                 for (size_t labelLength = 1; labelLength <= maxLen; ++labelLength) {
-                    featureTemplateListList[pos].emplace_back(obs, labelLength);
+                    featureTemplateBuffer->addFeatureTemplate(pos, labelLength);
                 }
             }
         }
     }
-    return featureTemplateListList;
 }
 
 }  // namespace DataConverter
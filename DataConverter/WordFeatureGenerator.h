@@ -12,7 +12,7 @@ namespace DataConverter {
 class WordFeatureGenerator : public FeatureTemplateGenerator<std::string> {
 public:
     WordFeatureGenerator(size_t maxNgram, size_t maxWindow, size_t maxLabelLength);
-    virtual std::vector<std::vector<HighOrderCRF::FeatureTemplate>> generateFeatureTemplates(const std::vector<std::string> &observationList) const;
+    virtual void generateFeatureTemplates(const std::vector<std::string> &observationList, HighOrderCRF::FeatureTemplateBuffer *featureTemplateBuffer) const;
 
 private:
     size_t maxNgram;
@@ -1,9 +1,11 @@
 #include "DataSequence.h"
 
 #include "FeatureTemplate.h"
+#include "FeatureTemplateBuffer.h"
 #include "../Utility/FileUtil.h"
 #include "../Utility/StringUtil.h"
 
+#include <cstdlib>
 #include <iostream>
 #include <istream>
 #include <string>
@@ -17,6 +19,7 @@ namespace HighOrderCRF {
 
 using std::cerr;
 using std::endl;
+using std::exit;
 using std::istream;
 using std::move;
 using std::ostream;
@@ -29,12 +32,13 @@ using std::vector;
 DataSequence::DataSequence(vector<string> originalStringList,
                            vector<string> labels,
                            vector<set<string>> possibleLabelSetList,
-                           vector<vector<FeatureTemplate>> featureTemplateListList) {
+                           FeatureTemplateBuffer &&featureTemplateBuffer) {
     this->originalStringList = move(originalStringList);
     this->labels = move(labels);
     this->possibleLabelSetList = move(possibleLabelSetList);
-    this->featureTemplateListList = move(featureTemplateListList);
-    if (this->labels.size() != this->featureTemplateListList.size() ||
+    this->featureTemplateBuffer = move(featureTemplateBuffer);
+    this->featureTemplateBuffer.finish();
+    if (this->labels.size() != this->featureTemplateBuffer.length() ||
         this->labels.size() != this->possibleLabelSetList.size() ||
         this->labels.size() != this->originalStringList.size()) {
         cerr << "Sizes do not match." << endl;
@@ -46,6 +50,7 @@ DataSequence::DataSequence(istream &is) {
     string line;
 
     auto seq = Utility::readSequence(is);
+    featureTemplateBuffer.reset(seq.size());
     
     for (const auto &line : seq) {
         auto fields = Utility::splitString(line);
@@ -62,12 +67,21 @@ DataSequence::DataSequence(istream &is) {
         }
         possibleLabelSetList.emplace_back(move(possibleLabelSet));
         labels.emplace_back(move(fields[2]));
-        vector<FeatureTemplate> featureTemplateList;
+        size_t pos = labels.size() - 1;
         for (size_t i = 3; i < fields.size(); ++i) {
-            featureTemplateList.emplace_back(fields[i]);
+            // a feature template is written as <label length>:<tag>
+            const char *str = fields[i].c_str();
+            char *tag;
+            unsigned long labelLength = strtoul(str, &tag, 10);
+            if (tag == str || *tag != ':') {
+                cerr << "Invalid feature template: " << fields[i] << endl;
+                exit(1);
+            }
+            ++tag;
+            featureTemplateBuffer.addFeatureTemplate(pos, tag, fields[i].size() - (tag - str), labelLength);
         }
-        featureTemplateListList.emplace_back(featureTemplateList);
     }
+    featureTemplateBuffer.finish();
 }
 
 void DataSequence::write(ostream &os) const {
@@ -87,9 +101,12 @@ void DataSequence::write(ostream &os) const {
             }
         }
         os << "\t" << labels[i];
-        for (const auto &ft : featureTemplateListList[i]) {
+        for (size_t j = 0; j < featureTemplateBuffer.getFeatureTemplateCount(i); ++j) {
+            size_t tagLength;
+            const char *tag = featureTemplateBuffer.getTag(i, j, &tagLength);
             os << "\t";
-            os << ft.toString();
+            os << featureTemplateBuffer.getLabelLength(i, j) << ":";
+            os.write(tag, tagLength);
         }
         os << "\n";
     }
@@ -122,7 +139,7 @@ InternalDataSequence DataSequence::toInternalDataSequence(const unordered_map<st
         p.emplace_back(move(s));
     }
     
-    return InternalDataSequence(l, p, move(featureTemplateListList));
+    return InternalDataSequence(l, p, move(featureTemplateBuffer));
 }
 
 const vector<string> &DataSequence::getLabels() const {
@@ -145,7 +162,7 @@ unordered_set<string> DataSequence::getUsedLabelSet() const {
 }
 
 size_t DataSequence::length() const {
-    return featureTemplateListList.size();
+    return featureTemplateBuffer.length();
 }
 
 bool DataSequence::empty() const {
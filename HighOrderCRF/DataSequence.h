@@ -5,6 +5,7 @@
 
 #include "Feature.h"
 #include "FeatureTemplate.h"
+#include "FeatureTemplateBuffer.h"
 #include "InternalDataSequence.h"
 #include "LabelSequence.h"
 #include "PatternSetSequence.h"
@@ -24,7 +25,7 @@ public:
     DataSequence(std::vector<std::string> originalStringList,
                  std::vector<std::string> labels,
                  std::vector<std::set<std::string>> possibleLabelTypeSetList,
-                 std::vector<std::vector<FeatureTemplate>> featureTemplateListList);
+                 FeatureTemplateBuffer &&featureTemplateBuffer);
     DataSequence(std::istream &is);
     void write(std::ostream &os) const;
     // This method destroys the original object
@@ -38,7 +39,7 @@ private:
     std::vector<std::string> originalStringList;
     std::vector<std::string> labels;
     std::vector<std::set<std::string>> possibleLabelSetList;
-    std::vector<std::vector<FeatureTemplate>> featureTemplateListList;
+    FeatureTemplateBuffer featureTemplateBuffer;
 };
 
 }  // namespace HighOrderCRF
@@ -0,0 +1,159 @@
+#include "FeatureTemplateBuffer.h"
+
+#include "FeatureTemplate.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace HighOrderCRF {
+
+using std::move;
+using std::string;
+using std::vector;
+
+FeatureTemplateBuffer::FeatureTemplateBuffer() : sequenceLength(0), finished(false), tagStart(0) {}
+
+void FeatureTemplateBuffer::reset(size_t length) {
+    sequenceLength = length;
+    finished = false;
+    tagStart = 0;
+    tagPool.clear();
+    entryList.clear();
+    positionOffsetList.clear();
+}
+
+size_t FeatureTemplateBuffer::length() const {
+    return sequenceLength;
+}
+
+void FeatureTemplateBuffer::startTag() {
+    tagStart = tagPool.size();
+}
+
+void FeatureTemplateBuffer::appendToTag(const char *data, size_t size) {
+    tagPool.insert(tagPool.end(), data, data + size);
+}
+
+void FeatureTemplateBuffer::appendToTag(const char *str) {
+    appendToTag(str, strlen(str));
+}
+
+void FeatureTemplateBuffer::appendToTag(const string &str) {
+    appendToTag(str.data(), str.size());
+}
+
+void FeatureTemplateBuffer::appendToTag(char c) {
+    tagPool.emplace_back(c);
+}
+
+void FeatureTemplateBuffer::appendSignedNumberToTag(int num) {
+    char digits[16];
+    size_t len = 0;
+    unsigned int n = num < 0 ? -(unsigned int)num : num;
+    do {
+        digits[len++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    appendToTag(num < 0 ? '-' : '+');
+    while (len > 0) {
+        appendToTag(digits[--len]);
+    }
+}
+
+void FeatureTemplateBuffer::addFeatureTemplate(size_t pos, size_t labelLength) {
+    assert(!finished && pos < sequenceLength);
+    Entry e;
+    e.pos = pos;
+    e.tagOffset = tagStart;
+    e.tagLength = tagPool.size() - tagStart;
+    e.labelLength = labelLength;
+    entryList.emplace_back(e);
+}
+
+void FeatureTemplateBuffer::addFeatureTemplate(size_t pos, const char *tag, size_t tagLength, size_t labelLength) {
+    // reuses the tag of the last template if it is the same
+    if (entryList.empty() ||
+        entryList.back().tagLength != tagLength ||
+        memcmp(tagPool.data() + entryList.back().tagOffset, tag, tagLength) != 0) {
+        startTag();
+        appendToTag(tag, tagLength);
+    }
+    else {
+        tagStart = entryList.back().tagOffset;
+    }
+    addFeatureTemplate(pos, labelLength);
+}
+
+void FeatureTemplateBuffer::addFeatureTemplate(size_t pos, const FeatureTemplate &featureTemplate) {
+    const auto &tag = featureTemplate.getTag();
+    addFeatureTemplate(pos, tag.data(), tag.size(), featureTemplate.getLabelLength());
+}
+
+void FeatureTemplateBuffer::finish() {
+    if (finished) {
+        return;
+    }
+    // a stable counting sort by position
+    positionOffsetList.assign(sequenceLength + 1, 0);
+    for (const auto &e : entryList) {
+        ++positionOffsetList[e.pos + 1];
+    }
+    for (size_t pos = 1; pos <= sequenceLength; ++pos) {
+        positionOffsetList[pos] += positionOffsetList[pos - 1];
+    }
+    sortBuffer.resize(entryList.size());
+    for (const auto &e : entryList) {
+        sortBuffer[positionOffsetList[e.pos]++] = e;
+    }
+    for (size_t pos = sequenceLength; pos > 0; --pos) {
+        positionOffsetList[pos] = positionOffsetList[pos - 1];
+    }
+    positionOffsetList[0] = 0;
+    entryList.swap(sortBuffer);
+    sortBuffer.clear();
+    finished = true;
+}
+
+FeatureTemplateBuffer FeatureTemplateBuffer::release() {
+    size_t tagPoolCapacity = tagPool.capacity();
+    size_t entryListCapacity = entryList.capacity();
+    size_t positionOffsetListCapacity = positionOffsetList.capacity();
+    FeatureTemplateBuffer ret;
+    ret.sequenceLength = sequenceLength;
+    ret.finished = finished;
+    ret.tagStart = tagStart;
+    ret.tagPool = move(tagPool);
+    ret.entryList = move(entryList);
+    ret.positionOffsetList = move(positionOffsetList);
+    reset(0);
+    tagPool.reserve(tagPoolCapacity);
+    entryList.reserve(entryListCapacity);
+    positionOffsetList.reserve(positionOffsetListCapacity);
+    return ret;
+}
+
+size_t FeatureTemplateBuffer::getFeatureTemplateCount(size_t pos) const {
+    assert(finished);
+    return positionOffsetList[pos + 1] - positionOffsetList[pos];
+}
+
+const char *FeatureTemplateBuffer::getTag(size_t pos, size_t index, size_t *tagLength) const {
+    const auto &e = entryList[positionOffsetList[pos] + index];
+    *tagLength = e.tagLength;
+    return tagPool.data() + e.tagOffset;
+}
+
+size_t FeatureTemplateBuffer::getLabelLength(size_t pos, size_t index) const {
+    return entryList[positionOffsetList[pos] + index].labelLength;
+}
+
+FeatureTemplate FeatureTemplateBuffer::getFeatureTemplate(size_t pos, size_t index) const {
+    size_t tagLength;
+    const char *tag = getTag(pos, index, &tagLength);
+    return FeatureTemplate(string(tag, tagLength), getLabelLength(pos, index));
+}
+
+}  // namespace HighOrderCRF
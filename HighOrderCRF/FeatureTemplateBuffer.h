@@ -0,0 +1,71 @@
+#ifndef HOCRF_HIGH_ORDER_CRF_FEATURE_TEMPLATE_BUFFER_H_
+#define HOCRF_HIGH_ORDER_CRF_FEATURE_TEMPLATE_BUFFER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace HighOrderCRF {
+
+class FeatureTemplate;
+
+// Holds the feature templates of a sequence in flat arrays. The tags are
+// written into a single byte pool, so adding templates does not allocate
+// memory once the buffer has grown large enough, and a buffer can be reused
+// for many sequences through reset().
+//
+// A tag is built by calling startTag() and then appending bytes to it. Each
+// call to addFeatureTemplate(pos, labelLength) adds a template whose tag is
+// everything appended since the last startTag(), so a generator can add a
+// tag for an n-gram, append the next observation, and add the tag for the
+// (n+1)-gram without copying the common prefix.
+//
+// Templates can be added at any position in any order. After finish() is
+// called, they are grouped by position, keeping the order in which they were
+// added at each position.
+class FeatureTemplateBuffer {
+public:
+    FeatureTemplateBuffer();
+    // Removes all the templates, keeping the allocated memory.
+    void reset(size_t length);
+    size_t length() const;
+
+    void startTag();
+    void appendToTag(const char *data, size_t size);
+    void appendToTag(const char *str);
+    void appendToTag(const std::string &str);
+    void appendToTag(char c);
+    // Appends a number with an explicit sign, such as "+1" or "-2".
+    void appendSignedNumberToTag(int num);
+    void addFeatureTemplate(size_t pos, size_t labelLength);
+    void addFeatureTemplate(size_t pos, const char *tag, size_t tagLength, size_t labelLength);
+    void addFeatureTemplate(size_t pos, const FeatureTemplate &featureTemplate);
+    void finish();
+    // Moves the templates into a new buffer without copying them. This
+    // buffer is left empty, with as much memory reserved as it had.
+    FeatureTemplateBuffer release();
+
+    size_t getFeatureTemplateCount(size_t pos) const;
+    const char *getTag(size_t pos, size_t index, size_t *tagLength) const;
+    size_t getLabelLength(size_t pos, size_t index) const;
+    FeatureTemplate getFeatureTemplate(size_t pos, size_t index) const;
+
+private:
+    struct Entry {
+        uint32_t pos;
+        uint32_t tagOffset;
+        uint32_t tagLength;
+        uint32_t labelLength;
+    };
+    size_t sequenceLength;
+    bool finished;
+    uint32_t tagStart;
+    std::vector<char> tagPool;
+    std::vector<Entry> entryList;
+    std::vector<Entry> sortBuffer;
+    std::vector<uint32_t> positionOffsetList;
+};
+
+}  // namespace HighOrderCRF
+
+#endif  // HOCRF_HIGH_ORDER_CRF_FEATURE_TEMPLATE_BUFFER_H_
@@ -2,11 +2,15 @@
 
 #include "FeatureTemplate.h"
 #include "LabelSequence.h"
+#include "../Utility/MappedFile.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -19,26 +23,242 @@ using std::cerr;
 using std::endl;
 using std::exit;
 using std::ios;
-using std::ifstream;
+using std::lock_guard;
 using std::make_pair;
+using std::make_shared;
+using std::max;
 using std::move;
+using std::mutex;
 using std::ofstream;
+using std::pair;
+using std::sort;
 using std::string;
 using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
+// The layout of the memory-mappable model file. All the numbers are stored
+// in the native byte order, which is checked by byteOrderMark when reading.
+// Each section starts at an offset aligned to 8 bytes.
+//
+// The feature templates are sorted by their tags and label lengths, and
+// are looked up through an open-addressing hash table whose slots hold
+// template indexes (INVALID_FEATURE_TEMPLATE for an empty slot). The table
+// size is a power of two and collisions are resolved by linear probing.
+// The feature indexes of the i-th template are
+//   featureTemplateFeatureIndexList[featureTemplateFeatureOffsetList[i]
+//                                   .. featureTemplateFeatureOffsetList[i + 1]],
+// and the same scheme is used for the tags, the label sequences and the
+// label strings.
+//
+// A hashed model has no feature templates. The feature offsets and indexes
+// are those of the hash buckets instead, and hold label sequence indexes.
+// The number of the buckets is that of the weights, and the features have
+// no label sequence indexes of their own.
+enum ModelImageSection {
+    FEATURE_TEMPLATE_TAG_OFFSETS,
+    FEATURE_TEMPLATE_TAGS,
+    FEATURE_TEMPLATE_LABEL_LENGTHS,
+    FEATURE_TEMPLATE_FEATURE_OFFSETS,
+    FEATURE_TEMPLATE_FEATURE_INDEXES,
+    WEIGHTS,
+    FEATURE_LABEL_SEQUENCE_INDEXES,
+    LABEL_SEQUENCE_OFFSETS,
+    LABEL_SEQUENCE_LABELS,
+    LABEL_STRING_OFFSETS,
+    LABEL_STRINGS,
+    FEATURE_TEMPLATE_HASH_TABLE,
+    MODEL_IMAGE_SECTION_COUNT
+};
+
+struct ModelImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t featureTemplateCount;
+    uint32_t featureCount;
+    uint32_t labelSequenceCount;
+    uint32_t labelCount;
+    uint32_t featureTemplateHashTableSize;
+    // the bit count of the feature indexes of a hashed model (0 for the
+    // other models), and FEATURE_HASH_SIGNED for signed hashing
+    uint32_t featureHashing;
+    uint64_t imageSize;
+    uint64_t sectionOffsetList[MODEL_IMAGE_SECTION_COUNT];
+};
+
+static const char MODEL_IMAGE_MAGIC[8] = { 'H', 'O', 'C', 'R', 'F', 'M', 'D', 'L' };
+static const uint32_t MODEL_IMAGE_VERSION = 3;
+// version 2 has the same layout without hashed models
+static const uint32_t MODEL_IMAGE_MIN_VERSION = 2;
+static const uint32_t FEATURE_HASH_BIT_COUNT_MASK = 0xff;
+static const uint32_t FEATURE_HASH_SIGNED = 0x100;
+static const uint32_t MAX_FEATURE_HASH_BIT_COUNT = 31;
+static const uint32_t MODEL_IMAGE_BYTE_ORDER_MARK = 0x01020304;
+
+// The contents of a model in a form that is easy to build the image from.
+struct ModelContents {
+    vector<pair<FeatureTemplate, vector<uint32_t>>> featureTemplateList;
+    vector<weight_t> weightList;
+    vector<uint32_t> featureLabelSequenceIndexList;
+    vector<vector<label_t>> labelSequenceList;
+    vector<string> labelStringList;
+    uint32_t featureHashing;
+    vector<uint32_t> bucketOffsetList;
+    vector<uint32_t> bucketLabelSequenceIndexList;
+
+    ModelContents() : featureHashing(0) {}
+};
+
+int compareFeatureTemplate(const char *tag1, size_t tagLength1, size_t labelLength1,
+                           const char *tag2, size_t tagLength2, size_t labelLength2) {
+    int ret = memcmp(tag1, tag2, std::min(tagLength1, tagLength2));
+    if (ret != 0) {
+        return ret;
+    }
+    if (tagLength1 != tagLength2) {
+        return tagLength1 < tagLength2 ? -1 : 1;
+    }
+    if (labelLength1 != labelLength2) {
+        return labelLength1 < labelLength2 ? -1 : 1;
+    }
+    return 0;
+}
+
+// FNV-1a over the tag bytes followed by the label length. The hash values
+// are stored in model files, so this must not depend on the platform.
+uint64_t hashFeatureTemplate(const char *tag, size_t tagLength, size_t labelLength) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < tagLength; ++i) {
+        h ^= (unsigned char)tag[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= (uint64_t)labelLength;
+    h *= 0x100000001b3ULL;
+    return h ^ (h >> 32);
+}
+
 template<class T>
-T readNumber(ifstream *ifs) {
+void appendSection(vector<char> *image, uint64_t *offset, const T *data, size_t count) {
+    image->resize((image->size() + 7) & ~(size_t)7);
+    *offset = image->size();
+    const char *p = reinterpret_cast<const char *>(data);
+    image->insert(image->end(), p, p + sizeof(T) * count);
+}
+
+vector<char> buildImage(ModelContents *contents) {
+    auto &featureTemplateList = contents->featureTemplateList;
+    sort(featureTemplateList.begin(), featureTemplateList.end(),
+         [](const pair<FeatureTemplate, vector<uint32_t>> &a, const pair<FeatureTemplate, vector<uint32_t>> &b) {
+             const auto &tagA = a.first.getTag();
+             const auto &tagB = b.first.getTag();
+             return compareFeatureTemplate(tagA.data(), tagA.size(), a.first.getLabelLength(),
+                                           tagB.data(), tagB.size(), b.first.getLabelLength()) < 0;
+         });
+
+    vector<uint32_t> tagOffsetList;
+    string tagData;
+    vector<uint32_t> labelLengthList;
+    vector<uint32_t> featureOffsetList;
+    vector<uint32_t> featureIndexList;
+    tagOffsetList.reserve(featureTemplateList.size() + 1);
+    labelLengthList.reserve(featureTemplateList.size());
+    featureOffsetList.reserve(featureTemplateList.size() + 1);
+    for (const auto &entry : featureTemplateList) {
+        tagOffsetList.emplace_back(tagData.size());
+        tagData += entry.first.getTag();
+        labelLengthList.emplace_back(entry.first.getLabelLength());
+        featureOffsetList.emplace_back(featureIndexList.size());
+        featureIndexList.insert(featureIndexList.end(), entry.second.begin(), entry.second.end());
+    }
+    tagOffsetList.emplace_back(tagData.size());
+    featureOffsetList.emplace_back(featureIndexList.size());
+    if (contents->featureHashing != 0) {
+        featureOffsetList = move(contents->bucketOffsetList);
+        featureIndexList = move(contents->bucketLabelSequenceIndexList);
+    }
+
+    vector<uint32_t> labelSequenceOffsetList;
+    vector<label_t> labelSequenceLabelList;
+    labelSequenceOffsetList.reserve(contents->labelSequenceList.size() + 1);
+    for (const auto &labels : contents->labelSequenceList) {
+        labelSequenceOffsetList.emplace_back(labelSequenceLabelList.size());
+        labelSequenceLabelList.insert(labelSequenceLabelList.end(), labels.begin(), labels.end());
+    }
+    labelSequenceOffsetList.emplace_back(labelSequenceLabelList.size());
+
+    vector<uint32_t> labelStringOffsetList;
+    string labelStringData;
+    labelStringOffsetList.reserve(contents->labelStringList.size() + 1);
+    for (const auto &str : contents->labelStringList) {
+        labelStringOffsetList.emplace_back(labelStringData.size());
+        labelStringData += str;
+    }
+    labelStringOffsetList.emplace_back(labelStringData.size());
+
+    // keeps the load factor at most 1/2
+    uint32_t hashTableSize = 1;
+    while (hashTableSize < featureTemplateList.size() * 2) {
+        hashTableSize <<= 1;
+    }
+    vector<uint32_t> hashTable(hashTableSize, INVALID_FEATURE_TEMPLATE);
+    for (uint32_t i = 0; i < featureTemplateList.size(); ++i) {
+        const auto &tag = featureTemplateList[i].first.getTag();
+        size_t slot = hashFeatureTemplate(tag.data(), tag.size(), featureTemplateList[i].first.getLabelLength()) & (hashTableSize - 1);
+        while (hashTable[slot] != INVALID_FEATURE_TEMPLATE) {
+            slot = (slot + 1) & (hashTableSize - 1);
+        }
+        hashTable[slot] = i;
+    }
+
+    ModelImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_IMAGE_VERSION;
+    header.byteOrderMark = MODEL_IMAGE_BYTE_ORDER_MARK;
+    header.featureTemplateCount = featureTemplateList.size();
+    header.featureCount = contents->weightList.size();
+    header.labelSequenceCount = contents->labelSequenceList.size();
+    header.labelCount = contents->labelStringList.size();
+    header.featureTemplateHashTableSize = hashTableSize;
+    header.featureHashing = contents->featureHashing;
+
+    vector<char> image(sizeof(header));
+    auto offsets = header.sectionOffsetList;
+    appendSection(&image, &offsets[FEATURE_TEMPLATE_TAG_OFFSETS], tagOffsetList.data(), tagOffsetList.size());
+    appendSection(&image, &offsets[FEATURE_TEMPLATE_TAGS], tagData.data(), tagData.size());
+    appendSection(&image, &offsets[FEATURE_TEMPLATE_LABEL_LENGTHS], labelLengthList.data(), labelLengthList.size());
+    appendSection(&image, &offsets[FEATURE_TEMPLATE_FEATURE_OFFSETS], featureOffsetList.data(), featureOffsetList.size());
+    appendSection(&image, &offsets[FEATURE_TEMPLATE_FEATURE_INDEXES], featureIndexList.data(), featureIndexList.size());
+    appendSection(&image, &offsets[WEIGHTS], contents->weightList.data(), contents->weightList.size());
+    appendSection(&image, &offsets[FEATURE_LABEL_SEQUENCE_INDEXES], contents->featureLabelSequenceIndexList.data(), contents->featureLabelSequenceIndexList.size());
+    appendSection(&image, &offsets[LABEL_SEQUENCE_OFFSETS], labelSequenceOffsetList.data(), labelSequenceOffsetList.size());
+    appendSection(&image, &offsets[LABEL_SEQUENCE_LABELS], labelSequenceLabelList.data(), labelSequenceLabelList.size());
+    appendSection(&image, &offsets[LABEL_STRING_OFFSETS], labelStringOffsetList.data(), labelStringOffsetList.size());
+    appendSection(&image, &offsets[LABEL_STRINGS], labelStringData.data(), labelStringData.size());
+    appendSection(&image, &offsets[FEATURE_TEMPLATE_HASH_TABLE], hashTable.data(), hashTable.size());
+    image.resize((image.size() + 7) & ~(size_t)7);
+    header.imageSize = image.size();
+    memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+// Functions for reading the legacy model format, in which the numbers are
+// stored in little endian regardless of the platform.
+template<class T>
+T readNumber(const char **p, const char *end) {
+    if ((size_t)(end - *p) < sizeof(T)) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
     T num;
     memset(&num, 0, sizeof(T));
-    unsigned char val;
     size_t shift = 0;
     for (size_t i = 0; i < sizeof(T); ++i) {
-        ifs->read((char *)&val, 1);
-        num |= ((T)val << shift);
+        num |= ((T)(unsigned char)(*p)[i] << shift);
         shift += 8;
     }
+    *p += sizeof(T);
     return num;
 }
 
@@ -53,276 +273,718 @@ void writeNumber(ofstream *ofs, T num) {
     }
 }
 
-string readString(ifstream *ifs, vector<char> *buffer) {
-    string str;
-    uint32_t len = readNumber<uint32_t>(ifs);
-    if (len > buffer->size()) {
-        buffer->resize(len);
+string readString(const char **p, const char *end) {
+    uint32_t len = readNumber<uint32_t>(p, end);
+    if ((size_t)(end - *p) < len) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
     }
-    ifs->read(buffer->data(), len);
-    str.assign(buffer->begin(), buffer->begin() + len);
+    string str(*p, len);
+    *p += len;
     return str;
 }
 
-void writeString(ofstream *ofs, const string &str) {
-    writeNumber<uint32_t>(ofs, str.size());
-    ofs->write(str.data(), str.size());
+void writeString(ofstream *ofs, const char *str, size_t len) {
+    writeNumber<uint32_t>(ofs, len);
+    ofs->write(str, len);
 }
 
-HighOrderCRFData::HighOrderCRFData(unordered_map<FeatureTemplate, vector<uint32_t>> featureTemplateToFeatureIndexListMap, vector<double> weightList, vector<uint32_t> featureLabelSequenceIndexList, vector<LabelSequence> labelSequenceList, unordered_map<string, label_t> labelMap) {
-    this->featureTemplateToFeatureIndexListMap = move(featureTemplateToFeatureIndexListMap);
-    this->featureLabelSequenceIndexList = move(featureLabelSequenceIndexList);
-    this->labelSequenceList = move(labelSequenceList);
-    this->labelMap = move(labelMap);
-    this->weightList.reserve(weightList.size());
+HighOrderCRFData::HighOrderCRFData(unordered_map<FeatureTemplate, vector<uint32_t>> featureTemplateToFeatureIndexListMap, vector<double> weightList, vector<uint32_t> featureLabelSequenceIndexList, vector<LabelSequence> labelSequenceList, unordered_map<string, label_t> labelMap) : HighOrderCRFData() {
+    ModelContents contents;
+    contents.featureTemplateList.reserve(featureTemplateToFeatureIndexListMap.size());
+    for (auto &entry : featureTemplateToFeatureIndexListMap) {
+        contents.featureTemplateList.emplace_back(entry.first, move(entry.second));
+    }
+    featureTemplateToFeatureIndexListMap.clear();
+    contents.weightList.reserve(weightList.size());
     for (auto w : weightList) {
-        this->weightList.emplace_back(double_to_weight(w));
+        contents.weightList.emplace_back(double_to_weight(w));
+    }
+    contents.featureLabelSequenceIndexList = move(featureLabelSequenceIndexList);
+    contents.labelSequenceList.reserve(labelSequenceList.size());
+    for (const auto &seq : labelSequenceList) {
+        contents.labelSequenceList.emplace_back(seq.getLabelData(), seq.getLabelData() + seq.getLength());
     }
-    setExpWeightList();
+    contents.labelStringList.resize(labelMap.size());
+    for (auto &entry : labelMap) {
+        contents.labelStringList[entry.second] = entry.first;
+    }
+
+    imageBuffer = buildImage(&contents);
+    setImage(imageBuffer.data(), imageBuffer.size());
 }
 
-HighOrderCRFData::HighOrderCRFData() {}
+HighOrderCRFData::HighOrderCRFData(uint32_t featureHashBitCount, bool signedHashing, vector<uint32_t> bucketOffsetList, vector<uint32_t> bucketLabelSequenceIndexList, vector<LabelSequence> labelSequenceList, unordered_map<string, label_t> labelMap) : HighOrderCRFData() {
+    if (featureHashBitCount == 0 || featureHashBitCount > MAX_FEATURE_HASH_BIT_COUNT) {
+        cerr << "The number of the hash bits must be from 1 to " << MAX_FEATURE_HASH_BIT_COUNT << "." << endl;
+        exit(1);
+    }
+    ModelContents contents;
+    contents.featureHashing = featureHashBitCount | (signedHashing ? FEATURE_HASH_SIGNED : 0);
+    contents.bucketOffsetList = move(bucketOffsetList);
+    contents.bucketLabelSequenceIndexList = move(bucketLabelSequenceIndexList);
+    contents.weightList.assign((size_t)1 << featureHashBitCount, double_to_weight(0.0));
+    contents.labelSequenceList.reserve(labelSequenceList.size());
+    for (const auto &seq : labelSequenceList) {
+        contents.labelSequenceList.emplace_back(seq.getLabelData(), seq.getLabelData() + seq.getLength());
+    }
+    contents.labelStringList.resize(labelMap.size());
+    for (auto &entry : labelMap) {
+        contents.labelStringList[entry.second] = entry.first;
+    }
 
-const unordered_map<FeatureTemplate, vector<uint32_t>> &HighOrderCRFData::getFeatureTemplateToFeatureIndexMapList() const {
-    return featureTemplateToFeatureIndexListMap;
+    imageBuffer = buildImage(&contents);
+    setImage(imageBuffer.data(), imageBuffer.size());
 }
 
-const vector<weight_t> &HighOrderCRFData::getWeightList() const {
-    return weightList;
+HighOrderCRFData::HighOrderCRFData()
+    : image(nullptr), imageSize(0), featureTemplateCount(0), featureCount(0), labelSequenceCount(0), labelCount(0),
+      featureHashBitCount(0), signedHashing(false),
+      featureTemplateTagOffsetList(nullptr), featureTemplateTagData(nullptr), featureTemplateLabelLengthList(nullptr),
+      featureTemplateFeatureOffsetList(nullptr), featureTemplateFeatureIndexList(nullptr), weightList(nullptr),
+      featureLabelSequenceIndexList(nullptr), labelSequenceOffsetList(nullptr), labelSequenceLabelList(nullptr),
+      labelStringOffsetList(nullptr), labelStringData(nullptr),
+      featureTemplateHashTable(nullptr), featureTemplateHashTableMask(0) {}
+
+void HighOrderCRFData::setImage(const char *image, size_t imageSize) {
+    ModelImageHeader header;
+    if (imageSize < sizeof(header)) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, MODEL_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byteOrderMark != MODEL_IMAGE_BYTE_ORDER_MARK) {
+        cerr << "The model file is not in the mappable format of this platform." << endl;
+        exit(1);
+    }
+    if (header.version < MODEL_IMAGE_MIN_VERSION || header.version > MODEL_IMAGE_VERSION) {
+        cerr << "Unsupported model file version: " << header.version << endl;
+        exit(1);
+    }
+    if (header.imageSize != imageSize) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+
+    // Checks that a section lies within the image and returns its address.
+    auto section = [&](ModelImageSection s, size_t byteSize) {
+        uint64_t offset = header.sectionOffsetList[s];
+        if (offset % 8 != 0 || offset > imageSize || byteSize > imageSize - offset) {
+            cerr << "The model file is corrupted." << endl;
+            exit(1);
+        }
+        return image + offset;
+    };
+    uint32_t templateCount = header.featureTemplateCount;
+    uint32_t hashBitCount = header.featureHashing & FEATURE_HASH_BIT_COUNT_MASK;
+    if (hashBitCount > MAX_FEATURE_HASH_BIT_COUNT ||
+        (hashBitCount > 0 && (templateCount != 0 || header.featureCount != (uint32_t)1 << hashBitCount))) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+    // the feature lists of the templates, or of the buckets of a hashed model
+    uint32_t featureListCount = hashBitCount > 0 ? header.featureCount : templateCount;
+    featureTemplateTagOffsetList = reinterpret_cast<const uint32_t *>(section(FEATURE_TEMPLATE_TAG_OFFSETS, sizeof(uint32_t) * (templateCount + 1)));
+    featureTemplateTagData = section(FEATURE_TEMPLATE_TAGS, featureTemplateTagOffsetList[templateCount]);
+    featureTemplateLabelLengthList = reinterpret_cast<const uint32_t *>(section(FEATURE_TEMPLATE_LABEL_LENGTHS, sizeof(uint32_t) * templateCount));
+    featureTemplateFeatureOffsetList = reinterpret_cast<const uint32_t *>(section(FEATURE_TEMPLATE_FEATURE_OFFSETS, sizeof(uint32_t) * ((size_t)featureListCount + 1)));
+    featureTemplateFeatureIndexList = reinterpret_cast<const uint32_t *>(section(FEATURE_TEMPLATE_FEATURE_INDEXES, sizeof(uint32_t) * featureTemplateFeatureOffsetList[featureListCount]));
+    weightList = reinterpret_cast<const weight_t *>(section(WEIGHTS, sizeof(weight_t) * header.featureCount));
+    featureLabelSequenceIndexList = reinterpret_cast<const uint32_t *>(section(FEATURE_LABEL_SEQUENCE_INDEXES, sizeof(uint32_t) * (hashBitCount > 0 ? 0 : header.featureCount)));
+    labelSequenceOffsetList = reinterpret_cast<const uint32_t *>(section(LABEL_SEQUENCE_OFFSETS, sizeof(uint32_t) * (header.labelSequenceCount + 1)));
+    labelSequenceLabelList = reinterpret_cast<const label_t *>(section(LABEL_SEQUENCE_LABELS, sizeof(label_t) * labelSequenceOffsetList[header.labelSequenceCount]));
+    labelStringOffsetList = reinterpret_cast<const uint32_t *>(section(LABEL_STRING_OFFSETS, sizeof(uint32_t) * (header.labelCount + 1)));
+    labelStringData = section(LABEL_STRINGS, labelStringOffsetList[header.labelCount]);
+    // the table must have an empty slot to end the probes
+    if (header.featureTemplateHashTableSize <= templateCount || (header.featureTemplateHashTableSize & (header.featureTemplateHashTableSize - 1)) != 0) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+    featureTemplateHashTable = reinterpret_cast<const uint32_t *>(section(FEATURE_TEMPLATE_HASH_TABLE, sizeof(uint32_t) * header.featureTemplateHashTableSize));
+
+    this->image = image;
+    this->imageSize = imageSize;
+    featureTemplateCount = header.featureTemplateCount;
+    featureCount = header.featureCount;
+    labelSequenceCount = header.labelSequenceCount;
+    labelCount = header.labelCount;
+    featureHashBitCount = hashBitCount;
+    signedHashing = (header.featureHashing & FEATURE_HASH_SIGNED) != 0;
+    featureTemplateHashTableMask = header.featureTemplateHashTableSize - 1;
+    validateImage();
+
+    labelMap.clear();
+    labelStringList.clear();
+    labelStringList.reserve(labelCount);
+    for (uint32_t i = 0; i < labelCount; ++i) {
+        labelStringList.emplace_back(labelStringData + labelStringOffsetList[i], labelStringOffsetList[i + 1] - labelStringOffsetList[i]);
+        labelMap.insert(make_pair(labelStringList.back(), (label_t)i));
+    }
+    clearExpWeightList();
 }
 
-const vector<double> &HighOrderCRFData::getExpWeightList() const {
-    return expWeightList;
+// Returns true if the offsets do not decrease. The last offset has been
+// checked against the size of the section.
+static bool isMonotonic(const uint32_t *offsetList, size_t count) {
+    for (size_t i = 0; i + 1 < count; ++i) {
+        if (offsetList[i] > offsetList[i + 1]) {
+            return false;
+        }
+    }
+    return count > 0 && offsetList[0] == 0;
 }
 
-void HighOrderCRFData::setExpWeightList() {
-    expWeightList.reserve(weightList.size());
-    for (auto w : weightList) {
-        expWeightList.emplace_back(exp(weight_to_double(w)));
+static bool isBelow(const uint32_t *list, size_t count, uint32_t limit) {
+    for (size_t i = 0; i < count; ++i) {
+        if (list[i] >= limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checks the contents of the sections, so that the accessors never read
+// out of the image.
+void HighOrderCRFData::validateImage() const {
+    uint32_t featureListCount = featureHashBitCount > 0 ? featureCount : featureTemplateCount;
+    // the feature lists of a hashed model hold label sequence indexes
+    uint32_t featureIndexLimit = featureHashBitCount > 0 ? labelSequenceCount : featureCount;
+    size_t hashTableSize = featureTemplateHashTableMask + 1;
+    bool valid = isMonotonic(featureTemplateTagOffsetList, (size_t)featureTemplateCount + 1) &&
+        isMonotonic(featureTemplateFeatureOffsetList, (size_t)featureListCount + 1) &&
+        isBelow(featureTemplateFeatureIndexList, featureTemplateFeatureOffsetList[featureListCount], featureIndexLimit) &&
+        isBelow(featureLabelSequenceIndexList, featureHashBitCount > 0 ? 0 : featureCount, labelSequenceCount) &&
+        isMonotonic(labelSequenceOffsetList, (size_t)labelSequenceCount + 1) &&
+        isMonotonic(labelStringOffsetList, (size_t)labelCount + 1);
+    for (size_t i = 0; valid && i < labelSequenceOffsetList[labelSequenceCount]; ++i) {
+        valid = labelSequenceLabelList[i] >= 0 && (uint32_t)labelSequenceLabelList[i] < labelCount;
+    }
+    // The patterns are generated on the assumption that every label sequence
+    // has a label, and that the features of a template have label sequences
+    // of its length.
+    uint32_t maxLabelLength = 0;
+    for (size_t i = 0; valid && i < labelSequenceCount; ++i) {
+        uint32_t labelLength = labelSequenceOffsetList[i + 1] - labelSequenceOffsetList[i];
+        valid = labelLength >= 1;
+        maxLabelLength = max(maxLabelLength, labelLength);
+    }
+    for (size_t i = 0; valid && i < featureTemplateCount; ++i) {
+        uint32_t labelLength = featureTemplateLabelLengthList[i];
+        valid = labelLength >= 1 && labelLength <= maxLabelLength;
+        for (uint32_t j = featureTemplateFeatureOffsetList[i]; valid && j < featureTemplateFeatureOffsetList[i + 1]; ++j) {
+            uint32_t labelSequenceIndex = featureLabelSequenceIndexList[featureTemplateFeatureIndexList[j]];
+            valid = labelSequenceOffsetList[labelSequenceIndex + 1] - labelSequenceOffsetList[labelSequenceIndex] == labelLength;
+        }
+    }
+    for (size_t i = 0; valid && i < hashTableSize; ++i) {
+        valid = featureTemplateHashTable[i] == INVALID_FEATURE_TEMPLATE || featureTemplateHashTable[i] < featureTemplateCount;
+    }
+    if (!valid) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+}
+
+size_t HighOrderCRFData::getFeatureTemplateCount() const {
+    return featureTemplateCount;
+}
+
+FeatureTemplate HighOrderCRFData::getFeatureTemplate(uint32_t featureTemplateIndex) const {
+    const char *tag = featureTemplateTagData + featureTemplateTagOffsetList[featureTemplateIndex];
+    size_t tagLength = featureTemplateTagOffsetList[featureTemplateIndex + 1] - featureTemplateTagOffsetList[featureTemplateIndex];
+    return FeatureTemplate(string(tag, tagLength), featureTemplateLabelLengthList[featureTemplateIndex]);
+}
+
+uint32_t HighOrderCRFData::findFeatureTemplate(const char *tag, size_t tagLength, size_t labelLength) const {
+    if (featureTemplateCount == 0) {
+        return INVALID_FEATURE_TEMPLATE;
+    }
+    size_t slot = hashFeatureTemplate(tag, tagLength, labelLength) & featureTemplateHashTableMask;
+    for (size_t i = 0; i <= featureTemplateHashTableMask; ++i) {
+        uint32_t index = featureTemplateHashTable[slot];
+        if (index == INVALID_FEATURE_TEMPLATE) {
+            return INVALID_FEATURE_TEMPLATE;
+        }
+        uint32_t begin = featureTemplateTagOffsetList[index];
+        if (featureTemplateLabelLengthList[index] == labelLength &&
+            featureTemplateTagOffsetList[index + 1] - begin == tagLength &&
+            memcmp(featureTemplateTagData + begin, tag, tagLength) == 0) {
+            return index;
+        }
+        slot = (slot + 1) & featureTemplateHashTableMask;
+    }
+    return INVALID_FEATURE_TEMPLATE;
+}
+
+uint32_t HighOrderCRFData::findFeatureTemplate(const FeatureTemplate &featureTemplate) const {
+    const auto &tag = featureTemplate.getTag();
+    return findFeatureTemplate(tag.data(), tag.size(), featureTemplate.getLabelLength());
+}
+
+const uint32_t *HighOrderCRFData::getFeatureIndexList(uint32_t featureTemplateIndex, size_t *size) const {
+    uint32_t begin = featureTemplateFeatureOffsetList[featureTemplateIndex];
+    *size = featureTemplateFeatureOffsetList[featureTemplateIndex + 1] - begin;
+    return featureTemplateFeatureIndexList + begin;
+}
+
+const uint32_t *HighOrderCRFData::getFeatureIndexList(const char *tag, size_t tagLength, size_t labelLength, size_t *size) const {
+    uint32_t featureTemplateIndex = findFeatureTemplate(tag, tagLength, labelLength);
+    if (featureTemplateIndex == INVALID_FEATURE_TEMPLATE) {
+        *size = 0;
+        return nullptr;
     }
+    return getFeatureIndexList(featureTemplateIndex, size);
 }
 
-const vector<uint32_t> &HighOrderCRFData::getFeatureLabelSequenceIndexList() const {
-    return featureLabelSequenceIndexList;
+size_t HighOrderCRFData::getFeatureCount() const {
+    return featureCount;
 }
 
-const vector<LabelSequence> &HighOrderCRFData::getLabelSequenceList() const {
-    return labelSequenceList;
+uint32_t HighOrderCRFData::getFeatureHashBitCount() const {
+    return featureHashBitCount;
+}
+
+bool HighOrderCRFData::isSignedHashing() const {
+    return signedHashing;
+}
+
+const uint32_t *HighOrderCRFData::getBucketLabelSequenceIndexList(uint32_t bucket, size_t *size) const {
+    uint32_t begin = featureTemplateFeatureOffsetList[bucket];
+    *size = featureTemplateFeatureOffsetList[bucket + 1] - begin;
+    return featureTemplateFeatureIndexList + begin;
+}
+
+uint32_t HighOrderCRFData::getFeatureHashBucket(const char *tag, size_t tagLength, size_t labelLength, uint32_t featureHashBitCount) {
+    return (uint32_t)(hashFeatureTemplate(tag, tagLength, labelLength) & (((uint64_t)1 << featureHashBitCount) - 1));
+}
+
+feature_index_t HighOrderCRFData::getHashedFeatureIndex(uint32_t bucket, uint32_t labelSequenceIndex, uint32_t featureHashBitCount, bool signedHashing) {
+    // the finalizer of SplitMix64 over the bucket and the label sequence
+    uint64_t h = ((uint64_t)bucket << 32 | labelSequenceIndex) + 0x9e3779b97f4a7c15ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    feature_index_t index = (feature_index_t)(h & (((uint64_t)1 << featureHashBitCount) - 1));
+    if (signedHashing && (h >> 63) != 0) {
+        index |= NEGATED_FEATURE_FLAG;
+    }
+    return index;
+}
+
+const weight_t *HighOrderCRFData::getWeightList() const {
+    return weightList;
+}
+
+const double *HighOrderCRFData::getExpWeightList() const {
+    lock_guard<mutex> lock(expWeightListMutex);
+    if (expWeightList.size() != featureCount) {
+        expWeightList.reserve(featureCount);
+        for (uint32_t i = 0; i < featureCount; ++i) {
+            expWeightList.emplace_back(exp(weight_to_double(weightList[i])));
+        }
+    }
+    return expWeightList.data();
+}
+
+void HighOrderCRFData::clearExpWeightList() {
+    lock_guard<mutex> lock(expWeightListMutex);
+    expWeightList.clear();
+}
+
+uint32_t HighOrderCRFData::getFeatureLabelSequenceIndex(uint32_t featureIndex) const {
+    return featureLabelSequenceIndexList[featureIndex];
+}
+
+const label_t *HighOrderCRFData::getLabelSequence(uint32_t labelSequenceIndex, size_t *length) const {
+    uint32_t begin = labelSequenceOffsetList[labelSequenceIndex];
+    *length = labelSequenceOffsetList[labelSequenceIndex + 1] - begin;
+    return labelSequenceLabelList + begin;
 }
 
 const unordered_map<string, label_t> &HighOrderCRFData::getLabelMap() const {
     return labelMap;
 }
 
-vector<string> HighOrderCRFData::getLabelStringList() const {
-    vector<string> ret(labelMap.size());
-    for (auto &entry : labelMap) {
-        ret[entry.second] = entry.first;
+const vector<string> &HighOrderCRFData::getLabelStringList() const {
+    return labelStringList;
+}
+
+void HighOrderCRFData::setWeightList(const vector<double> &weightList) {
+    if (mappedFile || weightList.size() != featureCount) {
+        cerr << "Cannot set the weights of the model." << endl;
+        exit(1);
+    }
+    auto dest = reinterpret_cast<weight_t *>(imageBuffer.data() + (reinterpret_cast<const char *>(this->weightList) - image));
+    for (size_t i = 0; i < weightList.size(); ++i) {
+        dest[i] = double_to_weight(weightList[i]);
+    }
+    clearExpWeightList();
+}
+
+vector<double> HighOrderCRFData::getWeightListFrom(const HighOrderCRFData &source, size_t *matchedFeatureCount) const {
+    if (featureHashBitCount != source.featureHashBitCount || signedHashing != source.signedHashing) {
+        cerr << "The initial model must have the same feature hashing options." << endl;
+        exit(1);
+    }
+
+    // The label sequences of this model in the labels of the source model.
+    // Those with labels unknown to the source model match no features.
+    const auto &sourceLabelMap = source.getLabelMap();
+    const auto &labelStringList = getLabelStringList();
+    vector<LabelSequence> sourceLabelSequenceList(labelSequenceCount);
+    vector<bool> validList(labelSequenceCount, true);
+    for (uint32_t i = 0; i < labelSequenceCount; ++i) {
+        size_t length;
+        const label_t *labels = getLabelSequence(i, &length);
+        vector<label_t> sourceLabels;
+        sourceLabels.reserve(length);
+        for (size_t j = 0; j < length; ++j) {
+            auto it = sourceLabelMap.find(labelStringList[labels[j]]);
+            if (it == sourceLabelMap.end()) {
+                validList[i] = false;
+                break;
+            }
+            sourceLabels.emplace_back(it->second);
+        }
+        if (validList[i]) {
+            sourceLabelSequenceList[i] = LabelSequence(move(sourceLabels));
+        }
+    }
+    auto getSourceLabelSequence = [&source](uint32_t labelSequenceIndex) {
+        size_t length;
+        const label_t *labels = source.getLabelSequence(labelSequenceIndex, &length);
+        return LabelSequence(vector<label_t>(labels, labels + length));
+    };
+
+    vector<double> ret(featureCount);
+    *matchedFeatureCount = 0;
+    unordered_map<LabelSequence, double> sourceWeightMap;
+    if (featureHashBitCount > 0) {
+        // The features are matched in each bucket, and the weights are
+        // negated as the features are.
+        for (uint32_t bucket = 0; bucket < featureCount; ++bucket) {
+            size_t sourceSize;
+            const uint32_t *sourceList = source.getBucketLabelSequenceIndexList(bucket, &sourceSize);
+            if (sourceSize == 0) {
+                continue;
+            }
+            sourceWeightMap.clear();
+            for (size_t j = 0; j < sourceSize; ++j) {
+                feature_index_t featureIndex = getHashedFeatureIndex(bucket, sourceList[j], featureHashBitCount, signedHashing);
+                double weight = weight_to_double(source.weightList[featureIndex & ~NEGATED_FEATURE_FLAG]);
+                sourceWeightMap[getSourceLabelSequence(sourceList[j])] = (featureIndex & NEGATED_FEATURE_FLAG) ? -weight : weight;
+            }
+            size_t size;
+            const uint32_t *v = getBucketLabelSequenceIndexList(bucket, &size);
+            for (size_t j = 0; j < size; ++j) {
+                if (!validList[v[j]]) {
+                    continue;
+                }
+                auto it = sourceWeightMap.find(sourceLabelSequenceList[v[j]]);
+                if (it == sourceWeightMap.end()) {
+                    continue;
+                }
+                feature_index_t featureIndex = getHashedFeatureIndex(bucket, v[j], featureHashBitCount, signedHashing);
+                ret[featureIndex & ~NEGATED_FEATURE_FLAG] = (featureIndex & NEGATED_FEATURE_FLAG) ? -it->second : it->second;
+                ++*matchedFeatureCount;
+            }
+        }
+        return ret;
+    }
+
+    for (uint32_t i = 0; i < featureTemplateCount; ++i) {
+        uint32_t sourceFeatureTemplateIndex = source.findFeatureTemplate(getFeatureTemplate(i));
+        if (sourceFeatureTemplateIndex == INVALID_FEATURE_TEMPLATE) {
+            continue;
+        }
+        size_t sourceSize;
+        const uint32_t *sourceList = source.getFeatureIndexList(sourceFeatureTemplateIndex, &sourceSize);
+        sourceWeightMap.clear();
+        for (size_t j = 0; j < sourceSize; ++j) {
+            sourceWeightMap[getSourceLabelSequence(source.featureLabelSequenceIndexList[sourceList[j]])] = weight_to_double(source.weightList[sourceList[j]]);
+        }
+        size_t size;
+        const uint32_t *v = getFeatureIndexList(i, &size);
+        for (size_t j = 0; j < size; ++j) {
+            uint32_t labelSequenceIndex = featureLabelSequenceIndexList[v[j]];
+            if (!validList[labelSequenceIndex]) {
+                continue;
+            }
+            auto it = sourceWeightMap.find(sourceLabelSequenceList[labelSequenceIndex]);
+            if (it != sourceWeightMap.end()) {
+                ret[v[j]] = it->second;
+                ++*matchedFeatureCount;
+            }
+        }
     }
     return ret;
 }
 
 void HighOrderCRFData::read(const string &filename) {
-    ifstream in(filename, ios::in | ios::binary);
-    if (!in.is_open()) {
-        cerr << "Cannot read from file: " << filename << endl;
-        exit(1);
+    auto file = make_shared<Utility::MappedFile>(filename);
+    if (file->size() >= sizeof(MODEL_IMAGE_MAGIC) && memcmp(file->data(), MODEL_IMAGE_MAGIC, sizeof(MODEL_IMAGE_MAGIC)) == 0) {
+        imageBuffer.clear();
+        mappedFile = file;
+        setImage(mappedFile->data(), mappedFile->size());
+    }
+    else {
+        readLegacy(file->data(), file->size());
     }
-    vector<char> buffer;
+}
 
-    buffer.reserve(1024);  // a buffer of an arbitrary size
-    uint32_t bufferSize = 0;
+void HighOrderCRFData::readLegacy(const char *data, size_t size) {
+    const char *p = data;
+    const char *end = data + size;
+    ModelContents contents;
 
     // reads feature templates
-    uint32_t numFeatureTemplates = readNumber<uint32_t>(&in);
-    featureTemplateToFeatureIndexListMap.clear();
-    featureTemplateToFeatureIndexListMap.reserve(numFeatureTemplates);
+    uint32_t numFeatureTemplates = readNumber<uint32_t>(&p, end);
+    contents.featureTemplateList.reserve(numFeatureTemplates);
     for (size_t i = 0; i < numFeatureTemplates; ++i) {
         // reads the observation of a feature template
-        string obs = readString(&in, &buffer);
+        string obs = readString(&p, end);
 
         // reads the label length
-        uint32_t labelLength =  readNumber<uint32_t>(&in);
-        FeatureTemplate ft(obs, labelLength);
+        uint32_t labelLength =  readNumber<uint32_t>(&p, end);
 
         // reads the feature indexes
-        uint32_t featureIndexCount = readNumber<uint32_t>(&in);
+        uint32_t featureIndexCount = readNumber<uint32_t>(&p, end);
         vector<uint32_t> featureIndexes;
         featureIndexes.reserve(featureIndexCount);
         for (size_t j = 0; j < featureIndexCount; ++j) {
-            featureIndexes.emplace_back(readNumber<uint32_t>(&in));
+            featureIndexes.emplace_back(readNumber<uint32_t>(&p, end));
         }
-        featureTemplateToFeatureIndexListMap.insert(make_pair(ft, featureIndexes));
+        contents.featureTemplateList.emplace_back(FeatureTemplate(obs, labelLength), move(featureIndexes));
     }
 
     // read features
-    uint32_t numFeatures = readNumber<uint32_t>(&in);
-    weightList.clear();
-    weightList.reserve(numFeatures);
-    featureLabelSequenceIndexList.clear();
-    featureLabelSequenceIndexList.reserve(numFeatures);
+    uint32_t numFeatures = readNumber<uint32_t>(&p, end);
+    contents.weightList.reserve(numFeatures);
+    contents.featureLabelSequenceIndexList.reserve(numFeatures);
     for (size_t i = 0; i < numFeatures; ++i) {
-        weight_t t = readNumber<weight_t>(&in);
-        weightList.emplace_back(t);
-        featureLabelSequenceIndexList.emplace_back(readNumber<uint32_t>(&in));
+        contents.weightList.emplace_back(readNumber<weight_t>(&p, end));
+        contents.featureLabelSequenceIndexList.emplace_back(readNumber<uint32_t>(&p, end));
     }
-    setExpWeightList();
 
     // read label sequences
-    uint32_t numLabelSequences = readNumber<uint32_t>(&in);
-    labelSequenceList.clear();
-    labelSequenceList.reserve(numLabelSequences);
+    uint32_t numLabelSequences = readNumber<uint32_t>(&p, end);
+    contents.labelSequenceList.reserve(numLabelSequences);
     for (size_t i = 0; i < numLabelSequences; ++i) {
-        uint32_t len = readNumber<uint32_t>(&in);
+        uint32_t len = readNumber<uint32_t>(&p, end);
         vector<label_t> v;
         for (size_t j = 0; j < len; ++j) {
-            v.emplace_back(readNumber<uint32_t>(&in));
+            v.emplace_back(readNumber<uint32_t>(&p, end));
         }
-        labelSequenceList.emplace_back(move(v));
+        contents.labelSequenceList.emplace_back(move(v));
     }
 
-    // reads the label map
-    uint32_t numLabels = readNumber<uint32_t>(&in);
-    labelMap.clear();
-
+    // reads the label strings
+    uint32_t numLabels = readNumber<uint32_t>(&p, end);
+    contents.labelStringList.reserve(numLabels);
     for (size_t i = 0; i < numLabels; ++i) {
-        // reads the label string
-        string labelString = readString(&in, &buffer);
-        labelMap.insert(make_pair(labelString, i));
+        contents.labelStringList.emplace_back(readString(&p, end));
     }
 
-    in.close();
+    mappedFile.reset();
+    imageBuffer = buildImage(&contents);
+    setImage(imageBuffer.data(), imageBuffer.size());
 }
 
 void HighOrderCRFData::trim() {
+    ModelContents contents;
+
+    if (featureHashBitCount > 0) {
+        // Drops the label sequences of the buckets whose features have no
+        // weights, except those of the empty template, which are the labels.
+        uint32_t emptyBucket = getFeatureHashBucket("", 0, 1, featureHashBitCount);
+        contents.featureHashing = featureHashBitCount | (signedHashing ? FEATURE_HASH_SIGNED : 0);
+        contents.bucketOffsetList.reserve((size_t)featureCount + 1);
+        for (uint32_t bucket = 0; bucket < featureCount; ++bucket) {
+            contents.bucketOffsetList.emplace_back(contents.bucketLabelSequenceIndexList.size());
+            size_t size;
+            const uint32_t *v = getBucketLabelSequenceIndexList(bucket, &size);
+            for (size_t j = 0; j < size; ++j) {
+                feature_index_t featureIndex = getHashedFeatureIndex(bucket, v[j], featureHashBitCount, signedHashing);
+                if (weightList[featureIndex & ~NEGATED_FEATURE_FLAG] != 0 || bucket == emptyBucket) {
+                    contents.bucketLabelSequenceIndexList.emplace_back(v[j]);
+                }
+            }
+        }
+        contents.bucketOffsetList.emplace_back(contents.bucketLabelSequenceIndexList.size());
+        contents.weightList.assign(weightList, weightList + featureCount);
+        for (uint32_t i = 0; i < labelSequenceCount; ++i) {
+            size_t length;
+            const label_t *labels = getLabelSequence(i, &length);
+            contents.labelSequenceList.emplace_back(labels, labels + length);
+        }
+        contents.labelStringList = getLabelStringList();
+
+        auto newImage = buildImage(&contents);
+        mappedFile.reset();
+        imageBuffer = move(newImage);
+        setImage(imageBuffer.data(), imageBuffer.size());
+        return;
+    }
+
     // trim features
-    uint32_t validFeatureCount = 0;
-    vector<uint32_t> validFeatureIndexList;
-    validFeatureIndexList.reserve(weightList.size());
     unordered_set<uint32_t> labelFeatureSet;
 
-    FeatureTemplate emptyFeatureTemplate("", 1);
-    auto it = featureTemplateToFeatureIndexListMap.find(emptyFeatureTemplate);
-    if (it != featureTemplateToFeatureIndexListMap.end()) {
-        const auto &features = it->second;
-        for (auto feature : features) {
-            labelFeatureSet.insert(feature);
-        }
+    uint32_t emptyFeatureTemplateIndex = findFeatureTemplate("", 0, 1);
+    if (emptyFeatureTemplateIndex != INVALID_FEATURE_TEMPLATE) {
+        size_t size;
+        const uint32_t *features = getFeatureIndexList(emptyFeatureTemplateIndex, &size);
+        labelFeatureSet.insert(features, features + size);
     }
 
-    vector<bool> labelFlagList(labelSequenceList.size());
-    for (size_t i = 0; i < weightList.size(); ++i) {
+    vector<bool> labelFlagList(labelSequenceCount);
+    vector<uint32_t> validFeatureIndexList;
+    validFeatureIndexList.reserve(featureCount);
+    for (uint32_t i = 0; i < featureCount; ++i) {
         if (weightList[i] != 0 || labelFeatureSet.find(i) != labelFeatureSet.end()) {
             labelFlagList[featureLabelSequenceIndexList[i]] = true;
-            weightList[validFeatureCount] = weightList[i];
-            featureLabelSequenceIndexList[validFeatureCount] = featureLabelSequenceIndexList[i];
-            validFeatureIndexList.emplace_back(validFeatureCount);
-            ++validFeatureCount;
+            validFeatureIndexList.emplace_back(contents.weightList.size());
+            contents.weightList.emplace_back(weightList[i]);
+            contents.featureLabelSequenceIndexList.emplace_back(featureLabelSequenceIndexList[i]);
         }
         else {
             validFeatureIndexList.emplace_back(UINT32_MAX);
         }
     }
-    weightList.resize(validFeatureCount);
-    featureLabelSequenceIndexList.resize(validFeatureCount);
 
     // trim label sequence list
-    uint32_t validLabelSequenceCount = 0;
     vector<uint32_t> validLabelSequenceIndexList;
-    validLabelSequenceIndexList.reserve(labelSequenceList.size());
-    for (size_t i = 0; i < labelSequenceList.size(); ++i) {
-        validLabelSequenceIndexList.emplace_back(labelFlagList[i] ? validLabelSequenceCount : UINT32_MAX);
+    validLabelSequenceIndexList.reserve(labelSequenceCount);
+    for (uint32_t i = 0; i < labelSequenceCount; ++i) {
+        validLabelSequenceIndexList.emplace_back(labelFlagList[i] ? contents.labelSequenceList.size() : UINT32_MAX);
         if (labelFlagList[i]) {
-            if (validLabelSequenceCount != i) {
-                labelSequenceList[validLabelSequenceCount] = move(labelSequenceList[i]);
-            }
-            ++validLabelSequenceCount;
+            size_t length;
+            const label_t *labels = getLabelSequence(i, &length);
+            contents.labelSequenceList.emplace_back(labels, labels + length);
         }
     }
-    labelSequenceList.resize(validLabelSequenceCount);
 
     // update features
-    for (auto &i : featureLabelSequenceIndexList) {
+    for (auto &i : contents.featureLabelSequenceIndexList) {
         i = validLabelSequenceIndexList[i];
     }
 
     // trim feature templates
-    for (auto it = featureTemplateToFeatureIndexListMap.begin(); it != featureTemplateToFeatureIndexListMap.end(); ) {
-        auto &v = it->second;
+    for (uint32_t i = 0; i < featureTemplateCount; ++i) {
+        size_t size;
+        const uint32_t *v = getFeatureIndexList(i, &size);
         vector<uint32_t> validFeatureIndexes;
-        for (auto i : v) {
-            auto newIndex = validFeatureIndexList[i];
+        for (size_t j = 0; j < size; ++j) {
+            auto newIndex = validFeatureIndexList[v[j]];
             if (newIndex != UINT32_MAX) {
                 validFeatureIndexes.emplace_back(newIndex);
             }
         }
-        if (validFeatureIndexes.empty()) {
-            featureTemplateToFeatureIndexListMap.erase(it++);
-        }
-        else {
-            v = move(validFeatureIndexes);
-            ++it;
+        if (!validFeatureIndexes.empty()) {
+            contents.featureTemplateList.emplace_back(getFeatureTemplate(i), move(validFeatureIndexes));
         }
     }
+
+    contents.labelStringList = getLabelStringList();
+
+    auto newImage = buildImage(&contents);
+    mappedFile.reset();
+    imageBuffer = move(newImage);
+    setImage(imageBuffer.data(), imageBuffer.size());
 }
 
 void HighOrderCRFData::write(const string &filename) const {
+    // the legacy format cannot hold hashed models
+    if (featureHashBitCount > 0) {
+        writeMapped(filename);
+        return;
+    }
     ofstream out(filename, ios::out | ios::binary);
 
     // write feature templates
-    writeNumber<uint32_t>(&out, featureTemplateToFeatureIndexListMap.size());
-    for (const auto entry : featureTemplateToFeatureIndexListMap) {
-        const auto &ft = entry.first;
-        const auto &v = entry.second;
-        writeString(&out, ft.getTag());
-        writeNumber<uint32_t>(&out, ft.getLabelLength());
-        writeNumber<uint32_t>(&out, v.size());
-        for (const auto &i : v) {
-            writeNumber<uint32_t>(&out, i);
+    writeNumber<uint32_t>(&out, featureTemplateCount);
+    for (uint32_t i = 0; i < featureTemplateCount; ++i) {
+        uint32_t tagBegin = featureTemplateTagOffsetList[i];
+        writeString(&out, featureTemplateTagData + tagBegin, featureTemplateTagOffsetList[i + 1] - tagBegin);
+        writeNumber<uint32_t>(&out, featureTemplateLabelLengthList[i]);
+        size_t size;
+        const uint32_t *v = getFeatureIndexList(i, &size);
+        writeNumber<uint32_t>(&out, size);
+        for (size_t j = 0; j < size; ++j) {
+            writeNumber<uint32_t>(&out, v[j]);
         }
     }
 
     // write features
-    writeNumber<uint32_t>(&out, weightList.size());
-    for (size_t i = 0; i < weightList.size(); ++i) {
-        writeNumber<weight_t>(&out, weightList[i]);  // assuming that the size of double is 64 bits
+    writeNumber<uint32_t>(&out, featureCount);
+    for (uint32_t i = 0; i < featureCount; ++i) {
+        writeNumber<weight_t>(&out, weightList[i]);
         writeNumber<uint32_t>(&out, featureLabelSequenceIndexList[i]);
     }
 
     // write label sequences
-    writeNumber<uint32_t>(&out, labelSequenceList.size());
-    for (const auto &l : labelSequenceList) {
-        writeNumber<uint32_t>(&out, l.getLength());
-        for (size_t j = 0; j < l.getLength(); ++j) {
-            writeNumber<label_t>(&out, l.getLabelAt(j));
+    writeNumber<uint32_t>(&out, labelSequenceCount);
+    for (uint32_t i = 0; i < labelSequenceCount; ++i) {
+        size_t length;
+        const label_t *labels = getLabelSequence(i, &length);
+        writeNumber<uint32_t>(&out, length);
+        for (size_t j = 0; j < length; ++j) {
+            writeNumber<label_t>(&out, labels[j]);
         }
     }
 
-    auto labelStringList = getLabelStringList();
-    writeNumber<uint32_t>(&out, labelStringList.size());
-    for (const auto &str : labelStringList) {
-        writeString(&out, str);
+    writeNumber<uint32_t>(&out, labelCount);
+    for (uint32_t i = 0; i < labelCount; ++i) {
+        writeString(&out, labelStringData + labelStringOffsetList[i], labelStringOffsetList[i + 1] - labelStringOffsetList[i]);
     }
-    
+
     out.close();
 }
 
+void HighOrderCRFData::writeMapped(const string &filename) const {
+    ofstream out(filename, ios::out | ios::binary);
+    if (!out.is_open()) {
+        cerr << "Cannot write to file: " << filename << endl;
+        exit(1);
+    }
+    out.write(image, imageSize);
+    out.close();
+}
+
+const char *HighOrderCRFData::getImage(size_t *size) const {
+    *size = imageSize;
+    return image;
+}
+
+void HighOrderCRFData::readImage(const char *image, size_t imageSize) {
+    mappedFile.reset();
+    imageBuffer.assign(image, image + imageSize);
+    setImage(imageBuffer.data(), imageBuffer.size());
+}
+
 void HighOrderCRFData::dumpFeatures(const string &filename, bool outputWeights) const {
+    if (featureHashBitCount > 0) {
+        cerr << "The features of a hashed model cannot be dumped." << endl;
+        exit(1);
+    }
     ofstream out(filename, ios::binary);
     out.precision(15);
-    const auto labelStringList = getLabelStringList();
-    for (const auto &entry : featureTemplateToFeatureIndexListMap) {
-        const auto &ft = entry.first;
-        const auto &v = entry.second;
-
-        for (const auto &featureIndex : v) {
+    const auto &labelStringList = getLabelStringList();
+    for (uint32_t i = 0; i < featureTemplateCount; ++i) {
+        const auto ft = getFeatureTemplate(i);
+        size_t size;
+        const uint32_t *v = getFeatureIndexList(i, &size);
+
+        for (size_t j = 0; j < size; ++j) {
+            auto featureIndex = v[j];
             if (outputWeights) {
                 out << weight_to_double(weightList[featureIndex]) << "\t";
             }
             out << (ft.getTag());
-            auto &labelSequence = labelSequenceList[featureLabelSequenceIndexList[featureIndex]];
-            for (size_t j = 0; j < labelSequence.getLength(); ++j) {
-                out << "\t" << labelStringList[labelSequence.getLabelAt(j)];
+            size_t length;
+            const label_t *labels = getLabelSequence(featureLabelSequenceIndexList[featureIndex], &length);
+            for (size_t k = 0; k < length; ++k) {
+                out << "\t" << labelStringList[labels[k]];
             }
             out << endl;
         }
@@ -5,37 +5,108 @@
 #include "FeatureTemplate.h"
 #include "LabelSequence.h"
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+namespace Utility {
+class MappedFile;
+}
+
 namespace HighOrderCRF {
 
+// The model is held as a flat image whose layout is identical to that of the
+// memory-mappable model file, so that the same accessors work whether the
+// image was mapped from a file or built in memory.
 class HighOrderCRFData {
 public:
     HighOrderCRFData(std::unordered_map<FeatureTemplate, std::vector<uint32_t>> featureTemplateToFeatureIndexListMap, std::vector<double> weightList, std::vector<uint32_t> featureLabelSequenceIndexList, std::vector<LabelSequence> labelSequenceList, std::unordered_map<std::string, label_t> labelMap);
+    // A hashed model, which holds no feature templates. The label sequences
+    // of the features of a template are listed for the hash bucket of the
+    // template,
+    //   bucketLabelSequenceIndexList[bucketOffsetList[b] .. bucketOffsetList[b + 1]],
+    // and the weight of each feature is found by hashing the bucket and the
+    // label sequence into 2^featureHashBitCount slots.
+    HighOrderCRFData(uint32_t featureHashBitCount, bool signedHashing, std::vector<uint32_t> bucketOffsetList, std::vector<uint32_t> bucketLabelSequenceIndexList, std::vector<LabelSequence> labelSequenceList, std::unordered_map<std::string, label_t> labelMap);
     HighOrderCRFData();
 
-    const std::unordered_map<FeatureTemplate, std::vector<uint32_t>> &getFeatureTemplateToFeatureIndexMapList() const;
-    const std::vector<weight_t> &getWeightList() const;
-    const std::vector<double> &getExpWeightList() const;
-    const std::vector<uint32_t> &getFeatureLabelSequenceIndexList() const;
-    const std::vector<LabelSequence> &getLabelSequenceList() const;
+    size_t getFeatureTemplateCount() const;
+    FeatureTemplate getFeatureTemplate(uint32_t featureTemplateIndex) const;
+    // Returns INVALID_FEATURE_TEMPLATE if the template is not in the model.
+    // The lookup does not allocate memory.
+    uint32_t findFeatureTemplate(const char *tag, size_t tagLength, size_t labelLength) const;
+    uint32_t findFeatureTemplate(const FeatureTemplate &featureTemplate) const;
+    const uint32_t *getFeatureIndexList(uint32_t featureTemplateIndex, size_t *size) const;
+    // Sets *size to 0 if the template is not in the model.
+    const uint32_t *getFeatureIndexList(const char *tag, size_t tagLength, size_t labelLength, size_t *size) const;
+    size_t getFeatureCount() const;
+    // 0 unless the model is hashed.
+    uint32_t getFeatureHashBitCount() const;
+    bool isSignedHashing() const;
+    const uint32_t *getBucketLabelSequenceIndexList(uint32_t bucket, size_t *size) const;
+    static uint32_t getFeatureHashBucket(const char *tag, size_t tagLength, size_t labelLength, uint32_t featureHashBitCount);
+    // The index has NEGATED_FEATURE_FLAG set if the weight is negated.
+    static feature_index_t getHashedFeatureIndex(uint32_t bucket, uint32_t labelSequenceIndex, uint32_t featureHashBitCount, bool signedHashing);
+    const weight_t *getWeightList() const;
+    // Computed on the first call, since only the likelihood calculation
+    // needs it.
+    const double *getExpWeightList() const;
+    uint32_t getFeatureLabelSequenceIndex(uint32_t featureIndex) const;
+    const label_t *getLabelSequence(uint32_t labelSequenceIndex, size_t *length) const;
     const std::unordered_map<std::string, label_t> &getLabelMap() const;
-    std::vector<std::string> getLabelStringList() const;
+    const std::vector<std::string> &getLabelStringList() const;
+    void setWeightList(const std::vector<double> &weightList);
+    // Returns the weights of the features of this model taken from the
+    // features of the source model with the same template tags and label
+    // sequences, and 0 for the other features. Both models must have the
+    // same hashing options.
+    std::vector<double> getWeightListFrom(const HighOrderCRFData &source, size_t *matchedFeatureCount) const;
     void trim();
     void read(const std::string &filename);
     void write(const std::string &filename) const;
+    void writeMapped(const std::string &filename) const;
+    // The image in the format of the mappable model file.
+    const char *getImage(size_t *size) const;
+    // Copies an image returned by getImage(), so that the weights can be set.
+    void readImage(const char *image, size_t imageSize);
     void dumpFeatures(const std::string &filename, bool outputWeights) const;
 
 private:
-    void setExpWeightList();
-    std::unordered_map<FeatureTemplate, std::vector<uint32_t>> featureTemplateToFeatureIndexListMap;
-    std::vector<weight_t> weightList;
-    std::vector<double> expWeightList;
-    std::vector<uint32_t> featureLabelSequenceIndexList;
-    std::vector<LabelSequence> labelSequenceList;
+    HighOrderCRFData(const HighOrderCRFData &) = delete;
+    HighOrderCRFData &operator=(const HighOrderCRFData &) = delete;
+    void readLegacy(const char *data, size_t size);
+    void setImage(const char *image, size_t imageSize);
+    void validateImage() const;
+    void clearExpWeightList();
+    std::vector<char> imageBuffer;
+    std::shared_ptr<Utility::MappedFile> mappedFile;
+    const char *image;
+    size_t imageSize;
+    uint32_t featureTemplateCount;
+    uint32_t featureCount;
+    uint32_t labelSequenceCount;
+    uint32_t labelCount;
+    uint32_t featureHashBitCount;
+    bool signedHashing;
+    const uint32_t *featureTemplateTagOffsetList;
+    const char *featureTemplateTagData;
+    const uint32_t *featureTemplateLabelLengthList;
+    const uint32_t *featureTemplateFeatureOffsetList;
+    const uint32_t *featureTemplateFeatureIndexList;
+    const weight_t *weightList;
+    const uint32_t *featureLabelSequenceIndexList;
+    const uint32_t *labelSequenceOffsetList;
+    const label_t *labelSequenceLabelList;
+    const uint32_t *labelStringOffsetList;
+    const char *labelStringData;
+    const uint32_t *featureTemplateHashTable;
+    size_t featureTemplateHashTableMask;
+    mutable std::vector<double> expWeightList;
+    mutable std::mutex expWeightListMutex;
     std::unordered_map<std::string, label_t> labelMap;
+    std::vector<std::string> labelStringList;
 };
 
 }  // namespace HighOrderCRF
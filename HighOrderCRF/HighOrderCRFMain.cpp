@@ -1,5 +1,6 @@
 #include "../optionparser/optionparser.h"
 #include "../task/task_queue.hpp"
+#include "../Optimizer/UnixSocketCommunicator.h"
 #include "DataSequence.h"
 #include "HighOrderCRFProcessor.h"
 #include "types.h"
@@ -29,7 +30,7 @@ using std::string;
 using std::stringstream;
 using std::vector;
 
-enum optionIndex { UNKNOWN, HELP, TRAIN, TAG, CALC_LIKELIHOOD, TEST, MODEL, THREADS, C1, C2, EPSILON, MAXITER, CUTOFF };
+enum optionIndex { UNKNOWN, HELP, TRAIN, TAG, CALC_LIKELIHOOD, TEST, MODEL, THREADS, C1, C2, EPSILON, MAXITER, CUTOFF, CONVERT, SINGLE_PRECISION, CHECK_PRECISION, PER_THREAD_GRADIENTS, CACHE, SHARD_DIR, MEMORY_BUDGET, SGD, LEARNING_RATE, RANK, WORLD_SIZE, RENDEZVOUS, HASH_BITS, SIGNED_HASH, COUNT_SKETCH, CHECKPOINT, CHECKPOINT_INTERVAL, RESUME, INITIAL_MODEL };
 
 struct Arg : public option::Arg
 {
@@ -47,6 +48,7 @@ const option::Descriptor usage[] =
     { UNKNOWN, 0, "", "", Arg::None, "USAGE:  [options]\n\n"
     "Options:" },
     { HELP, 0, "h", "help", Arg::None, "  -h, --help  \tPrints usage and exit." },
+    { CONVERT, 0, "", "convert", Arg::Required, "  --convert  <file>\tConverts the model designated by --model into the memory-mappable format and writes it to <file>. A model in that format is loaded without parsing." },
     { CUTOFF, 0, "", "cutoff", Arg::Required, "  --cutoff  <number>\tCut-off threshold for features. Features whose frequency is less than this threshold will be ignored." },
     { MODEL, 0, "", "model", Arg::Required, "  --model  <file>\tDesignates the model file to be saved/loaded. Options will be saved to/loaded from <file>.options." },
     { TAG, 0, "", "tag", Arg::None, "  --tag  \tTag the text read from the standard input and writes the result to the standard output. This option can be omitted." },
@@ -57,6 +59,24 @@ const option::Descriptor usage[] =
     { C2, 0, "", "c2", Arg::Required, "  --c2  <number>\t(For training) Sets the coefficient for L2 regularization. The default value is 0 (no L2 regularization)." },
     { EPSILON, 0, "", "epsilon", Arg::Required, "  --epsilon  <number>\t(For training) Sets the epsilon for convergence." },
     { MAXITER, 0, "", "maxiter", Arg::Required, "  --maxiter  <number>\t(For training) Sets the maximum iteration count." },
+    { SGD, 0, "", "sgd", Arg::Required, "  --sgd  <number>\t(For training) Trains the model by mini-batch SGD with batches of <number> sequences instead of L-BFGS. --maxiter sets the number of epochs, which defaults to 10." },
+    { LEARNING_RATE, 0, "", "learning-rate", Arg::Required, "  --learning-rate  <number>\t(For training with --sgd) Sets the initial learning rate. The default value is 1.0." },
+    { INITIAL_MODEL, 0, "", "initial-model", Arg::Required, "  --initial-model  <file>\t(For training) Starts the training from the weights of the features in the model <file> that have the same templates and label sequences, which is faster when the training data have been slightly changed." },
+    { CHECKPOINT, 0, "", "checkpoint", Arg::Required, "  --checkpoint  <file>\t(For training with L-BFGS) Writes the state of the optimization to <file> periodically, so that the training can be resumed with --resume." },
+    { CHECKPOINT_INTERVAL, 0, "", "checkpoint-interval", Arg::Required, "  --checkpoint-interval  <number>\t(For training with --checkpoint) Sets the number of iterations between checkpoints. The default value is 10." },
+    { RESUME, 0, "", "resume", Arg::None, "  --resume  \t(For training with --checkpoint) Continues the training from the state in the checkpoint file. The training file and the options must be the same." },
+    { SINGLE_PRECISION, 0, "", "single-precision", Arg::None, "  --single-precision  \t(For training) Runs the forward-backward calculations in single precision." },
+    { PER_THREAD_GRADIENTS, 0, "", "per-thread-gradients", Arg::None, "  --per-thread-gradients  \t(For training) Accumulates the gradient in a buffer per thread instead of shared atomic numbers. The result does not depend on thread scheduling." },
+    { CACHE, 0, "", "cache", Arg::Required, "  --cache  <file>\t(For training) Stores the data compiled from the training file in <file>, or reads them from it if it was made from the same training file with the same cut-off threshold." },
+    { SHARD_DIR, 0, "", "shard-dir", Arg::Required, "  --shard-dir  <directory>\t(For training) Stores the compiled training data in shard files in <directory> instead of memory and reads them on every iteration." },
+    { MEMORY_BUDGET, 0, "", "memory-budget", Arg::Required, "  --memory-budget  <number>\t(For training with --shard-dir) Sets the memory in megabytes for the shards held at a time. The default value is 1024." },
+    { COUNT_SKETCH, 0, "", "count-sketch", Arg::Required, "  --count-sketch  <number>\t(For training with --cutoff) Counts the features approximately in <number> megabytes first, so that the features below the cut-off threshold are not stored. The same features are kept as without it." },
+    { HASH_BITS, 0, "", "hash-bits", Arg::Required, "  --hash-bits  <number>\t(For training) Hashes the features into 2^<number> weights instead of storing their strings, which bounds the memory for the model. <number> is from 1 to 31." },
+    { SIGNED_HASH, 0, "", "signed-hash", Arg::None, "  --signed-hash  \t(For training with --hash-bits) Negates the weights of half of the hashed features, so that collisions cancel out on average." },
+    { RENDEZVOUS, 0, "", "rendezvous", Arg::Required, "  --rendezvous  <path>\t(For training) Trains the model together with the other processes started with the same Unix domain socket <path>. Requires --rank and --world-size. Only rank 0 writes the model." },
+    { RANK, 0, "", "rank", Arg::Required, "  --rank  <number>\t(For training with --rendezvous) Sets the number of this process, from 0 to the world size minus one." },
+    { WORLD_SIZE, 0, "", "world-size", Arg::Required, "  --world-size  <number>\t(For training with --rendezvous) Sets the number of the processes." },
+    { CHECK_PRECISION, 0, "", "check-precision", Arg::None, "  --check-precision  \t(For training) Compares the single precision gradient with the double precision one at the trained weights." },
     { THREADS, 0, "", "threads", Arg::Required, "  --threads  <number>\tDesignates the number of threads to run concurrently." },
     { 0, 0, 0, 0, 0, 0 }
 };
@@ -174,11 +194,99 @@ int mainProc(int argc, char **argv) {
         }
         
         HighOrderCRFProcessor processor;
+        processor.setSinglePrecision(options[SINGLE_PRECISION]);
+        processor.setPrecisionCheck(options[CHECK_PRECISION]);
+        processor.setPerThreadGradients(options[PER_THREAD_GRADIENTS]);
+        if (options[CACHE]) {
+            processor.setCacheFilename(options[CACHE].arg);
+        }
+        if (options[SGD]) {
+            int batchSize = atoi(options[SGD].arg);
+            if (batchSize < 1) {
+                cerr << "--sgd must be a positive number." << endl;
+                exit(1);
+            }
+            double learningRate = 1.0;
+            if (options[LEARNING_RATE]) {
+                learningRate = atof(options[LEARNING_RATE].arg);
+            }
+            processor.setStochasticOptimization(batchSize, learningRate);
+        }
+        if (options[SHARD_DIR]) {
+            int memoryBudget = 1024;
+            if (options[MEMORY_BUDGET]) {
+                memoryBudget = atoi(options[MEMORY_BUDGET].arg);
+                if (memoryBudget < 1) {
+                    cerr << "--memory-budget must be a positive number." << endl;
+                    exit(1);
+                }
+            }
+            processor.setOutOfCore(options[SHARD_DIR].arg, (size_t)memoryBudget * 1024 * 1024);
+        }
+        if (options[COUNT_SKETCH]) {
+            int countSketchSize = atoi(options[COUNT_SKETCH].arg);
+            if (countSketchSize < 1) {
+                cerr << "--count-sketch must be a positive number." << endl;
+                exit(1);
+            }
+            processor.setCountSketchSize((size_t)countSketchSize * 1024 * 1024);
+        }
+        if (options[HASH_BITS]) {
+            int hashBitCount = atoi(options[HASH_BITS].arg);
+            if (hashBitCount < 1 || hashBitCount > 31) {
+                cerr << "--hash-bits must be from 1 to 31." << endl;
+                exit(1);
+            }
+            processor.setFeatureHashing(hashBitCount, options[SIGNED_HASH]);
+        }
+        if (options[INITIAL_MODEL]) {
+            processor.setInitialModel(options[INITIAL_MODEL].arg);
+        }
+        if (options[CHECKPOINT]) {
+            int checkpointInterval = 10;
+            if (options[CHECKPOINT_INTERVAL]) {
+                checkpointInterval = atoi(options[CHECKPOINT_INTERVAL].arg);
+                if (checkpointInterval < 1) {
+                    cerr << "--checkpoint-interval must be a positive number." << endl;
+                    exit(1);
+                }
+            }
+            processor.setCheckpoint(options[CHECKPOINT].arg, checkpointInterval, options[RESUME]);
+        }
+        else if (options[RESUME]) {
+            cerr << "--resume requires --checkpoint." << endl;
+            exit(1);
+        }
+        bool isRoot = true;
+        if (options[RENDEZVOUS]) {
+            int rank = options[RANK] ? atoi(options[RANK].arg) : -1;
+            int worldSize = options[WORLD_SIZE] ? atoi(options[WORLD_SIZE].arg) : 0;
+            if (worldSize < 1) {
+                cerr << "--world-size must be a positive number." << endl;
+                exit(1);
+            }
+            if (rank < 0 || rank >= worldSize) {
+                cerr << "--rank must be less than --world-size." << endl;
+                exit(1);
+            }
+            processor.setCommunicator(make_shared<Optimizer::UnixSocketCommunicator>(options[RENDEZVOUS].arg, rank, worldSize));
+            isRoot = rank == 0;
+        }
         processor.train(filename, cutoff, numThreads, maxIter, c1, c2, epsilon);
-        processor.writeModel(modelFilename);
+        if (isRoot) {
+            processor.writeModel(modelFilename);
+        }
         
         return 0;
     }
+    else if (options[CONVERT]) {
+        string filename = options[CONVERT].arg;
+        HighOrderCRFProcessor proc;
+        proc.readModel(modelFilename);
+        proc.writeMappedModel(filename);
+
+        return 0;
+    }
     else if (options[TEST]) {
         string filename = options[TEST].arg;
         HighOrderCRFProcessor proc;
@@ -1,14 +1,20 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -17,8 +23,14 @@
 #include "HighOrderCRFProcessor.h"
 
 #include "../task/task_queue.hpp"
+#include "../Optimizer/Communicator.h"
+#include "../Optimizer/DistributedUpdate.h"
 #include "../Optimizer/OptimizerClass.h"
+#include "../Optimizer/StochasticOptimizer.h"
+#include "../Optimizer/WorkerPool.h"
 #include "../Utility/AtomicFixedPointNumber.h"
+#include "../Utility/CountMinSketch.h"
+#include "../Utility/MappedFile.h"
 #include "types.h"
 #include "PatternSetSequence.h"
 #include "DataSequence.h"
@@ -27,84 +39,663 @@
 #include "HighOrderCRFData.h"
 #include "InternalDataSequence.h"
 #include "LabelSequence.h"
+#include "SequenceShardStore.h"
+#include "TrainingCache.h"
 
 namespace HighOrderCRF {
 
 using std::back_inserter;
 using std::cerr;
 using std::copy_if;
+using std::condition_variable;
+using std::cout;
 using std::endl;
+using std::function;
 using std::future;
 using std::ifstream;
+using std::istringstream;
+using std::lock_guard;
 using std::make_pair;
 using std::make_shared;
 using std::move;
+using std::mutex;
 using std::numeric_limits;
+using std::pair;
 using std::remove;
 using std::shared_ptr;
+using std::sort;
 using std::string;
+using std::thread;
+using std::to_string;
 using std::transform;
+using std::unique_lock;
 using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
+using Optimizer::Communicator;
+using Optimizer::DistributedUpdate;
 using Optimizer::OptimizerClass;
+using Optimizer::StochasticOptimizer;
+using Optimizer::WorkerPool;
 
-double hocrfUpdateProc(void *updateData, const double *x, double *g, int n, size_t concurrency) {
-    auto sequenceList = static_cast<vector<shared_ptr<PatternSetSequence>> *>(updateData);
-    
-    hwm::task_queue tq(concurrency);
-    vector<future<double>> futureList;
-    vector<Utility::AtomicFixedPointNumber64> g2(n);
-    
-    for (int i = 0; i < n; ++i) {
-        g2[i] = g[i];
+// The number of epochs of stochastic optimization unless maxIter is given.
+const size_t DEFAULT_EPOCH_COUNT = 10;
+
+// At most this number of shards are held in memory at a time when the
+// sequences are stored out of core.
+const size_t SHARD_SLOT_COUNT = 4;
+
+// The number of the rows of the count-min sketch of the features.
+const size_t COUNT_SKETCH_DEPTH = 4;
+
+struct HighOrderCRFUpdateData {
+    // the sequences in memory, or those of the current shard
+    vector<shared_ptr<PatternSetSequence>> *sequenceList;
+    vector<vector<size_t>> chunkList;
+    size_t chunkCount;
+    // null unless the sequences are stored out of core
+    const SequenceShardStore *shardStore;
+    vector<vector<shared_ptr<PatternSetSequence>>> shardSlotList;
+    bool singlePrecision;
+    vector<float> singlePrecisionExpWeightList;
+    bool perThreadGradients;
+    vector<vector<double>> gradientBufferList;
+    // the features of the sequences selected by hocrfSelectProc, or null if
+    // all the sequences are selected. Only these are read and written.
+    const vector<uint32_t> *featureIndexList;
+    // set on each evaluation
+    const double *expWeights;
+    int featureCount;
+    vector<Utility::AtomicFixedPointNumber64> gradient;
+    vector<double> chunkLogLikelihoodList;
+};
+
+// Reads the shards in order on a thread of its own while the ones before
+// them are processed. At most slotList->size() shards, including the one
+// being processed, are held at a time.
+class ShardPrefetcher {
+public:
+    ShardPrefetcher(const SequenceShardStore *shardStore, vector<vector<shared_ptr<PatternSetSequence>>> *slotList)
+        : shardStore(shardStore), slotList(slotList), loadedCount(0), takenCount(0), releasedCount(0),
+          readerThread(&ShardPrefetcher::readShards, this) {}
+
+    // All the shards must have been taken.
+    ~ShardPrefetcher() {
+        readerThread.join();
     }
 
-    for (auto &sequence : *sequenceList) {
-        future<double> f = tq.enqueue(&PatternSetSequence::accumulateFeatureExpectations, sequence, x, &g2);
-        futureList.emplace_back(move(f));
+    // Returns the sequences of the next shard, or null after the last one.
+    // The shard returned before is released.
+    vector<shared_ptr<PatternSetSequence>> *next() {
+        unique_lock<mutex> lock(prefetchMutex);
+        releasedCount = takenCount;
+        releasedCondition.notify_one();
+        if (takenCount == shardStore->getShardCount()) {
+            return nullptr;
+        }
+        loadedCondition.wait(lock, [this] { return loadedCount > takenCount; });
+        return &(*slotList)[takenCount++ % slotList->size()];
     }
-    tq.wait();
 
-    for (int i = 0; i < n; ++i) {
-        g[i] = g2[i];
+private:
+    void readShards() {
+        size_t slotCount = slotList->size();
+        for (size_t i = 0; i < shardStore->getShardCount(); ++i) {
+            {
+                unique_lock<mutex> lock(prefetchMutex);
+                releasedCondition.wait(lock, [this, i, slotCount] { return i < releasedCount + slotCount; });
+            }
+            shardStore->readShard(i, &(*slotList)[i % slotCount]);
+            {
+                lock_guard<mutex> lock(prefetchMutex);
+                ++loadedCount;
+            }
+            loadedCondition.notify_one();
+        }
     }
 
+    const SequenceShardStore *shardStore;
+    vector<vector<shared_ptr<PatternSetSequence>>> *slotList;
+    mutex prefetchMutex;
+    condition_variable loadedCondition;
+    condition_variable releasedCondition;
+    size_t loadedCount;
+    size_t takenCount;
+    size_t releasedCount;
+    thread readerThread;
+};
+
+// Splits the sequences into chunks of about the same number of patterns.
+vector<vector<size_t>> makeSequenceChunks(const vector<shared_ptr<PatternSetSequence>> &sequenceList, size_t chunkCount) {
+    vector<size_t> costList;
+    costList.reserve(sequenceList.size());
+    for (const auto &sequence : sequenceList) {
+        costList.emplace_back(sequence->patternCount());
+    }
+    return WorkerPool::makeBalancedChunks(costList, chunkCount);
+}
+
+void accumulateChunk(void *updateData, size_t chunkIndex) {
+    auto data = static_cast<HighOrderCRFUpdateData *>(updateData);
+    double logLikelihood = 0.0;
+    for (size_t i : data->chunkList[chunkIndex]) {
+        const auto &sequence = *(*data->sequenceList)[i];
+        logLikelihood += data->singlePrecision ?
+            sequence.accumulateFeatureExpectations(data->singlePrecisionExpWeightList.data(), &data->gradient) :
+            sequence.accumulateFeatureExpectations(data->expWeights, &data->gradient);
+    }
+    data->chunkLogLikelihoodList[chunkIndex] = logLikelihood;
+}
+
+// Accumulates the expectations of a chunk into a buffer of its own. There
+// is one buffer per chunk rather than per thread, so the result does not
+// depend on which thread has run which chunk.
+void accumulateChunkToBuffer(void *updateData, size_t chunkIndex) {
+    auto data = static_cast<HighOrderCRFUpdateData *>(updateData);
+    auto &gradientBuffer = data->gradientBufferList[chunkIndex];
     double logLikelihood = 0.0;
-    for (auto &f : futureList) {
-        logLikelihood += f.get();
+    for (size_t i : data->chunkList[chunkIndex]) {
+        const auto &sequence = *(*data->sequenceList)[i];
+        logLikelihood += data->singlePrecision ?
+            sequence.accumulateFeatureExpectations(data->singlePrecisionExpWeightList.data(), gradientBuffer.data()) :
+            sequence.accumulateFeatureExpectations(data->expWeights, gradientBuffer.data());
+    }
+    data->chunkLogLikelihoodList[chunkIndex] = logLikelihood;
+}
+
+void clearGradientBuffer(void *updateData, size_t bufferIndex) {
+    auto data = static_cast<HighOrderCRFUpdateData *>(updateData);
+    auto &gradientBuffer = data->gradientBufferList[bufferIndex];
+    if (data->featureIndexList && gradientBuffer.size() == (size_t)data->featureCount) {
+        for (auto i : *data->featureIndexList) {
+            gradientBuffer[i] = 0.0;
+        }
+    }
+    else {
+        gradientBuffer.assign(data->featureCount, 0.0);
+    }
+}
+
+// Adds up the features in the slice of all the buffers into the first
+// buffer by pairwise (tree) reduction.
+void reduceGradientBuffers(void *updateData, size_t slice) {
+    auto data = static_cast<HighOrderCRFUpdateData *>(updateData);
+    auto &gradientBufferList = data->gradientBufferList;
+    const auto *featureIndexList = data->featureIndexList;
+    size_t bufferCount = gradientBufferList.size();
+    size_t size = featureIndexList ? featureIndexList->size() : data->featureCount;
+    size_t begin = size * slice / bufferCount;
+    size_t end = size * (slice + 1) / bufferCount;
+    for (size_t step = 1; step < bufferCount; step *= 2) {
+        for (size_t b = 0; b + step < bufferCount; b += step * 2) {
+            double *dest = gradientBufferList[b].data();
+            const double *src = gradientBufferList[b + step].data();
+            if (featureIndexList) {
+                for (size_t j = begin; j < end; ++j) {
+                    uint32_t i = (*featureIndexList)[j];
+                    dest[i] += src[i];
+                }
+            }
+            else {
+                for (size_t i = begin; i < end; ++i) {
+                    dest[i] += src[i];
+                }
+            }
+        }
+    }
+}
+
+// Runs the chunks of data->sequenceList and returns their log likelihood.
+double accumulateChunks(HighOrderCRFUpdateData *data, WorkerPool *pool) {
+    size_t chunkCount = data->chunkList.size();
+    data->chunkLogLikelihoodList.assign(chunkCount, 0.0);
+    pool->run(chunkCount, data->perThreadGradients ? &accumulateChunkToBuffer : &accumulateChunk, data);
+
+    double logLikelihood = 0.0;
+    for (double d : data->chunkLogLikelihoodList) {
+        logLikelihood += d;
     }
     return logLikelihood;
 }
 
-HighOrderCRFProcessor::HighOrderCRFProcessor() : modelData(new HighOrderCRFData) {}
+double hocrfUpdateProc(void *updateData, const double *x, double *g, int n, WorkerPool *pool) {
+    auto data = static_cast<HighOrderCRFUpdateData *>(updateData);
 
-void HighOrderCRFProcessor::train(const string &filename,
-                                  size_t cutoff,
-                                  size_t concurrency,
-                                  size_t maxIter,
-                                  double regularizationCoefficientL1,
-                                  double regularizationCoefficientL2,
-                                  double epsilonForConvergence) {
+    data->expWeights = x;
+    data->featureCount = n;
+    const auto *featureIndexList = data->featureIndexList;
+    if (data->singlePrecision) {
+        if (featureIndexList && data->singlePrecisionExpWeightList.size() == (size_t)n) {
+            for (auto i : *featureIndexList) {
+                data->singlePrecisionExpWeightList[i] = (float)x[i];
+            }
+        }
+        else {
+            data->singlePrecisionExpWeightList.assign(x, x + n);
+        }
+    }
+
+    // the buffers are kept between the calls, so that a call on a few
+    // sequences only clears and adds up the features of the sequences
+    size_t threadCount = pool->getThreadCount();
+    if (data->perThreadGradients) {
+        // one chunk per thread, since each chunk has a buffer of its own
+        data->gradientBufferList.resize(threadCount);
+        pool->run(threadCount, &clearGradientBuffer, data);
+    }
+    else {
+        if (data->gradient.size() != (size_t)n) {
+            data->gradient = vector<Utility::AtomicFixedPointNumber64>(n);
+        }
+        if (featureIndexList) {
+            for (auto i : *featureIndexList) {
+                data->gradient[i] = g[i];
+            }
+        }
+        else {
+            for (int i = 0; i < n; ++i) {
+                data->gradient[i] = g[i];
+            }
+        }
+    }
+
+    double logLikelihood = 0.0;
+    if (data->shardStore) {
+        size_t chunkCount = data->perThreadGradients ? threadCount : threadCount * 8;
+        ShardPrefetcher prefetcher(data->shardStore, &data->shardSlotList);
+        while ((data->sequenceList = prefetcher.next()) != nullptr) {
+            data->chunkList = makeSequenceChunks(*data->sequenceList, chunkCount);
+            logLikelihood += accumulateChunks(data, pool);
+        }
+    }
+    else {
+        logLikelihood = accumulateChunks(data, pool);
+    }
+
+    if (data->perThreadGradients) {
+        pool->run(threadCount, &reduceGradientBuffers, data);
+        const auto &gradient = data->gradientBufferList[0];
+        if (featureIndexList) {
+            for (auto i : *featureIndexList) {
+                g[i] += gradient[i];
+            }
+        }
+        else {
+            for (int i = 0; i < n; ++i) {
+                g[i] += gradient[i];
+            }
+        }
+    }
+    else if (featureIndexList) {
+        for (auto i : *featureIndexList) {
+            g[i] = data->gradient[i];
+        }
+    }
+    else {
+        for (int i = 0; i < n; ++i) {
+            g[i] = data->gradient[i];
+        }
+    }
+    return logLikelihood;
+}
+
+// Restricts the sequences that hocrfUpdateProc runs on to the items, adds
+// their feature counts and appends their features to featureIndexList, or
+// lifts the restriction if itemList is null. hocrfUpdateProc only updates
+// the features in featureIndexList, which must be kept until the next call.
+void hocrfSelectProc(void *updateData, const size_t *itemList, size_t itemCount, double *featureCounts, vector<uint32_t> *featureIndexList) {
+    auto data = static_cast<HighOrderCRFUpdateData *>(updateData);
+    const auto &sequenceList = *data->sequenceList;
+    if (!itemList) {
+        data->chunkList = makeSequenceChunks(sequenceList, data->chunkCount);
+        data->featureIndexList = nullptr;
+        return;
+    }
+    vector<size_t> costList;
+    costList.reserve(itemCount);
+    for (size_t i = 0; i < itemCount; ++i) {
+        const auto &sequence = *sequenceList[itemList[i]];
+        costList.emplace_back(sequence.patternCount());
+        sequence.accumulateFeatureCounts(featureCounts);
+        sequence.appendFeatureIndexes(featureIndexList);
+    }
+    data->featureIndexList = featureIndexList;
+    data->chunkList = WorkerPool::makeBalancedChunks(costList, data->chunkCount);
+    for (auto &chunk : data->chunkList) {
+        for (auto &i : chunk) {
+            i = itemList[i];
+        }
+    }
+}
+
+struct SketchData {
+    const vector<InternalDataSequence> *sequenceList;
+    size_t chunkCount;
+    uint32_t featureHashBitCount;
+    Utility::CountMinSketch *sketch;
+};
+
+void addChunkToSketch(void *sketchData, size_t chunkIndex) {
+    auto data = static_cast<SketchData *>(sketchData);
+    size_t size = data->sequenceList->size();
+    for (size_t i = size * chunkIndex / data->chunkCount; i < size * (chunkIndex + 1) / data->chunkCount; ++i) {
+        (*data->sequenceList)[i].addFeaturesToSketch(data->featureHashBitCount, data->sketch);
+    }
+}
+
+// Splits the training file into the blocks of the sequences, each of which
+// ends with an empty line. The incomplete block at the end is dropped as
+// DataSequence does.
+vector<pair<const char *, size_t>> splitSequenceBlocks(const char *data, size_t size) {
+    vector<pair<const char *, size_t>> blockList;
+    const char *end = data + size;
+    const char *blockStart = data;
+    const char *p = data;
+    while (p < end) {
+        const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!lineEnd) {
+            break;
+        }
+        if (lineEnd == p) {
+            blockList.emplace_back(blockStart, lineEnd + 1 - blockStart);
+            blockStart = lineEnd + 1;
+        }
+        p = lineEnd + 1;
+    }
+    return blockList;
+}
+
+struct IngestionData {
+    const vector<pair<const char *, size_t>> *blockList;
+    size_t chunkCount;
+    // the used labels are collected if labelMap is null
+    const unordered_map<string, label_t> *labelMap;
+    vector<unordered_set<string>> *usedLabelSetList;
+    vector<InternalDataSequence> *sequenceList;
+};
+
+void ingestChunk(void *ingestionData, size_t chunkIndex) {
+    auto data = static_cast<IngestionData *>(ingestionData);
+    size_t size = data->blockList->size();
+    for (size_t i = size * chunkIndex / data->chunkCount; i < size * (chunkIndex + 1) / data->chunkCount; ++i) {
+        const auto &block = (*data->blockList)[i];
+        istringstream is(string(block.first, block.second));
+        DataSequence seq(is);
+        if (!data->labelMap) {
+            (*data->usedLabelSetList)[i] = seq.getUsedLabelSet();
+        }
+        else {
+            (*data->sequenceList)[i] = seq.toInternalDataSequence(*data->labelMap);
+        }
+    }
+}
+
+// The features of each chunk are numbered in the order of their first
+// appearances in the chunk, so that merging the chunks in order numbers them
+// in the same way as counting them in a single pass.
+struct FeatureCountData {
+    const vector<InternalDataSequence> *sequenceList;
+    size_t chunkCount;
+    uint32_t featureHashBitCount;
+    const Utility::CountMinSketch *sketch;
+    uint32_t minCount;
+    vector<unordered_map<Feature, uint32_t>> featureToFeatureIndexMapList;
+    vector<vector<uint32_t>> featureCountListList;
+    vector<unordered_map<LabelSequence, uint32_t>> labelSequenceToIndexMapList;
+    vector<vector<LabelSequence>> labelSequenceListList;
+    vector<unordered_map<uint64_t, uint32_t>> featureCountMapList;
+};
+
+void countChunkFeatures(void *featureCountData, size_t chunkIndex) {
+    auto data = static_cast<FeatureCountData *>(featureCountData);
+    size_t size = data->sequenceList->size();
+    for (size_t i = size * chunkIndex / data->chunkCount; i < size * (chunkIndex + 1) / data->chunkCount; ++i) {
+        const auto &sequence = (*data->sequenceList)[i];
+        if (data->featureHashBitCount > 0) {
+            sequence.accumulateHashedFeatureData(data->featureHashBitCount, &data->labelSequenceToIndexMapList[chunkIndex], &data->labelSequenceListList[chunkIndex], &data->featureCountMapList[chunkIndex], data->sketch, data->minCount);
+        }
+        else {
+            sequence.accumulateFeatureData(nullptr, &data->featureToFeatureIndexMapList[chunkIndex], &data->featureCountListList[chunkIndex], data->sketch, data->minCount);
+        }
+    }
+}
+
+// Adds the hashed feature counts of a chunk, whose keys hold the indexes
+// of the label sequences of the chunk, to those of the whole data.
+template<class M>
+void mergeHashedFeatureCounts(const vector<LabelSequence> &chunkLabelSequenceList,
+                              const M &chunkFeatureCountMap,
+                              unordered_map<LabelSequence, uint32_t> *labelSequenceToIndexMap,
+                              vector<LabelSequence> *labelSequenceList,
+                              unordered_map<uint64_t, uint32_t> *featureCountMap) {
+    vector<uint32_t> labelSequenceIndexList;
+    labelSequenceIndexList.reserve(chunkLabelSequenceList.size());
+    for (const auto &seq : chunkLabelSequenceList) {
+        auto it = labelSequenceToIndexMap->find(seq);
+        if (it == labelSequenceToIndexMap->end()) {
+            it = labelSequenceToIndexMap->insert(make_pair(seq, (uint32_t)labelSequenceList->size())).first;
+            labelSequenceList->emplace_back(seq);
+        }
+        labelSequenceIndexList.emplace_back(it->second);
+    }
+    for (const auto &entry : chunkFeatureCountMap) {
+        (*featureCountMap)[(entry.first & ~(uint64_t)0xffffffff) | labelSequenceIndexList[(uint32_t)entry.first]] += entry.second;
+    }
+}
+
+// Adds the counts of the features of a chunk, in the order of their indexes
+// in the chunk, to those of the whole data.
+void mergeFeatureCounts(const vector<const Feature *> &chunkFeatureList,
+                        const vector<uint32_t> &chunkFeatureCountList,
+                        unordered_map<FeatureTemplate, vector<uint32_t>> *featureTemplateToFeatureIndexListMap,
+                        unordered_map<Feature, uint32_t> *featureToFeatureIndexMap,
+                        vector<uint32_t> *featureCountList) {
+    for (size_t j = 0; j < chunkFeatureList.size(); ++j) {
+        const auto &f = *chunkFeatureList[j];
+        auto it = featureToFeatureIndexMap->find(f);
+        if (it == featureToFeatureIndexMap->end()) {
+            auto index = (uint32_t)featureToFeatureIndexMap->size();
+            it = featureToFeatureIndexMap->insert(make_pair(f, index)).first;
+            featureCountList->emplace_back(0);
+            FeatureTemplate ft(f.getTag(), f.getLabelSequence().getLength());
+            auto it2 = featureTemplateToFeatureIndexListMap->find(ft);
+            if (it2 == featureTemplateToFeatureIndexListMap->end()) {
+                it2 = featureTemplateToFeatureIndexListMap->insert(make_pair(ft, vector<uint32_t>())).first;
+            }
+            it2->second.emplace_back(index);
+        }
+        (*featureCountList)[it->second] += chunkFeatureCountList[j];
+    }
+}
+
+// The data exchanged by the processes in distributed training, in the
+// native byte order, since the processes run on one host.
+template<typename T>
+void appendNumber(string *data, T number) {
+    data->append(reinterpret_cast<const char *>(&number), sizeof(T));
+}
+
+template<typename T>
+T readNumber(const char **p) {
+    T number;
+    memcpy(&number, *p, sizeof(T));
+    *p += sizeof(T);
+    return number;
+}
+
+void appendString(string *data, const string &str) {
+    appendNumber<uint32_t>(data, str.size());
+    data->append(str);
+}
+
+string readString(const char **p) {
+    uint32_t length = readNumber<uint32_t>(p);
+    string str(*p, length);
+    *p += length;
+    return str;
+}
+
+void appendLabelSequence(string *data, const LabelSequence &seq) {
+    appendNumber<uint32_t>(data, seq.getLength());
+    data->append(reinterpret_cast<const char *>(seq.getLabelData()), sizeof(label_t) * seq.getLength());
+}
+
+LabelSequence readLabelSequence(const char **p) {
+    uint32_t length = readNumber<uint32_t>(p);
+    vector<label_t> labels(length);
+    memcpy(labels.data(), *p, sizeof(label_t) * length);
+    *p += sizeof(label_t) * length;
+    return LabelSequence(move(labels));
+}
+
+struct PatternSetGenerationData {
+    const vector<InternalDataSequence> *sequenceList;
+    const HighOrderCRFData *modelData;
+    size_t chunkCount;
+    vector<shared_ptr<PatternSetSequence>> *patternSetSequenceList;
+};
+
+void generateChunkPatternSets(void *patternSetGenerationData, size_t chunkIndex) {
+    auto data = static_cast<PatternSetGenerationData *>(patternSetGenerationData);
+    size_t size = data->patternSetSequenceList->size();
+    for (size_t i = size * chunkIndex / data->chunkCount; i < size * (chunkIndex + 1) / data->chunkCount; ++i) {
+        auto patternSetSequence = make_shared<PatternSetSequence>();
+        (*data->sequenceList)[i].generatePatternSetSequence(*data->modelData, true, patternSetSequence.get());
+        patternSetSequence->shrinkToFit();
+        (*data->patternSetSequenceList)[i] = move(patternSetSequence);
+    }
+}
+
+// Compares the expectations calculated in single precision with those
+// calculated in double precision at the given weights.
+void checkSinglePrecision(vector<shared_ptr<PatternSetSequence>> *sequenceList, const SequenceShardStore *shardStore, const vector<double> &weightList, size_t concurrency) {
+    int n = (int)weightList.size();
+    vector<double> expWeightList(n);
+    for (int i = 0; i < n; ++i) {
+        expWeightList[i] = exp(weightList[i]);
+    }
+    WorkerPool pool(concurrency);
+    HighOrderCRFUpdateData data;
+    data.sequenceList = sequenceList;
+    data.chunkCount = concurrency * 8;
+    data.chunkList = makeSequenceChunks(*sequenceList, data.chunkCount);
+    data.shardStore = shardStore;
+    data.shardSlotList.resize(SHARD_SLOT_COUNT);
+    data.perThreadGradients = false;
+    data.featureIndexList = nullptr;
+    vector<double> doubleGradient(n);
+    vector<double> singleGradient(n);
+    data.singlePrecision = false;
+    double doubleLogLikelihood = hocrfUpdateProc(&data, expWeightList.data(), doubleGradient.data(), n, &pool);
+    data.singlePrecision = true;
+    double singleLogLikelihood = hocrfUpdateProc(&data, expWeightList.data(), singleGradient.data(), n, &pool);
+
+    double maxDifference = 0.0;
+    double differenceNorm = 0.0;
+    double norm = 0.0;
+    for (int i = 0; i < n; ++i) {
+        double d = fabs(singleGradient[i] - doubleGradient[i]);
+        if (d > maxDifference) {
+            maxDifference = d;
+        }
+        differenceNorm += d * d;
+        norm += doubleGradient[i] * doubleGradient[i];
+    }
+    cout << "Precision check (single / double):" << endl;
+    cout << "Log-likelihood: " << singleLogLikelihood << " / " << doubleLogLikelihood << endl;
+    cout << "Max gradient difference: " << maxDifference << endl;
+    cout << "Relative gradient error: " << (norm > 0.0 ? sqrt(differenceNorm / norm) : 0.0) << endl << endl;
+}
+
+HighOrderCRFProcessor::HighOrderCRFProcessor() : modelData(new HighOrderCRFData), singlePrecision(false), precisionCheck(false), perThreadGradients(false), memoryBudget(0), batchSize(0), learningRate(0.0), featureHashBitCount(0), signedHashing(false), countSketchSize(0), checkpointInterval(0), resume(false) {}
+
+void HighOrderCRFProcessor::compileTrainingData(const string &filename,
+                                                size_t cutoff,
+                                                size_t concurrency,
+                                                vector<double> *prunedFeatureCountList,
+                                                vector<shared_ptr<PatternSetSequence>> *patternSetSequenceList,
+                                                SequenceShardStore *shardStore) {
     ifstream ifs_label(filename);
     if (!ifs_label.is_open()) {
         cerr << "Cannot read from file: " << filename << endl;
         exit(1);
     }
 
+    // Each process only counts the features of its own contiguous range of
+    // the sequences. The labels and the feature counts of all the processes
+    // are merged in the order of the ranks, so that they are numbered in the
+    // same way as by a single process.
+    size_t rank = communicator ? communicator->getRank() : 0;
+    size_t size = communicator ? communicator->getSize() : 1;
+    size_t begin = 0;
+    size_t end = 0;
+
+    // The sequences are kept in memory unless they are stored out of core,
+    // in which case they are read again for each pass.
     size_t count = 0;
     unordered_set<string> labelSet;
-    while (true) {
-        DataSequence seq(ifs_label);
-        if (!ifs_label) {
-            break;
+    vector<InternalDataSequence> internalDataSequenceList;
+    shared_ptr<Utility::MappedFile> mappedFile;
+    vector<pair<const char *, size_t>> blockList;
+    shared_ptr<WorkerPool> pool;
+    IngestionData ingestionData;
+    vector<unordered_set<string>> usedLabelSetList;
+    if (!shardStore) {
+        // The sequences are parsed in parallel, but the labels are inserted
+        // in order so that they are numbered in the same way.
+        ifs_label.close();
+        mappedFile = make_shared<Utility::MappedFile>(filename);
+        blockList = splitSequenceBlocks(mappedFile->data(), mappedFile->size());
+        begin = blockList.size() * rank / size;
+        end = blockList.size() * (rank + 1) / size;
+        blockList.erase(blockList.begin() + end, blockList.end());
+        blockList.erase(blockList.begin(), blockList.begin() + begin);
+        count = blockList.size();
+        pool = make_shared<WorkerPool>(concurrency);
+        usedLabelSetList.resize(count);
+        ingestionData.blockList = &blockList;
+        ingestionData.chunkCount = concurrency * 8;
+        ingestionData.labelMap = nullptr;
+        ingestionData.usedLabelSetList = &usedLabelSetList;
+        ingestionData.sequenceList = &internalDataSequenceList;
+        pool->run(ingestionData.chunkCount, &ingestChunk, &ingestionData);
+        string labelData;
+        for (const auto &s : usedLabelSetList) {
+            for (const auto &label : s) {
+                if (labelSet.insert(label).second) {
+                    appendString(&labelData, label);
+                }
+            }
+        }
+        usedLabelSetList = vector<unordered_set<string>>();
+        if (size > 1) {
+            // a new set, so that its order only depends on the insertions
+            labelSet = unordered_set<string>();
+            for (const auto &data : communicator->allGather(labelData)) {
+                const char *p = data.data();
+                while (p < data.data() + data.size()) {
+                    labelSet.insert(readString(&p));
+                }
+            }
+        }
+    }
+    else {
+        // Every process reads the labels of all the sequences, since its
+        // range is not known until they are counted.
+        while (true) {
+            DataSequence seq(ifs_label);
+            if (!ifs_label) {
+                break;
+            }
+            auto s = seq.getUsedLabelSet();
+            labelSet.insert(s.begin(), s.end());
+            ++count;
         }
-        auto s = seq.getUsedLabelSet();
-        labelSet.insert(s.begin(), s.end());
-        ++count;
+        ifs_label.close();
+        begin = count * rank / size;
+        end = count * (rank + 1) / size;
     }
-    ifs_label.close();
 
     unordered_map<string, label_t> labelMap;
     label_t labelNum = 0;
@@ -113,76 +704,364 @@ void HighOrderCRFProcessor::train(const string &filename,
         ++labelNum;
     }
 
-    ifstream ifs(filename);
-    vector<InternalDataSequence> internalDataSequenceList;
-    internalDataSequenceList.reserve(count);
-    while (true) {
-        DataSequence seq(ifs);
-        if (!ifs) {
-            break;
+    auto forEachSequence = [&](const unordered_map<string, label_t> &labelMap, const function<void(const InternalDataSequence &)> &proc) {
+        if (!internalDataSequenceList.empty()) {
+            for (const auto &internalDataSequence : internalDataSequenceList) {
+                proc(internalDataSequence);
+            }
+            return;
         }
-        internalDataSequenceList.emplace_back(seq.toInternalDataSequence(labelMap));
+        ifstream ifs(filename);
+        for (size_t index = 0; index < end; ++index) {
+            DataSequence seq(ifs);
+            if (!ifs) {
+                break;
+            }
+            if (index >= begin) {
+                proc(seq.toInternalDataSequence(labelMap));
+            }
+        }
+        ifs.close();
+    };
+    if (!shardStore) {
+        internalDataSequenceList.resize(count);
+        ingestionData.labelMap = &labelMap;
+        pool->run(ingestionData.chunkCount, &ingestChunk, &ingestionData);
+        blockList = vector<pair<const char *, size_t>>();
+        mappedFile.reset();
     }
-    ifs.close();
     
-    unordered_map<FeatureTemplate, vector<uint32_t>> featureTemplateToFeatureIndexListMap;
-    unordered_map<Feature, uint32_t> featureToFeatureIndexMap;
-    vector<uint32_t> featureCountList;
-    for (auto &internalDataSequence : internalDataSequenceList) {
-        internalDataSequence.accumulateFeatureData(&featureTemplateToFeatureIndexListMap, &featureToFeatureIndexMap, &featureCountList);
+    // Counts the features approximately in a fixed amount of memory first,
+    // so that those certainly below the cutoff are never stored. The sketch
+    // never underestimates, so the features left after the pruning are the
+    // same.
+    shared_ptr<Utility::CountMinSketch> sketch;
+    if (countSketchSize > 0 && cutoff > 1) {
+        sketch = make_shared<Utility::CountMinSketch>(countSketchSize, COUNT_SKETCH_DEPTH);
+        if (!internalDataSequenceList.empty()) {
+            SketchData sketchData;
+            sketchData.sequenceList = &internalDataSequenceList;
+            sketchData.chunkCount = concurrency * 8;
+            sketchData.featureHashBitCount = featureHashBitCount;
+            sketchData.sketch = sketch.get();
+            pool->run(sketchData.chunkCount, &addChunkToSketch, &sketchData);
+        }
+        else {
+            forEachSequence(labelMap, [&](const InternalDataSequence &internalDataSequence) {
+                internalDataSequence.addFeaturesToSketch(featureHashBitCount, sketch.get());
+            });
+        }
+        if (size > 1) {
+            vector<double> counterList(sketch->getCounterCount());
+            sketch->getCounters(counterList.data());
+            communicator->allReduce(counterList.data(), counterList.size());
+            sketch->setCounters(counterList.data());
+        }
     }
 
-    // prune features
-    vector<double> prunedFeatureCountList;
-    copy_if(featureCountList.begin(), featureCountList.end(), back_inserter(prunedFeatureCountList), [&](uint32_t x) { return x >= cutoff; });
-    vector<uint32_t> indexToNewIndexList;
-    uint32_t counter = 0;
-    uint32_t invalidSize = numeric_limits<uint32_t>::max();
-    transform(featureCountList.begin(), featureCountList.end(), back_inserter(indexToNewIndexList), [&](uint32_t x) { return x >= cutoff ? counter++ : invalidSize; });
-    for (auto &entry : featureTemplateToFeatureIndexListMap) {
-        auto &indexList = entry.second;
-        transform(indexList.begin(), indexList.end(), indexList.begin(), [&](uint32_t x) { return indexToNewIndexList[x]; });
-        indexList.erase(remove(indexList.begin(), indexList.end(), invalidSize), indexList.end());
-    }
-    for (auto it = featureToFeatureIndexMap.begin(); it != featureToFeatureIndexMap.end();) {
-        if (indexToNewIndexList[it->second] == invalidSize) {
-            featureToFeatureIndexMap.erase(it++);
+    if (featureHashBitCount > 0) {
+        // The features are counted by their hash buckets and label sequences
+        // instead of their strings.
+        unordered_map<LabelSequence, uint32_t> labelSequenceToIndexMap;
+        vector<LabelSequence> labelSequenceList;
+        unordered_map<uint64_t, uint32_t> featureCountMap;
+        if (internalDataSequenceList.empty() || concurrency == 1) {
+            forEachSequence(labelMap, [&](const InternalDataSequence &internalDataSequence) {
+                internalDataSequence.accumulateHashedFeatureData(featureHashBitCount, &labelSequenceToIndexMap, &labelSequenceList, &featureCountMap, sketch.get(), (uint32_t)cutoff);
+            });
         }
         else {
-            it->second = indexToNewIndexList[it->second];
-            ++it;
+            FeatureCountData featureCountData;
+            featureCountData.sequenceList = &internalDataSequenceList;
+            featureCountData.chunkCount = concurrency;
+            featureCountData.featureHashBitCount = featureHashBitCount;
+            featureCountData.sketch = sketch.get();
+            featureCountData.minCount = (uint32_t)cutoff;
+            featureCountData.labelSequenceToIndexMapList.resize(concurrency);
+            featureCountData.labelSequenceListList.resize(concurrency);
+            featureCountData.featureCountMapList.resize(concurrency);
+            pool->run(concurrency, &countChunkFeatures, &featureCountData);
+            for (size_t i = 0; i < concurrency; ++i) {
+                mergeHashedFeatureCounts(featureCountData.labelSequenceListList[i], featureCountData.featureCountMapList[i], &labelSequenceToIndexMap, &labelSequenceList, &featureCountMap);
+                featureCountData.labelSequenceToIndexMapList[i] = unordered_map<LabelSequence, uint32_t>();
+                featureCountData.labelSequenceListList[i] = vector<LabelSequence>();
+                featureCountData.featureCountMapList[i] = unordered_map<uint64_t, uint32_t>();
+            }
+        }
+        if (size > 1) {
+            string countData;
+            appendNumber<uint64_t>(&countData, labelSequenceList.size());
+            for (const auto &seq : labelSequenceList) {
+                appendLabelSequence(&countData, seq);
+            }
+            for (const auto &entry : featureCountMap) {
+                appendNumber<uint64_t>(&countData, entry.first);
+                appendNumber<uint32_t>(&countData, entry.second);
+            }
+            labelSequenceToIndexMap = unordered_map<LabelSequence, uint32_t>();
+            labelSequenceList.clear();
+            featureCountMap = unordered_map<uint64_t, uint32_t>();
+            for (const auto &data : communicator->allGather(countData)) {
+                const char *p = data.data();
+                vector<LabelSequence> rankLabelSequenceList(readNumber<uint64_t>(&p));
+                for (auto &seq : rankLabelSequenceList) {
+                    seq = readLabelSequence(&p);
+                }
+                vector<pair<uint64_t, uint32_t>> rankFeatureCountList;
+                while (p < data.data() + data.size()) {
+                    uint64_t key = readNumber<uint64_t>(&p);
+                    rankFeatureCountList.emplace_back(key, readNumber<uint32_t>(&p));
+                }
+                mergeHashedFeatureCounts(rankLabelSequenceList, rankFeatureCountList, &labelSequenceToIndexMap, &labelSequenceList, &featureCountMap);
+            }
+        }
+
+        // prune features
+        vector<pair<uint64_t, uint32_t>> featureList;
+        copy_if(featureCountMap.begin(), featureCountMap.end(), back_inserter(featureList), [&](const pair<uint64_t, uint32_t> &x) { return x.second >= cutoff; });
+        featureCountMap.clear();
+        sort(featureList.begin(), featureList.end());
+
+        uint32_t bucketCount = (uint32_t)1 << featureHashBitCount;
+        vector<uint32_t> bucketOffsetList;
+        vector<uint32_t> bucketLabelSequenceIndexList;
+        bucketOffsetList.reserve((size_t)bucketCount + 1);
+        bucketLabelSequenceIndexList.reserve(featureList.size());
+        prunedFeatureCountList->assign(bucketCount, 0.0);
+        auto it = featureList.begin();
+        for (uint32_t bucket = 0; bucket < bucketCount; ++bucket) {
+            bucketOffsetList.emplace_back(bucketLabelSequenceIndexList.size());
+            for (; it != featureList.end() && (it->first >> 32) == bucket; ++it) {
+                uint32_t labelSequenceIndex = (uint32_t)it->first;
+                bucketLabelSequenceIndexList.emplace_back(labelSequenceIndex);
+                feature_index_t featureIndex = HighOrderCRFData::getHashedFeatureIndex(bucket, labelSequenceIndex, featureHashBitCount, signedHashing);
+                (*prunedFeatureCountList)[featureIndex & ~NEGATED_FEATURE_FLAG] += (featureIndex & NEGATED_FEATURE_FLAG) ? -(double)it->second : it->second;
+            }
         }
+        bucketOffsetList.emplace_back(bucketLabelSequenceIndexList.size());
+
+        modelData = make_shared<HighOrderCRFData>(featureHashBitCount, signedHashing, move(bucketOffsetList), move(bucketLabelSequenceIndexList), move(labelSequenceList), move(labelMap));
     }
+    else {
+        unordered_map<FeatureTemplate, vector<uint32_t>> featureTemplateToFeatureIndexListMap;
+        unordered_map<Feature, uint32_t> featureToFeatureIndexMap;
+        vector<uint32_t> featureCountList;
+        if (internalDataSequenceList.empty() || concurrency == 1) {
+            forEachSequence(labelMap, [&](const InternalDataSequence &internalDataSequence) {
+                internalDataSequence.accumulateFeatureData(&featureTemplateToFeatureIndexListMap, &featureToFeatureIndexMap, &featureCountList, sketch.get(), (uint32_t)cutoff);
+            });
+        }
+        else {
+            FeatureCountData featureCountData;
+            featureCountData.sequenceList = &internalDataSequenceList;
+            featureCountData.chunkCount = concurrency;
+            featureCountData.featureHashBitCount = 0;
+            featureCountData.sketch = sketch.get();
+            featureCountData.minCount = (uint32_t)cutoff;
+            featureCountData.featureToFeatureIndexMapList.resize(concurrency);
+            featureCountData.featureCountListList.resize(concurrency);
+            pool->run(concurrency, &countChunkFeatures, &featureCountData);
+            for (size_t i = 0; i < concurrency; ++i) {
+                const auto &chunkFeatureToFeatureIndexMap = featureCountData.featureToFeatureIndexMapList[i];
+                const auto &chunkFeatureCountList = featureCountData.featureCountListList[i];
+                vector<const Feature *> chunkFeatureList(chunkFeatureCountList.size());
+                for (const auto &entry : chunkFeatureToFeatureIndexMap) {
+                    chunkFeatureList[entry.second] = &entry.first;
+                }
+                mergeFeatureCounts(chunkFeatureList, chunkFeatureCountList, &featureTemplateToFeatureIndexListMap, &featureToFeatureIndexMap, &featureCountList);
+                featureCountData.featureToFeatureIndexMapList[i] = unordered_map<Feature, uint32_t>();
+                featureCountData.featureCountListList[i] = vector<uint32_t>();
+            }
+        }
+        if (size > 1) {
+            string countData;
+            vector<const Feature *> ownFeatureList(featureCountList.size());
+            for (const auto &entry : featureToFeatureIndexMap) {
+                ownFeatureList[entry.second] = &entry.first;
+            }
+            for (size_t i = 0; i < ownFeatureList.size(); ++i) {
+                appendString(&countData, ownFeatureList[i]->getTag());
+                appendLabelSequence(&countData, ownFeatureList[i]->getLabelSequence());
+                appendNumber<uint32_t>(&countData, featureCountList[i]);
+            }
+            ownFeatureList.clear();
+            featureTemplateToFeatureIndexListMap = unordered_map<FeatureTemplate, vector<uint32_t>>();
+            featureToFeatureIndexMap = unordered_map<Feature, uint32_t>();
+            featureCountList.clear();
+            for (const auto &data : communicator->allGather(countData)) {
+                const char *p = data.data();
+                vector<Feature> rankFeatureList;
+                vector<uint32_t> rankFeatureCountList;
+                while (p < data.data() + data.size()) {
+                    string tag = readString(&p);
+                    LabelSequence seq = readLabelSequence(&p);
+                    rankFeatureList.emplace_back(move(tag), move(seq));
+                    rankFeatureCountList.emplace_back(readNumber<uint32_t>(&p));
+                }
+                vector<const Feature *> rankFeaturePointerList;
+                rankFeaturePointerList.reserve(rankFeatureList.size());
+                for (const auto &f : rankFeatureList) {
+                    rankFeaturePointerList.emplace_back(&f);
+                }
+                mergeFeatureCounts(rankFeaturePointerList, rankFeatureCountList, &featureTemplateToFeatureIndexListMap, &featureToFeatureIndexMap, &featureCountList);
+            }
+        }
+
+        // prune features
+        prunedFeatureCountList->clear();
+        copy_if(featureCountList.begin(), featureCountList.end(), back_inserter(*prunedFeatureCountList), [&](uint32_t x) { return x >= cutoff; });
+        vector<uint32_t> indexToNewIndexList;
+        uint32_t counter = 0;
+        uint32_t invalidSize = numeric_limits<uint32_t>::max();
+        transform(featureCountList.begin(), featureCountList.end(), back_inserter(indexToNewIndexList), [&](uint32_t x) { return x >= cutoff ? counter++ : invalidSize; });
+        for (auto &entry : featureTemplateToFeatureIndexListMap) {
+            auto &indexList = entry.second;
+            transform(indexList.begin(), indexList.end(), indexList.begin(), [&](uint32_t x) { return indexToNewIndexList[x]; });
+            indexList.erase(remove(indexList.begin(), indexList.end(), invalidSize), indexList.end());
+        }
+        for (auto it = featureToFeatureIndexMap.begin(); it != featureToFeatureIndexMap.end();) {
+            if (indexToNewIndexList[it->second] == invalidSize) {
+                featureToFeatureIndexMap.erase(it++);
+            }
+            else {
+                it->second = indexToNewIndexList[it->second];
+                ++it;
+            }
+        }
 
-    unordered_map<LabelSequence, uint32_t> labelSequenceToIndexMap;
-    vector<uint32_t> featureLabelSequenceIndexList(featureToFeatureIndexMap.size());
-    vector<LabelSequence> labelSequenceList;
+        unordered_map<LabelSequence, uint32_t> labelSequenceToIndexMap;
+        vector<uint32_t> featureLabelSequenceIndexList(featureToFeatureIndexMap.size());
+        vector<LabelSequence> labelSequenceList;
 
-    for (auto &entry : featureToFeatureIndexMap) {
-        const auto &f = entry.first;
-        const auto &i = entry.second;
-        const auto seq = f.getLabelSequence();
-        auto it = labelSequenceToIndexMap.find(seq);
-        if (it == labelSequenceToIndexMap.end()) {
-            it = labelSequenceToIndexMap.insert(make_pair(seq, labelSequenceToIndexMap.size())).first;
-            labelSequenceList.emplace_back(seq);  // copied
+        for (auto &entry : featureToFeatureIndexMap) {
+            const auto &f = entry.first;
+            const auto &i = entry.second;
+            const auto seq = f.getLabelSequence();
+            auto it = labelSequenceToIndexMap.find(seq);
+            if (it == labelSequenceToIndexMap.end()) {
+                it = labelSequenceToIndexMap.insert(make_pair(seq, labelSequenceToIndexMap.size())).first;
+                labelSequenceList.emplace_back(seq);  // copied
+            }
+            featureLabelSequenceIndexList[i] = it->second;
         }
-        featureLabelSequenceIndexList[i] = it->second;
+
+        modelData = make_shared<HighOrderCRFData>(move(featureTemplateToFeatureIndexListMap), vector<double>(featureToFeatureIndexMap.size()), move(featureLabelSequenceIndexList), move(labelSequenceList), move(labelMap));
+    }
+
+    patternSetSequenceList->clear();
+    if (shardStore) {
+        PatternSetSequence patternSetSequence;
+        // labelMap has been moved into the model
+        forEachSequence(modelData->getLabelMap(), [&](const InternalDataSequence &internalDataSequence) {
+            internalDataSequence.generatePatternSetSequence(*modelData, true, &patternSetSequence);
+            shardStore->add(patternSetSequence);
+        });
+        shardStore->finish();
+        return;
     }
-        
+    patternSetSequenceList->resize(internalDataSequenceList.size());
+    PatternSetGenerationData generationData;
+    generationData.sequenceList = &internalDataSequenceList;
+    generationData.modelData = modelData.get();
+    generationData.chunkCount = concurrency * 8;
+    generationData.patternSetSequenceList = patternSetSequenceList;
+    pool->run(generationData.chunkCount, &generateChunkPatternSets, &generationData);
+}
+
+void HighOrderCRFProcessor::train(const string &filename,
+                                  size_t cutoff,
+                                  size_t concurrency,
+                                  size_t maxIter,
+                                  double regularizationCoefficientL1,
+                                  double regularizationCoefficientL2,
+                                  double epsilonForConvergence) {
+    vector<double> prunedFeatureCountList;
     vector<shared_ptr<PatternSetSequence>> patternSetSequenceList;
-    for (auto &internalDataSequence : internalDataSequenceList) {
-        patternSetSequenceList.emplace_back(internalDataSequence.generatePatternSetSequence(featureTemplateToFeatureIndexListMap, featureLabelSequenceIndexList, labelSequenceList, true));
+    shared_ptr<SequenceShardStore> shardStore;
+    modelData = make_shared<HighOrderCRFData>();
+    if (!checkpointFilename.empty() && batchSize > 0) {
+        cerr << "Checkpoints cannot be used with stochastic optimization." << endl;
+        exit(1);
+    }
+    if (communicator && (!cacheFilename.empty() || batchSize > 0)) {
+        cerr << "Distributed training cannot be used with the training cache or stochastic optimization." << endl;
+        exit(1);
+    }
+    if (!shardDirectory.empty()) {
+        // the processes may share the directory
+        string shardName = communicator ? "shard.rank" + to_string(communicator->getRank()) : "shard";
+        shardStore = make_shared<SequenceShardStore>(shardDirectory, shardName, memoryBudget / SHARD_SLOT_COUNT);
+        compileTrainingData(filename, cutoff, concurrency, &prunedFeatureCountList, &patternSetSequenceList, shardStore.get());
+        cout << shardStore->getSequenceCount() << " sequences are stored in " << shardStore->getShardCount() << " shards." << endl;
+    }
+    else if (cacheFilename.empty() ||
+             !readTrainingCache(cacheFilename, filename, cutoff, modelData.get(), &prunedFeatureCountList, &patternSetSequenceList) ||
+             // the cache may have been made with other hashing options
+             modelData->getFeatureHashBitCount() != featureHashBitCount ||
+             modelData->isSignedHashing() != signedHashing) {
+        compileTrainingData(filename, cutoff, concurrency, &prunedFeatureCountList, &patternSetSequenceList, nullptr);
+        if (!cacheFilename.empty()) {
+            writeTrainingCache(cacheFilename, filename, cutoff, *modelData, prunedFeatureCountList, patternSetSequenceList);
+        }
+    }
+
+    HighOrderCRFUpdateData updateData;
+    updateData.sequenceList = &patternSetSequenceList;
+    updateData.shardStore = shardStore.get();
+    updateData.shardSlotList.resize(SHARD_SLOT_COUNT);
+    // one chunk per thread with gradient buffers, since each chunk has a
+    // buffer of its own
+    updateData.chunkCount = perThreadGradients ? concurrency : concurrency * 8;
+    updateData.chunkList = makeSequenceChunks(patternSetSequenceList, updateData.chunkCount);
+    updateData.singlePrecision = singlePrecision;
+    updateData.perThreadGradients = perThreadGradients;
+    updateData.featureIndexList = nullptr;
+    auto initialWeightList = make_shared<vector<double>>(prunedFeatureCountList.size());
+    if (!initialModelFilename.empty()) {
+        HighOrderCRFData initialModelData;
+        initialModelData.read(initialModelFilename);
+        size_t matchedFeatureCount;
+        *initialWeightList = modelData->getWeightListFrom(initialModelData, &matchedFeatureCount);
+        cout << "Initial weights are taken from " << matchedFeatureCount << " of " << modelData->getFeatureCount() << " features." << endl;
+    }
+    vector<double> bestWeightList;
+    if (batchSize > 0) {
+        if (shardStore) {
+            cerr << "Stochastic optimization cannot be used with out-of-core training." << endl;
+            exit(1);
+        }
+        auto optimizer = make_shared<StochasticOptimizer>(hocrfUpdateProc, hocrfSelectProc, (void *)&updateData, patternSetSequenceList.size(), prunedFeatureCountList.size(), concurrency, maxIter > 0 ? maxIter : DEFAULT_EPOCH_COUNT, batchSize, learningRate, regularizationCoefficientL1, regularizationCoefficientL2);
+        optimizer->optimize(initialWeightList->data());
+        bestWeightList = optimizer->getWeightList();
+    }
+    else if (communicator) {
+        DistributedUpdate distributedUpdate(communicator.get(), hocrfUpdateProc, (void *)&updateData, prunedFeatureCountList.size());
+        if (communicator->getRank() == 0) {
+            auto optimizer = make_shared<OptimizerClass>(DistributedUpdate::updateProc, (void *)&distributedUpdate, prunedFeatureCountList, concurrency, maxIter, regularizationCoefficientL1, regularizationCoefficientL2, epsilonForConvergence);
+            if (!checkpointFilename.empty()) {
+                optimizer->setCheckpoint(checkpointFilename, checkpointInterval, resume);
+            }
+            optimizer->optimize(initialWeightList->data());
+            bestWeightList = optimizer->getBestWeightList();
+            distributedUpdate.finish(bestWeightList);
+        }
+        else {
+            WorkerPool pool(concurrency);
+            bestWeightList = distributedUpdate.serve(&pool);
+        }
+    }
+    else {
+        auto optimizer = make_shared<OptimizerClass>(hocrfUpdateProc, (void *)&updateData, prunedFeatureCountList, concurrency, maxIter, regularizationCoefficientL1, regularizationCoefficientL2, epsilonForConvergence);
+        if (!checkpointFilename.empty()) {
+            optimizer->setCheckpoint(checkpointFilename, checkpointInterval, resume);
+        }
+        optimizer->optimize(initialWeightList->data());
+        bestWeightList = optimizer->getBestWeightList();
+    }
+    if (precisionCheck) {
+        checkSinglePrecision(&patternSetSequenceList, shardStore.get(), bestWeightList, concurrency);
     }
-    // free memory
-    vector<InternalDataSequence>().swap(internalDataSequenceList);
-        
-    auto optimizer = make_shared<OptimizerClass>(hocrfUpdateProc, (void *)&patternSetSequenceList, prunedFeatureCountList, concurrency, maxIter, regularizationCoefficientL1, regularizationCoefficientL2, epsilonForConvergence);
-    auto initialWeightList = make_shared<vector<double>>(featureCountList.size());
-    optimizer->optimize(initialWeightList->data());
-    auto bestWeightList = optimizer->getBestWeightList();
-        
-    modelData = make_shared<HighOrderCRFData>(move(featureTemplateToFeatureIndexListMap), move(bestWeightList), move(featureLabelSequenceIndexList), move(labelSequenceList), move(labelMap));
+    modelData->setWeightList(bestWeightList);
 }
 
 void HighOrderCRFProcessor::test(const string &filename,
@@ -278,6 +1157,11 @@ void HighOrderCRFProcessor::writeModel(const string &filename) {
     modelData->write(filename);
 }
 
+void HighOrderCRFProcessor::writeMappedModel(const string &filename) {
+    modelData->trim();
+    modelData->writeMapped(filename);
+}
+
 void HighOrderCRFProcessor::readModel(const string &filename) {
     modelData->read(filename);
 }
@@ -287,11 +1171,9 @@ vector<string> HighOrderCRFProcessor::tag(DataSequence *dataSequence) const {
     if (dataSequence->empty()) {
         return ret;
     }
-    auto labelStringList = modelData->getLabelStringList();
-    auto l = dataSequence
-        ->toInternalDataSequence(modelData->getLabelMap())
-        .generatePatternSetSequence(modelData->getFeatureTemplateToFeatureIndexMapList(), modelData->getFeatureLabelSequenceIndexList(), modelData->getLabelSequenceList(), false)
-        ->decode(modelData->getWeightList().data());
+    const auto &labelStringList = modelData->getLabelStringList();
+    vector<label_t> l(dataSequence->length());
+    tagBatch(&dataSequence, 1, l.data());
     ret.reserve(l.size());
     for (auto label : l) {
         ret.emplace_back(labelStringList[label]);
@@ -299,16 +1181,89 @@ vector<string> HighOrderCRFProcessor::tag(DataSequence *dataSequence) const {
     return ret;
 }
 
+void HighOrderCRFProcessor::tagBatch(DataSequence *const *dataSequenceList, size_t count, label_t *labelBuffer) const {
+    const auto &labelMap = modelData->getLabelMap();
+    const weight_t *weights = modelData->getWeightList();
+    // reused for the sequences tagged on the same thread
+    static thread_local PatternSetSequence patternSetSequence;
+    for (size_t i = 0; i < count; ++i) {
+        DataSequence *dataSequence = dataSequenceList[i];
+        if (dataSequence->empty()) {
+            continue;
+        }
+        size_t length = dataSequence->length();
+        dataSequence
+            ->toInternalDataSequence(labelMap)
+            .generatePatternSetSequence(*modelData, false, &patternSetSequence);
+        patternSetSequence.decode(weights, labelBuffer);
+        labelBuffer += length;
+    }
+}
+
+const vector<string> &HighOrderCRFProcessor::getLabelStringList() const {
+    return modelData->getLabelStringList();
+}
+
+void HighOrderCRFProcessor::setSinglePrecision(bool singlePrecision) {
+    this->singlePrecision = singlePrecision;
+}
+
+void HighOrderCRFProcessor::setPrecisionCheck(bool precisionCheck) {
+    this->precisionCheck = precisionCheck;
+}
+
+void HighOrderCRFProcessor::setPerThreadGradients(bool perThreadGradients) {
+    this->perThreadGradients = perThreadGradients;
+}
+
+void HighOrderCRFProcessor::setCacheFilename(const string &cacheFilename) {
+    this->cacheFilename = cacheFilename;
+}
+
+void HighOrderCRFProcessor::setStochasticOptimization(size_t batchSize, double learningRate) {
+    this->batchSize = batchSize;
+    this->learningRate = learningRate;
+}
+
+void HighOrderCRFProcessor::setOutOfCore(const string &shardDirectory, size_t memoryBudget) {
+    this->shardDirectory = shardDirectory;
+    this->memoryBudget = memoryBudget;
+}
+
+void HighOrderCRFProcessor::setFeatureHashing(uint32_t featureHashBitCount, bool signedHashing) {
+    this->featureHashBitCount = featureHashBitCount;
+    this->signedHashing = signedHashing;
+}
+
+void HighOrderCRFProcessor::setCountSketchSize(size_t countSketchSize) {
+    this->countSketchSize = countSketchSize;
+}
+
+void HighOrderCRFProcessor::setCommunicator(const shared_ptr<Communicator> &communicator) {
+    this->communicator = communicator;
+}
+
+void HighOrderCRFProcessor::setCheckpoint(const string &checkpointFilename, size_t checkpointInterval, bool resume) {
+    this->checkpointFilename = checkpointFilename;
+    this->checkpointInterval = checkpointInterval;
+    this->resume = resume;
+}
+
+void HighOrderCRFProcessor::setInitialModel(const string &initialModelFilename) {
+    this->initialModelFilename = initialModelFilename;
+}
+
 vector<unordered_map<string, double>> HighOrderCRFProcessor::calcLabelLikelihoods(DataSequence *dataSequence) const {
     vector<unordered_map<string, double>> ret;
     if (dataSequence->empty()) {
         return ret;
     }
-    auto labelStringList = modelData->getLabelStringList();
-    auto v = dataSequence
+    const auto &labelStringList = modelData->getLabelStringList();
+    static thread_local PatternSetSequence patternSetSequence;
+    dataSequence
         ->toInternalDataSequence(modelData->getLabelMap())
-        .generatePatternSetSequence(modelData->getFeatureTemplateToFeatureIndexMapList(), modelData->getFeatureLabelSequenceIndexList(), modelData->getLabelSequenceList(), false)
-        ->calcLabelLikelihoods(modelData->getExpWeightList().data());
+        .generatePatternSetSequence(*modelData, false, &patternSetSequence);
+    auto v = patternSetSequence.calcLabelLikelihoods(modelData->getExpWeightList());
     ret.reserve(v.size());
     for (const auto &m : v) {
         unordered_map<string, double> newMap;
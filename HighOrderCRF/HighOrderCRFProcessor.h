@@ -9,11 +9,17 @@
 #include <unordered_set>
 #include <vector>
 
+namespace Optimizer {
+class Communicator;
+}  // namespace Optimizer
+
 namespace HighOrderCRF {
 
 class DataSequence;
 class FeatureTemplate;
 class HighOrderCRFData;
+class PatternSetSequence;
+class SequenceShardStore;
 
 class HighOrderCRFProcessor
 {
@@ -29,14 +35,84 @@ public:
     void test(const std::string &filename,
               size_t concurrency) const;
     void writeModel(const std::string &filename);
+    void writeMappedModel(const std::string &filename);
     void readModel(const std::string &filename);
     // dataSequence will be destroyed
     std::vector<std::string> tag(DataSequence *dataSequence) const;
+    // Tags the sequences and writes their label IDs one after another into
+    // labelBuffer, which must have room for the total length of the
+    // sequences. The IDs index the list returned by getLabelStringList().
+    // dataSequenceList will be destroyed
+    void tagBatch(DataSequence *const *dataSequenceList, size_t count, label_t *labelBuffer) const;
+    const std::vector<std::string> &getLabelStringList() const;
+    // Runs the forward-backward calculations of training in single precision.
+    void setSinglePrecision(bool singlePrecision);
+    // Compares the single precision gradient with the double precision one
+    // at the trained weights and prints the differences.
+    void setPrecisionCheck(bool precisionCheck);
+    // Accumulates the gradient into a double buffer per thread and merges the
+    // buffers by tree reduction instead of adding to shared fixed-point
+    // numbers atomically. The result is deterministic for a given number of
+    // threads.
+    void setPerThreadGradients(bool perThreadGradients);
+    // Stores the data compiled from the training file in the cache file, or
+    // reads them from it if it was written for the same training file and
+    // cutoff.
+    void setCacheFilename(const std::string &cacheFilename);
+    // Trains the model by mini-batch SGD instead of L-BFGS, with maxIter as
+    // the number of epochs. batchSize 0 (the default) selects L-BFGS.
+    void setStochasticOptimization(size_t batchSize, double learningRate);
+    // Stores the compiled sequences in shard files in the directory instead
+    // of memory, and streams them on every evaluation. About memoryBudget
+    // bytes of sequences are held in memory at a time.
+    void setOutOfCore(const std::string &shardDirectory, size_t memoryBudget);
+    // Maps the features into 2^featureHashBitCount weights by hashing
+    // instead of storing their strings. With signedHashing, half of the
+    // features take their weights negated, so that collisions cancel out on
+    // average. 0 (the default) disables hashing.
+    void setFeatureHashing(uint32_t featureHashBitCount, bool signedHashing);
+    // Counts the features approximately in a count-min sketch of about
+    // countSketchSize bytes before counting them exactly, so that the
+    // features below the cutoff are not stored. 0 (the default) disables
+    // the sketch. The same features are kept either way.
+    void setCountSketchSize(size_t countSketchSize);
+    // Trains the model together with the other processes connected by the
+    // communicator. Each process keeps every getSize()-th sequence of the
+    // training file, and the weights are optimized on rank 0.
+    void setCommunicator(const std::shared_ptr<Optimizer::Communicator> &communicator);
+    // Writes the state of L-BFGS to the checkpoint file every interval
+    // iterations, and continues from the state in it if resume is true.
+    void setCheckpoint(const std::string &checkpointFilename, size_t checkpointInterval, bool resume);
+    // Starts the training from the weights of the features in the initial
+    // model with the same template tags and label sequences, instead of 0.
+    void setInitialModel(const std::string &initialModelFilename);
     // dataSequence will be destroyed
     std::vector<std::unordered_map<std::string, double>> calcLabelLikelihoods(DataSequence *dataSequence) const;
 
 private:
+    void compileTrainingData(const std::string &filename,
+                             size_t cutoff,
+                             size_t concurrency,
+                             std::vector<double> *prunedFeatureCountList,
+                             std::vector<std::shared_ptr<PatternSetSequence>> *patternSetSequenceList,
+                             SequenceShardStore *shardStore);
     std::shared_ptr<HighOrderCRFData> modelData;
+    bool singlePrecision;
+    bool precisionCheck;
+    bool perThreadGradients;
+    std::string cacheFilename;
+    std::string shardDirectory;
+    size_t memoryBudget;
+    size_t batchSize;
+    double learningRate;
+    std::shared_ptr<Optimizer::Communicator> communicator;
+    uint32_t featureHashBitCount;
+    bool signedHashing;
+    size_t countSketchSize;
+    std::string checkpointFilename;
+    size_t checkpointInterval;
+    bool resume;
+    std::string initialModelFilename;
 };
 
 } // namespace HighOrderCRF
@@ -1,14 +1,15 @@
 #include "InternalDataSequence.h"
 
-#include "Pattern.h"
 #include "PatternSetSequence.h"
 #include "Feature.h"
 #include "FeatureTemplate.h"
+#include "FeatureTemplateBuffer.h"
+#include "HighOrderCRFData.h"
 #include "LabelSequence.h"
 #include "Trie.h"
+#include "../Utility/CountMinSketch.h"
 
 #include <algorithm>
-#include <iterator>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
@@ -17,25 +18,24 @@
 
 namespace HighOrderCRF {
 
-using std::back_inserter;
 using std::make_pair;
-using std::make_shared;
 using std::min;
 using std::move;
-using std::reverse_copy;
-using std::shared_ptr;
+using std::pair;
 using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
-InternalDataSequence::InternalDataSequence(vector<label_t> labels, vector<unordered_set<label_t>> possibleLabelSetList, vector<vector<FeatureTemplate>> featureTemplateListList) {
+InternalDataSequence::InternalDataSequence() {}
+
+InternalDataSequence::InternalDataSequence(vector<label_t> labels, vector<unordered_set<label_t>> possibleLabelSetList, FeatureTemplateBuffer featureTemplateBuffer) {
     this->labels = move(labels);
     this->possibleLabelSetList = move(possibleLabelSetList);
-    this->featureTemplateListList = move(featureTemplateListList);
+    this->featureTemplateBuffer = move(featureTemplateBuffer);
 }
 
 size_t InternalDataSequence::length() const {
-    return featureTemplateListList.size();
+    return featureTemplateBuffer.length();
 }
 
 LabelSequence InternalDataSequence::getLabelSequence(size_t pos, size_t length) const {
@@ -53,85 +53,238 @@ const vector<label_t> &InternalDataSequence::getLabels() const {
     return labels;
 }
 
+// FNV-1a over the tag, or the bucket of a hashed model, followed by the
+// labels of the feature at the position.
+uint64_t InternalDataSequence::hashFeature(size_t pos, const char *tag, size_t tagLength, size_t labelLength, uint32_t featureHashBitCount) const {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    auto add = [&h](uint64_t x) {
+        h ^= x;
+        h *= 0x100000001b3ULL;
+    };
+    if (featureHashBitCount > 0) {
+        add(HighOrderCRFData::getFeatureHashBucket(tag, tagLength, labelLength, featureHashBitCount));
+    }
+    else {
+        for (size_t i = 0; i < tagLength; ++i) {
+            add((unsigned char)tag[i]);
+        }
+    }
+    add(labelLength);
+    for (size_t i = 0; i < labelLength; ++i) {
+        add((uint32_t)labels[pos - i]);
+    }
+    return h;
+}
+
+void InternalDataSequence::addFeaturesToSketch(uint32_t featureHashBitCount, Utility::CountMinSketch *sketch) const {
+    for (size_t pos = 0; pos < labels.size(); ++pos) {
+        for (size_t i = 0; i < featureTemplateBuffer.getFeatureTemplateCount(pos); ++i) {
+            size_t labelLength = featureTemplateBuffer.getLabelLength(pos, i);
+            if (pos < labelLength - 1) {
+                continue;
+            }
+            size_t tagLength;
+            const char *tag = featureTemplateBuffer.getTag(pos, i, &tagLength);
+            sketch->add(hashFeature(pos, tag, tagLength, labelLength, featureHashBitCount));
+        }
+    }
+}
+
 void InternalDataSequence::accumulateFeatureData(unordered_map<FeatureTemplate, vector<uint32_t>> *featureTemplateToFeatureIndexListMap,
                                                  unordered_map<Feature, uint32_t> *featureToFeatureIndexMap,
-                                                 vector<uint32_t> *featureCountList) const {
+                                                 vector<uint32_t> *featureCountList,
+                                                 const Utility::CountMinSketch *sketch,
+                                                 uint32_t minCount) const {
     for (size_t pos = 0; pos < labels.size(); ++pos) {
-        for (auto &ft : featureTemplateListList[pos]) {
-            if (pos < ft.getLabelLength() - 1) {
+        for (size_t i = 0; i < featureTemplateBuffer.getFeatureTemplateCount(pos); ++i) {
+            size_t labelLength = featureTemplateBuffer.getLabelLength(pos, i);
+            if (pos < labelLength - 1) {
                 continue;
             }
+            if (sketch) {
+                size_t tagLength;
+                const char *tag = featureTemplateBuffer.getTag(pos, i, &tagLength);
+                if (sketch->estimate(hashFeature(pos, tag, tagLength, labelLength, 0)) < minCount) {
+                    continue;
+                }
+            }
+            auto ft = featureTemplateBuffer.getFeatureTemplate(pos, i);
             Feature f(ft.getTag(), getLabelSequence(pos, ft.getLabelLength()));
             auto it = featureToFeatureIndexMap->find(f);
             if (it == featureToFeatureIndexMap->end()) {
                 auto index = (uint32_t)featureToFeatureIndexMap->size();
                 it = featureToFeatureIndexMap->insert(make_pair(f, index)).first;
                 featureCountList->emplace_back(0);
-                auto it2 = featureTemplateToFeatureIndexListMap->find(ft);
-                if (it2 == featureTemplateToFeatureIndexListMap->end()) {
-                    it2 = featureTemplateToFeatureIndexListMap->insert(make_pair(ft, vector<uint32_t>())).first;
+                if (featureTemplateToFeatureIndexListMap) {
+                    auto it2 = featureTemplateToFeatureIndexListMap->find(ft);
+                    if (it2 == featureTemplateToFeatureIndexListMap->end()) {
+                        it2 = featureTemplateToFeatureIndexListMap->insert(make_pair(ft, vector<uint32_t>())).first;
+                    }
+                    it2->second.emplace_back(it->second);
                 }
-                it2->second.emplace_back(it->second);
             }
             ++(*featureCountList)[it->second];
         }
     }
 }
 
-struct PatternData {
+void InternalDataSequence::accumulateHashedFeatureData(uint32_t featureHashBitCount,
+                                                       unordered_map<LabelSequence, uint32_t> *labelSequenceToIndexMap,
+                                                       vector<LabelSequence> *labelSequenceList,
+                                                       unordered_map<uint64_t, uint32_t> *featureCountMap,
+                                                       const Utility::CountMinSketch *sketch,
+                                                       uint32_t minCount) const {
+    for (size_t pos = 0; pos < labels.size(); ++pos) {
+        for (size_t i = 0; i < featureTemplateBuffer.getFeatureTemplateCount(pos); ++i) {
+            size_t labelLength = featureTemplateBuffer.getLabelLength(pos, i);
+            if (pos < labelLength - 1) {
+                continue;
+            }
+            size_t tagLength;
+            const char *tag = featureTemplateBuffer.getTag(pos, i, &tagLength);
+            if (sketch && sketch->estimate(hashFeature(pos, tag, tagLength, labelLength, featureHashBitCount)) < minCount) {
+                continue;
+            }
+            uint32_t bucket = HighOrderCRFData::getFeatureHashBucket(tag, tagLength, labelLength, featureHashBitCount);
+            auto seq = getLabelSequence(pos, labelLength);
+            auto it = labelSequenceToIndexMap->find(seq);
+            if (it == labelSequenceToIndexMap->end()) {
+                it = labelSequenceToIndexMap->insert(make_pair(seq, (uint32_t)labelSequenceList->size())).first;
+                labelSequenceList->emplace_back(seq);
+            }
+            ++(*featureCountMap)[(uint64_t)bucket << 32 | it->second];
+        }
+    }
+}
+
+// The patterns of a sequence and their feature indexes in CSR form. The
+// feature indexes are collected as (pattern, feature) pairs while the tries
+// are built and sorted by the patterns in finish(), keeping their order.
+// Reused for the sequences processed on the same thread.
+struct PatternArena {
+    vector<pattern_index_t> patternIndexList;
+    vector<pair<uint32_t, feature_index_t>> featureEntryList;
+    vector<uint32_t> featureOffsetList;
     vector<feature_index_t> featureIndexList;
-    pattern_index_t patternIndex;
+
+    void clear() {
+        patternIndexList.clear();
+        featureEntryList.clear();
+    }
+
+    uint32_t patternCount() const {
+        return (uint32_t)patternIndexList.size();
+    }
+
+    // Adds a pattern if dataIndex is a new one returned by the trie.
+    void addPatternIfNew(int dataIndex) {
+        if ((uint32_t)dataIndex == patternIndexList.size()) {
+            patternIndexList.emplace_back(0);
+        }
+    }
+
+    void finish() {
+        featureOffsetList.assign(patternIndexList.size() + 1, 0);
+        for (const auto &entry : featureEntryList) {
+            ++featureOffsetList[entry.first + 1];
+        }
+        for (size_t i = 1; i < featureOffsetList.size(); ++i) {
+            featureOffsetList[i] += featureOffsetList[i - 1];
+        }
+        featureIndexList.resize(featureEntryList.size());
+        for (const auto &entry : featureEntryList) {
+            featureIndexList[featureOffsetList[entry.first]++] = entry.second;
+        }
+        // the offsets have been moved to the ends of the patterns
+        for (size_t i = featureOffsetList.size() - 1; i > 0; --i) {
+            featureOffsetList[i] = featureOffsetList[i - 1];
+        }
+        featureOffsetList[0] = 0;
+    }
 };
 
 template<typename L>
 struct PatternGenerationData {
-    vector<PatternData> *patternDataList;
-    vector<Pattern> *patternList;
+    PatternArena *arena;
+    PatternSetSequence *patternSetSequence;
     Trie<L> *prevTrie;
     pattern_index_t currentIndex;
 };
 
 void generatePatternSetProc(label_t *labels, size_t size, int dataIndex, int parentDataIndex, void *data) {
     auto generationData = static_cast<PatternGenerationData<label_t> *>(data);
+    auto arena = generationData->arena;
     pattern_index_t prevPatternIndex = 0;
     if (generationData->prevTrie && size > 0) {
-        prevPatternIndex = (*generationData->patternDataList)[generationData->prevTrie->find(labels + 1, size - 1)].patternIndex;
+        prevPatternIndex = arena->patternIndexList[generationData->prevTrie->find(labels + 1, size - 1)];
     }
-    PatternData &thisPatternData = (*generationData->patternDataList)[dataIndex];
-    thisPatternData.patternIndex = generationData->currentIndex;
+    arena->patternIndexList[dataIndex] = generationData->currentIndex;
     ++generationData->currentIndex;
-    PatternData &suffixPatternData = (*generationData->patternDataList)[parentDataIndex];
-    pattern_index_t suffixPatternIndex = suffixPatternData.patternIndex;
-    generationData->patternList->emplace_back(prevPatternIndex, suffixPatternIndex, size ? labels[0] : INVALID_LABEL, vector<feature_index_t>(thisPatternData.featureIndexList));
+    pattern_index_t suffixPatternIndex = arena->patternIndexList[parentDataIndex];
+    uint32_t begin = arena->featureOffsetList[dataIndex];
+    generationData->patternSetSequence->addPattern(prevPatternIndex, suffixPatternIndex, size ? labels[0] : INVALID_LABEL, arena->featureIndexList.data() + begin, arena->featureOffsetList[dataIndex + 1] - begin);
 }
 
-shared_ptr<PatternSetSequence> InternalDataSequence::generatePatternSetSequence(const unordered_map<FeatureTemplate, vector<uint32_t>> &featureTemplateToFeatureIndexListMap, const vector<uint32_t> &featureLabelSequenceIndexList, const vector<LabelSequence> &labelSequenceList, bool hasValidLabels) const {
-    vector<Trie<label_t>> trieList(this->length());
-    vector<PatternData> patternDataList;
+void InternalDataSequence::generatePatternSetSequence(const HighOrderCRFData &modelData, bool hasValidLabels, PatternSetSequence *patternSetSequence) const {
+    // reused for the sequences processed on the same thread
+    static thread_local vector<Trie<label_t>> trieList;
+    if (trieList.size() < this->length()) {
+        trieList.resize(this->length());
+    }
+    for (size_t pos = 0; pos < this->length(); ++pos) {
+        trieList[pos].clear();
+    }
+    static thread_local PatternArena arena;
+    arena.clear();
+    uint32_t hashBitCount = modelData.getFeatureHashBitCount();
+    bool signedHashing = modelData.isSignedHashing();
     auto emptyLabelSequence = LabelSequence::createEmptyLabelSequence();
     
     for (size_t pos = 0; pos < this->length(); ++pos) {
-        const auto &curFeatureTemplateList = featureTemplateListList[pos];
         auto &curTrie = trieList[pos];
-        int dataIndex = curTrie.findOrInsert(emptyLabelSequence.getLabelData(), emptyLabelSequence.getLength(), patternDataList.size());
-        if (dataIndex == patternDataList.size()) {
-            patternDataList.emplace_back();
-        }
+        arena.addPatternIfNew(curTrie.findOrInsert(emptyLabelSequence.getLabelData(), emptyLabelSequence.getLength(), arena.patternCount()));
 
-        for (const auto &featureTemplate : curFeatureTemplateList) {
-            if (featureTemplate.getLabelLength() > pos + 1) {
+        for (size_t k = 0; k < featureTemplateBuffer.getFeatureTemplateCount(pos); ++k) {
+            size_t templateLabelLength = featureTemplateBuffer.getLabelLength(pos, k);
+            if (templateLabelLength > pos + 1) {
                 continue;
             }
-            auto featureIndexList = featureTemplateToFeatureIndexListMap.find(featureTemplate);
-            if (featureIndexList == featureTemplateToFeatureIndexListMap.end()) {
-                continue;
+            size_t tagLength;
+            const char *tag = featureTemplateBuffer.getTag(pos, k, &tagLength);
+            size_t featureIndexCount;
+            const uint32_t *featureIndexList = nullptr;
+            // the label sequences of the bucket of the template if the model
+            // is hashed
+            const uint32_t *labelSequenceIndexList = nullptr;
+            uint32_t bucket = 0;
+            if (hashBitCount > 0) {
+                bucket = HighOrderCRFData::getFeatureHashBucket(tag, tagLength, templateLabelLength, hashBitCount);
+                labelSequenceIndexList = modelData.getBucketLabelSequenceIndexList(bucket, &featureIndexCount);
+            }
+            else {
+                featureIndexList = modelData.getFeatureIndexList(tag, tagLength, templateLabelLength, &featureIndexCount);
             }
-            for (auto &featureIndex : featureIndexList->second) {
-                auto seq = labelSequenceList[featureLabelSequenceIndexList[featureIndex]];
+            for (size_t j = 0; j < featureIndexCount; ++j) {
+                feature_index_t featureIndex;
+                uint32_t labelSequenceIndex;
+                if (labelSequenceIndexList) {
+                    labelSequenceIndex = labelSequenceIndexList[j];
+                    featureIndex = HighOrderCRFData::getHashedFeatureIndex(bucket, labelSequenceIndex, hashBitCount, signedHashing);
+                }
+                else {
+                    featureIndex = featureIndexList[j];
+                    labelSequenceIndex = modelData.getFeatureLabelSequenceIndex(featureIndex);
+                }
+                size_t labelLength;
+                const label_t *labelData = modelData.getLabelSequence(labelSequenceIndex, &labelLength);
+                // a bucket may hold the label sequences of other templates
+                if (labelLength != templateLabelLength) {
+                    continue;
+                }
 
                 bool labelsOK = true;
-                for (size_t i = 0; i < seq.getLength(); ++i) {
-                    if (!possibleLabelSetList[pos - i].empty() && possibleLabelSetList[pos - i].find(seq.getLabelAt(i)) == possibleLabelSetList[pos - i].end()) {
+                for (size_t i = 0; i < labelLength; ++i) {
+                    if (!possibleLabelSetList[pos - i].empty() && possibleLabelSetList[pos - i].find(labelData[i]) == possibleLabelSetList[pos - i].end()) {
                         labelsOK = false;
                         break;
                     }
@@ -139,20 +292,16 @@ shared_ptr<PatternSetSequence> InternalDataSequence::generatePatternSetSequence(
                 if (!labelsOK) {
                     continue;
                 }
-                int dataIndex = curTrie.findOrInsert(seq.getLabelData(), seq.getLength(), patternDataList.size());
-                if (dataIndex == patternDataList.size()) {
-                    patternDataList.emplace_back();
-                }
-
-                patternDataList[dataIndex].featureIndexList.emplace_back(featureIndex);
+                int dataIndex = curTrie.findOrInsert(labelData, labelLength, arena.patternCount());
+                arena.addPatternIfNew(dataIndex);
+                arena.featureEntryList.emplace_back((uint32_t)dataIndex, featureIndex);
 
                 if (pos > 0) {
-                    size_t labelLength = seq.getLength();
                     for (size_t i = 1; i <= min(labelLength - 1, pos); ++i) {
                         auto &prevTrie = trieList[pos - i];
-                        int prevDataIndex = prevTrie.findOrInsert(seq.getLabelData() + i, seq.getLength() - i, patternDataList.size());
-                        if (prevDataIndex == patternDataList.size()) {
-                            patternDataList.emplace_back();
+                        int prevDataIndex = prevTrie.findOrInsert(labelData + i, labelLength - i, arena.patternCount());
+                        if ((uint32_t)prevDataIndex == arena.patternCount()) {
+                            arena.addPatternIfNew(prevDataIndex);
                         } else {
                             break;
                         }
@@ -162,13 +311,6 @@ shared_ptr<PatternSetSequence> InternalDataSequence::generatePatternSetSequence(
         }
     }
 
-    auto patternListList = vector<vector<Pattern>>();
-    auto longestMatchIndexList = vector<pattern_index_t>();
-    vector<label_t> reversedLabels;
-    reversedLabels.reserve(labels.size());
-
-    reverse_copy(labels.begin(), labels.end(), back_inserter(reversedLabels));
-    
     for (size_t pos = 0; pos < this->length(); ++pos) {
         Trie<label_t> &curTrie = trieList[pos];
         if (curTrie.isEmpty()) {
@@ -176,29 +318,31 @@ shared_ptr<PatternSetSequence> InternalDataSequence::generatePatternSetSequence(
             if (!possibleLabelSetList[pos].empty()) {
                 l = *(possibleLabelSetList[pos].begin());
             }
-            int dataIndex = curTrie.findOrInsert(&l, 1, patternDataList.size());
-            if (dataIndex == patternDataList.size()) {
-                patternDataList.emplace_back();
-            }
+            arena.addPatternIfNew(curTrie.findOrInsert(&l, 1, arena.patternCount()));
         }
+    }
+    arena.finish();
 
-        vector<Pattern> patternList;
+    patternSetSequence->clear();
+    static thread_local vector<label_t> reversedLabels;
+    reversedLabels.assign(labels.rbegin(), labels.rend());
+    
+    for (size_t pos = 0; pos < this->length(); ++pos) {
+        Trie<label_t> &curTrie = trieList[pos];
         PatternGenerationData<label_t> d;
-        d.patternDataList = &patternDataList;
-        d.patternList = &patternList;
+        d.arena = &arena;
+        d.patternSetSequence = patternSetSequence;
         d.prevTrie = pos ? &trieList[pos - 1] : 0;
         d.currentIndex = 0;
         
         curTrie.visitValidNodes(generatePatternSetProc, (void *)&d);
-        patternListList.emplace_back(move(patternList));
 
         pattern_index_t longestMatchIndex = 0;
         if (hasValidLabels) {
-            longestMatchIndex = patternDataList[curTrie.findLongestMatch(reversedLabels.data() + this->length() - pos - 1, pos + 1)].patternIndex;
+            longestMatchIndex = arena.patternIndexList[curTrie.findLongestMatch(reversedLabels.data() + this->length() - pos - 1, pos + 1)];
         }
-        longestMatchIndexList.emplace_back(longestMatchIndex);
+        patternSetSequence->finishPosition(longestMatchIndex);
     }
-    return make_shared<PatternSetSequence>(move(patternListList), move(longestMatchIndexList));
 }
 
 }  // namespace HighOrderCRF
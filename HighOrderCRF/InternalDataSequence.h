@@ -5,30 +5,48 @@
 
 #include "Feature.h"
 #include "FeatureTemplate.h"
+#include "FeatureTemplateBuffer.h"
+#include "HighOrderCRFData.h"
 #include "LabelSequence.h"
 #include "PatternSetSequence.h"
 
+#include <cstdint>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+namespace Utility {
+class CountMinSketch;
+}  // namespace Utility
+
 namespace HighOrderCRF {
 
 class InternalDataSequence
 {
 public:
+    InternalDataSequence();
     // arguments will be destroyed
-    InternalDataSequence(std::vector<label_t> labelList, std::vector<std::unordered_set<label_t>> possibleLabelSetList, std::vector<std::vector<FeatureTemplate>> featureTemplateListList);
+    InternalDataSequence(std::vector<label_t> labelList, std::vector<std::unordered_set<label_t>> possibleLabelSetList, FeatureTemplateBuffer featureTemplateBuffer);
     size_t length() const;
     LabelSequence getLabelSequence(size_t pos, size_t length) const;
-    void accumulateFeatureData(std::unordered_map<FeatureTemplate, std::vector<uint32_t>> *featureTemplateToFeatureIndexListMap, std::unordered_map<Feature, uint32_t> *featureToFeatureIndexMap, std::vector<uint32_t> *featureCountList) const;
-    std::shared_ptr<PatternSetSequence> generatePatternSetSequence(const std::unordered_map<FeatureTemplate, std::vector<uint32_t>> &featureTemplateToFeatureIndexListMap, const std::vector<uint32_t> &featureLabelSequenceIndexList, const std::vector<LabelSequence> &labelSequenceList, bool hasValidLabels) const;
+    // Adds the features to the sketch, those of a hashed model if
+    // featureHashBitCount is not 0.
+    void addFeaturesToSketch(uint32_t featureHashBitCount, Utility::CountMinSketch *sketch) const;
+    // The features whose estimates in the sketch are less than minCount are
+    // skipped. sketch and featureTemplateToFeatureIndexListMap may be null.
+    void accumulateFeatureData(std::unordered_map<FeatureTemplate, std::vector<uint32_t>> *featureTemplateToFeatureIndexListMap, std::unordered_map<Feature, uint32_t> *featureToFeatureIndexMap, std::vector<uint32_t> *featureCountList, const Utility::CountMinSketch *sketch, uint32_t minCount) const;
+    // Counts the features of a hashed model by the hash bucket of the
+    // template and the label sequence index, (bucket << 32 | index).
+    void accumulateHashedFeatureData(uint32_t featureHashBitCount, std::unordered_map<LabelSequence, uint32_t> *labelSequenceToIndexMap, std::vector<LabelSequence> *labelSequenceList, std::unordered_map<uint64_t, uint32_t> *featureCountMap, const Utility::CountMinSketch *sketch, uint32_t minCount) const;
+    // patternSetSequence will be cleared before the patterns are generated
+    void generatePatternSetSequence(const HighOrderCRFData &modelData, bool hasValidLabels, PatternSetSequence *patternSetSequence) const;
     const std::vector<label_t> &getLabels() const;
 private:
+    uint64_t hashFeature(size_t pos, const char *tag, size_t tagLength, size_t labelLength, uint32_t featureHashBitCount) const;
     std::vector<label_t> labels;
     std::vector<std::unordered_set<label_t>> possibleLabelSetList;
-    std::vector<std::vector<FeatureTemplate>> featureTemplateListList;
+    FeatureTemplateBuffer featureTemplateBuffer;
 private:
 };
 
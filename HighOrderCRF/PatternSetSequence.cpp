@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <cfloat>
+#include <cstring>
+#include <ostream>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -8,7 +10,7 @@
 
 #include "../Utility/AtomicFixedPointNumber.h"
 #include "Feature.h"
-#include "Pattern.h"
+#include "ScoreKernels.h"
 
 namespace HighOrderCRF {
 
@@ -16,84 +18,148 @@ using std::copy;
 using std::fill;
 using std::make_pair;
 using std::move;
+using std::ostream;
 using std::swap;
 using std::unordered_map;
 using std::vector;
 
-vector<vector<double>> getAccumulatedWeightListList(const vector<vector<Pattern>> &patternListList, const double *expWeights) {
-    vector<vector<double>> ret;
-    ret.reserve(patternListList.size());
-    
-    // accumulates weights
-    for (size_t pos = 0; pos < patternListList.size(); ++pos) {
-        auto &curPatternList = patternListList[pos];
-        vector<double> curWeightList(curPatternList.size());
-        curWeightList[0] = 1.0;
-        
-        for (size_t i = 1; i < curPatternList.size(); ++i) {
-            auto &curPattern = curPatternList[i];
-            auto &curWeight = curWeightList[i];
-            curWeight = 1.0;
-            for (auto &featureIndex : curPattern.getFeatureIndexList()) {
-                curWeight *= expWeights[featureIndex];
-            }
-            curWeight *= curWeightList[curPattern.getLongestSuffixIndex()];
-        }
-        ret.emplace_back(move(curWeightList));
+PatternSetSequence::PatternSetSequence() {
+    clear();
+}
+
+void PatternSetSequence::clear() {
+    positionOffsetList.assign(1, 0);
+    prevPatternIndexList.clear();
+    longestSuffixIndexList.clear();
+    lastLabelList.clear();
+    featureOffsetList.assign(1, 0);
+    featureIndexList.clear();
+    longestMatchIndexList.clear();
+}
+
+void PatternSetSequence::addPattern(pattern_index_t prevPatternIndex,
+                                    pattern_index_t longestSuffixIndex,
+                                    label_t lastLabel,
+                                    const feature_index_t *featureIndexes,
+                                    size_t featureCount) {
+    prevPatternIndexList.emplace_back(prevPatternIndex);
+    longestSuffixIndexList.emplace_back(longestSuffixIndex);
+    lastLabelList.emplace_back(lastLabel);
+    featureIndexList.insert(featureIndexList.end(), featureIndexes, featureIndexes + featureCount);
+    featureOffsetList.emplace_back((uint32_t)featureIndexList.size());
+}
+
+void PatternSetSequence::finishPosition(pattern_index_t longestMatchIndex) {
+    positionOffsetList.emplace_back((uint32_t)lastLabelList.size());
+    longestMatchIndexList.emplace_back(longestMatchIndex);
+}
+
+void PatternSetSequence::shrinkToFit() {
+    positionOffsetList.shrink_to_fit();
+    prevPatternIndexList.shrink_to_fit();
+    longestSuffixIndexList.shrink_to_fit();
+    lastLabelList.shrink_to_fit();
+    featureOffsetList.shrink_to_fit();
+    featureIndexList.shrink_to_fit();
+    longestMatchIndexList.shrink_to_fit();
+}
+
+size_t PatternSetSequence::length() const {
+    return longestMatchIndexList.size();
+}
+
+size_t PatternSetSequence::patternCount() const {
+    return lastLabelList.size();
+}
+
+size_t PatternSetSequence::getPatternSetSize(size_t pos) const {
+    return positionOffsetList[pos + 1] - positionOffsetList[pos];
+}
+
+template<typename T>
+void writeArray(ostream *os, const vector<T> &v) {
+    os->write(reinterpret_cast<const char *>(v.data()), sizeof(T) * v.size());
+}
+
+template<typename T>
+bool readArray(const char **p, const char *end, size_t size, vector<T> *v) {
+    if ((size_t)(end - *p) < sizeof(T) * size) {
+        return false;
     }
-    return ret;
+    v->resize(size);
+    memcpy(v->data(), *p, sizeof(T) * size);
+    *p += sizeof(T) * size;
+    return true;
 }
 
-// for decoding
-vector<vector<double>> getAccumulatedWeightListListForDecoding(const vector<vector<Pattern>> &patternListList, const weight_t *weights) {
-    vector<vector<double>> ret;
-    ret.reserve(patternListList.size());
+void PatternSetSequence::write(ostream *os) const {
+    uint32_t sizes[] = { (uint32_t)length(), (uint32_t)patternCount(), (uint32_t)featureIndexList.size() };
+    os->write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+    writeArray(os, positionOffsetList);
+    writeArray(os, prevPatternIndexList);
+    writeArray(os, longestSuffixIndexList);
+    writeArray(os, lastLabelList);
+    writeArray(os, featureOffsetList);
+    writeArray(os, featureIndexList);
+    writeArray(os, longestMatchIndexList);
+}
 
-    // accumulates weights
-    for (size_t pos = 0; pos < patternListList.size(); ++pos) {
-        auto &curPatternList = patternListList[pos];
-        vector<double> curWeightList(curPatternList.size());
-        curWeightList[0] = 0.0;
+bool PatternSetSequence::read(const char **p, const char *end) {
+    vector<uint32_t> sizes;
+    if (!readArray(p, end, 3, &sizes)) {
+        return false;
+    }
+    return readArray(p, end, sizes[0] + 1, &positionOffsetList) &&
+        readArray(p, end, sizes[1], &prevPatternIndexList) &&
+        readArray(p, end, sizes[1], &longestSuffixIndexList) &&
+        readArray(p, end, sizes[1], &lastLabelList) &&
+        readArray(p, end, sizes[1] + 1, &featureOffsetList) &&
+        readArray(p, end, sizes[2], &featureIndexList) &&
+        readArray(p, end, sizes[0], &longestMatchIndexList);
+}
 
-        for (size_t i = 1; i < curPatternList.size(); ++i) {
-            auto &curPattern = curPatternList[i];
-            auto &curWeight = curWeightList[i];
-            curWeight = 0.0;
-            for (auto &featureIndex : curPattern.getFeatureIndexList()) {
-                curWeight += weight_to_double(weights[featureIndex]);
-            }
-            curWeight += curWeightList[curPattern.getLongestSuffixIndex()];
+size_t PatternSetSequence::getMaxPatternSetSize() const {
+    size_t maxPatternSetSize = 0;
+    for (size_t pos = 0; pos < length(); ++pos) {
+        size_t size = positionOffsetList[pos + 1] - positionOffsetList[pos];
+        if (size > maxPatternSetSize) {
+            maxPatternSetSize = size;
         }
-        ret.emplace_back(move(curWeightList));
     }
-    return ret;
+    return maxPatternSetSize;
 }
 
 void PatternSetSequence::accumulateFeatureCounts(double *counts) const {
-    for (size_t pos = 0; pos < patternListList.size(); ++pos) {
-        auto &patternList = patternListList[pos];
+    for (size_t pos = 0; pos < length(); ++pos) {
+        size_t offset = positionOffsetList[pos];
         pattern_index_t index = longestMatchIndexList[pos];
         while (index != 0) {
-            for (auto featureIndex : patternList[index].getFeatureIndexList()) {
-                counts[featureIndex] += 1.0;
+            for (size_t i = featureOffsetList[offset + index]; i < featureOffsetList[offset + index + 1]; ++i) {
+                feature_index_t f = featureIndexList[i];
+                counts[f & ~NEGATED_FEATURE_FLAG] += (f & NEGATED_FEATURE_FLAG) ? -1.0 : 1.0;
             }
-            index = patternList[index].getLongestSuffixIndex();
+            index = longestSuffixIndexList[offset + index];
         }
     }
 }
 
+void PatternSetSequence::appendFeatureIndexes(vector<uint32_t> *featureIndexes) const {
+    for (feature_index_t f : featureIndexList) {
+        featureIndexes->emplace_back(f & ~NEGATED_FEATURE_FLAG);
+    }
+}
+
 vector<unordered_map<label_t, double>> PatternSetSequence::calcLabelLikelihoods(const double *expWeights) const {
     vector<unordered_map<label_t, double>> ret;
-    vector<vector<double>> scoreListList;
-    calcScores(expWeights, &scoreListList);
-    for (size_t i = 0; i < scoreListList.size(); ++i) {
+    static thread_local vector<double> scoreList;
+    calcScores(expWeights, &scoreList);
+    for (size_t pos = 0; pos < length(); ++pos) {
         unordered_map<label_t, double> curMap;
-        for (size_t j = 1; j < scoreListList[i].size(); ++j) {
-            if (patternListList[i][j].getLongestSuffixIndex() != 0) {
+        for (size_t i = positionOffsetList[pos] + 1; i < positionOffsetList[pos + 1]; ++i) {
+            if (longestSuffixIndexList[i] != 0) {
                 continue;
             }
-            label_t l = patternListList[i][j].getLastLabel();
-            curMap.insert(make_pair(l, scoreListList[i][j]));
+            curMap.insert(make_pair(lastLabelList[i], scoreList[i]));
         }
         ret.emplace_back(move(curMap));
     }
@@ -101,60 +167,82 @@ vector<unordered_map<label_t, double>> PatternSetSequence::calcLabelLikelihoods(
 }
 
 
-double PatternSetSequence::calcScores(const double *expWeights, vector<vector<double>> *scores) const {
-    size_t maxPatternSetSize = 0;
-    size_t sequenceLength = patternListList.size();
-    vector<vector<double>> &scoreListList = *scores;
-    vector<int> exponents(sequenceLength);
+template<typename T>
+double PatternSetSequence::calcScores(const T *expWeights, vector<T> *scores) const {
+    size_t sequenceLength = length();
+    size_t maxPatternSetSize = getMaxPatternSetSize();
+    size_t patternCount = lastLabelList.size();
 
-    for (auto &patternList : patternListList) {
-        size_t size = patternList.size();
-        if (size > maxPatternSetSize) {
-            maxPatternSetSize = size;
-        }
-        scoreListList.emplace_back(vector<double>(size));
-    }
+    static thread_local vector<T> weightList;
+    static thread_local vector<int> exponents;
+    static thread_local vector<T> tempScoreList1;
+    static thread_local vector<T> tempScoreList2;
 
-    vector<double> tempScoreList1(maxPatternSetSize);
-    vector<double> tempScoreList2(maxPatternSetSize);
+    scores->assign(patternCount, 0.0);
+    weightList.resize(patternCount);
+    exponents.assign(sequenceLength, 0);
+    tempScoreList1.assign(maxPatternSetSize, 0.0);
+    tempScoreList2.assign(maxPatternSetSize, 0.0);
 
-    vector<double> *curTempScoreList = &tempScoreList1;
-    vector<double> *prevTempScoreList = &tempScoreList2;
+    T *curTempScoreList = tempScoreList1.data();
+    T *prevTempScoreList = tempScoreList2.data();
 
-    auto weightListList = getAccumulatedWeightListList(patternListList, expWeights);
+    // accumulates weights
+    for (size_t pos = 0; pos < sequenceLength; ++pos) {
+        size_t offset = positionOffsetList[pos];
+        size_t listSize = positionOffsetList[pos + 1] - offset;
+        T *curWeightList = weightList.data() + offset;
+        curWeightList[0] = 1.0;
+
+        for (size_t index = 1; index < listSize; ++index) {
+            auto &curWeight = curWeightList[index];
+            curWeight = 1.0;
+            for (size_t i = featureOffsetList[offset + index]; i < featureOffsetList[offset + index + 1]; ++i) {
+                feature_index_t f = featureIndexList[i];
+                if (f & NEGATED_FEATURE_FLAG) {
+                    curWeight /= expWeights[f & ~NEGATED_FEATURE_FLAG];
+                }
+                else {
+                    curWeight *= expWeights[f];
+                }
+            }
+            curWeight *= curWeightList[longestSuffixIndexList[offset + index]];
+        }
+    }
 
     // forward calculations
 
     int exponentDiff = 0;
-    (*prevTempScoreList)[0] = 1.0;  // gamma for the position -1
+    prevTempScoreList[0] = 1.0;  // gamma for the position -1
     exponents[0] = 0;
 
     for (size_t pos = 0; pos < sequenceLength; ++pos) {
-        auto &curPatternList = patternListList[pos];
-        auto &scoreList = scoreListList[pos];
-        auto &weightList = weightListList[pos];
-        size_t listSize = curPatternList.size();
+        size_t offset = positionOffsetList[pos];
+        size_t listSize = positionOffsetList[pos + 1] - offset;
+        T *scoreList = scores->data() + offset;
+        const T *curWeightList = weightList.data() + offset;
+        const pattern_index_t *longestSuffixIndexes = longestSuffixIndexList.data() + offset;
+        const pattern_index_t *prevPatternIndexes = prevPatternIndexList.data() + offset;
 
-        fill(curTempScoreList->begin(), curTempScoreList->begin() + listSize, 0.0);
-        double scale = ldexp(1.0, -exponentDiff);
+        fill(curTempScoreList, curTempScoreList + listSize, 0.0);
+        T scale = (T)ldexp(1.0, -exponentDiff);
 
         for (size_t index = listSize - 1; index > 0; --index) {
-            auto &curPattern = curPatternList[index];
-            auto longestSuffixIndex = curPattern.getLongestSuffixIndex();
-            auto prevPatternIndex = curPattern.getPrevPatternIndex();
+            auto longestSuffixIndex = longestSuffixIndexes[index];
+            auto prevPatternIndex = prevPatternIndexes[index];
 
-            double prevGamma = (*prevTempScoreList)[prevPatternIndex] * scale;
+            T prevGamma = prevTempScoreList[prevPatternIndex] * scale;
 
             // calculates alphas
             scoreList[longestSuffixIndex] -= prevGamma;
             scoreList[index] += prevGamma;
 
             // calculates gammas
-            (*curTempScoreList)[index] += scoreList[index] * weightList[index];
-            (*curTempScoreList)[longestSuffixIndex] += (*curTempScoreList)[index];
+            curTempScoreList[index] += scoreList[index] * curWeightList[index];
+            curTempScoreList[longestSuffixIndex] += curTempScoreList[index];
         }
         scoreList[0] = 0.0;  // alpha for an empty pattern is 0
-        frexp((*curTempScoreList)[0], &exponentDiff);  // gets the exponent of the gamma of the empty pattern
+        frexp(curTempScoreList[0], &exponentDiff);  // gets the exponent of the gamma of the empty pattern
 
         if (pos < sequenceLength - 1) {
             exponents[pos + 1] = exponents[pos] + exponentDiff;
@@ -162,84 +250,77 @@ double PatternSetSequence::calcScores(const double *expWeights, vector<vector<do
         swap(curTempScoreList, prevTempScoreList);
     }
 
-    double normalizer = (*prevTempScoreList)[0];
+    T normalizer = prevTempScoreList[0];
     int normalizerExponent = exponents[sequenceLength - 1];
 
     // backward calculations
 
-    size_t lastListLength = patternListList[sequenceLength - 1].size();
+    size_t lastListLength = positionOffsetList[sequenceLength] - positionOffsetList[sequenceLength - 1];
     // clears deltas
-    fill(curTempScoreList->begin(), curTempScoreList->begin() + lastListLength, 0.0);
+    fill(curTempScoreList, curTempScoreList + lastListLength, 0.0);
     // delta for the empty pattern
-    (*curTempScoreList)[0] = 1;
+    curTempScoreList[0] = 1;
 
     for (size_t pos = sequenceLength; pos-- > 0;) {
-        auto &curPatternList = patternListList[pos];
-        auto &scoreList = scoreListList[pos];
-        auto &weightList = weightListList[pos];
-        size_t listSize = curPatternList.size();
-        size_t prevListSize = (pos > 0) ? patternListList[pos - 1].size() : 1;
+        size_t offset = positionOffsetList[pos];
+        size_t listSize = positionOffsetList[pos + 1] - offset;
+        size_t prevListSize = (pos > 0) ? offset - positionOffsetList[pos - 1] : 1;
+        T *scoreList = scores->data() + offset;
+        const T *curWeightList = weightList.data() + offset;
+        const pattern_index_t *longestSuffixIndexes = longestSuffixIndexList.data() + offset;
+        const pattern_index_t *prevPatternIndexes = prevPatternIndexList.data() + offset;
 
-        fill(prevTempScoreList->begin(), prevTempScoreList->begin() + prevListSize, 0.0);
-        double scale = ldexp(1.0, (pos > 0) ? (exponents[pos - 1] - exponents[pos]) : 0);
+        fill(prevTempScoreList, prevTempScoreList + prevListSize, 0.0);
+        T scale = (T)ldexp(1.0, (pos > 0) ? (exponents[pos - 1] - exponents[pos]) : 0);
 
         for (size_t index = 1; index < listSize; ++index) {
-            auto longestSuffixIndex = curPatternList[index].getLongestSuffixIndex();
             // beta
-            (*curTempScoreList)[index] += (*curTempScoreList)[longestSuffixIndex];
+            curTempScoreList[index] += curTempScoreList[longestSuffixIndexes[index]];
         }
 
-        (*curTempScoreList)[0] = 0;
-        for (size_t index = 1; index < listSize; ++index) {
-            auto &curPattern = curPatternList[index];
-            auto longestSuffixIndex = curPattern.getLongestSuffixIndex();
-            auto prevPatternIndex = curPattern.getPrevPatternIndex();
-
-            // beta * W
-            (*curTempScoreList)[index] *= weightList[index];
+        curTempScoreList[0] = 0;
+        // beta * W, and theta (alpha * beta * W)
+        multiplyBetasAndThetas(curTempScoreList + 1, scoreList + 1, curWeightList + 1, listSize - 1);
 
-            // theta (alpha * beta * W)
-            scoreList[index] *= (*curTempScoreList)[index];
+        for (size_t index = 1; index < listSize; ++index) {
+            auto longestSuffixIndex = longestSuffixIndexes[index];
+            auto prevPatternIndex = prevPatternIndexes[index];
 
             // delta
-            (*prevTempScoreList)[prevPatternIndex] += ((*curTempScoreList)[index] - (*curTempScoreList)[longestSuffixIndex]) * scale;
+            prevTempScoreList[prevPatternIndex] += (curTempScoreList[index] - curTempScoreList[longestSuffixIndex]) * scale;
         }
 
         // sigma
         for (size_t index = listSize - 1; index > 0; --index) {
-            auto longestSuffixIndex = curPatternList[index].getLongestSuffixIndex();
-            scoreList[longestSuffixIndex] += scoreList[index];
+            scoreList[longestSuffixIndexes[index]] += scoreList[index];
         }
 
-        // normalizes the scores and accumulates feature expectations
-        for (size_t index = listSize - 1; index > 0; --index) {
-            scoreList[index] /= scoreList[0];
-        }
+        // normalizes the scores
+        divideScores(scoreList + 1, listSize - 1, scoreList[0]);
 
         swap(prevTempScoreList, curTempScoreList);
     }
 
     // calculates the log likelihood of the sequence
-    double logLikelihood = -(log(normalizer) + log(2.0) * normalizerExponent);
+    double logLikelihood = -(log((double)normalizer) + log(2.0) * normalizerExponent);
     for (size_t pos = 0; pos < sequenceLength; ++pos) {
-        auto &weightList = weightListList[pos];
-        logLikelihood += log(weightList[longestMatchIndexList[pos]]);
+        logLikelihood += log((double)weightList[positionOffsetList[pos] + longestMatchIndexList[pos]]);
     }
 
     return logLikelihood;
 }
 
-// returns log likelihood of the sequence
-double PatternSetSequence::accumulateFeatureExpectations(const double *expWeights, vector<Utility::AtomicFixedPointNumber64> *expectations) const {
-    vector<vector<double>> scoreListList;
-    double logLikelihood = calcScores(expWeights, &scoreListList);
-    
+template<typename T, typename E>
+double PatternSetSequence::accumulateFeatureExpectationsWithScores(const T *expWeights, E *expectations) const {
+    static thread_local vector<T> scoreList;
+    double logLikelihood = calcScores(expWeights, &scoreList);
+
     // accumulates expectations
-    for (size_t pos = 0; pos < scoreListList.size(); ++pos) {
-        auto &curPatternList = patternListList[pos];
-        for (size_t index = 1; index < curPatternList.size(); ++index) {
-            for (auto &featureIndex : curPatternList[index].getFeatureIndexList()) {
-                (*expectations)[featureIndex] += scoreListList[pos][index];
+    for (size_t pos = 0; pos < length(); ++pos) {
+        for (size_t index = positionOffsetList[pos] + 1; index < positionOffsetList[pos + 1]; ++index) {
+            for (size_t i = featureOffsetList[index]; i < featureOffsetList[index + 1]; ++i) {
+                feature_index_t f = featureIndexList[i];
+                expectations[f & ~NEGATED_FEATURE_FLAG] += (f & NEGATED_FEATURE_FLAG) ? -scoreList[index] : scoreList[index];
             }
         }
     }
@@ -247,68 +328,111 @@ double PatternSetSequence::accumulateFeatureExpectations(const double *expWeight
     return logLikelihood;
 }
 
+// returns log likelihood of the sequence
+double PatternSetSequence::accumulateFeatureExpectations(const double *expWeights, vector<Utility::AtomicFixedPointNumber64> *expectations) const {
+    return accumulateFeatureExpectationsWithScores(expWeights, expectations->data());
+}
+
+double PatternSetSequence::accumulateFeatureExpectations(const float *expWeights, vector<Utility::AtomicFixedPointNumber64> *expectations) const {
+    return accumulateFeatureExpectationsWithScores(expWeights, expectations->data());
+}
+
+double PatternSetSequence::accumulateFeatureExpectations(const double *expWeights, double *expectations) const {
+    return accumulateFeatureExpectationsWithScores(expWeights, expectations);
+}
+
+double PatternSetSequence::accumulateFeatureExpectations(const float *expWeights, double *expectations) const {
+    return accumulateFeatureExpectationsWithScores(expWeights, expectations);
+}
+
 vector<label_t> PatternSetSequence::decode(const weight_t *weights) const {
-    size_t maxPatternSetSize = 0;
-    size_t sequenceLength = patternListList.size();
+    vector<label_t> bestLabelList(length());
+    decode(weights, bestLabelList.data());
+    return bestLabelList;
+}
 
-    vector<vector<pattern_index_t>> bestIndexListList(0);
-    bestIndexListList.reserve(sequenceLength);
+void PatternSetSequence::decode(const weight_t *weights, label_t *labels) const {
+    size_t sequenceLength = length();
+    size_t maxPatternSetSize = getMaxPatternSetSize();
+    size_t patternCount = lastLabelList.size();
 
-    for (auto &patternList : patternListList) {
-        size_t size = patternList.size();
-        if (size > maxPatternSetSize) {
-            maxPatternSetSize = size;
-        }
-        bestIndexListList.emplace_back(vector<pattern_index_t>(size));
-    }
+    static thread_local vector<double> weightList;
+    static thread_local vector<pattern_index_t> bestIndexList;
+    static thread_local vector<pattern_index_t> bestPrefixIndexList;
+    static thread_local vector<double> tempScoreList1;
+    static thread_local vector<double> tempScoreList2;
+    static thread_local vector<double> prevTempScoreListForLabel;
+
+    weightList.resize(patternCount);
+    bestIndexList.assign(patternCount, 0);
+    bestPrefixIndexList.assign(maxPatternSetSize, 0);
+    tempScoreList1.assign(maxPatternSetSize, 0.0);
+    tempScoreList2.assign(maxPatternSetSize, 0.0);
+    prevTempScoreListForLabel.assign(maxPatternSetSize, 0.0);
 
-    vector<pattern_index_t> bestPrefixIndexList(maxPatternSetSize);
-    vector<double> tempScoreList1(maxPatternSetSize);
-    vector<double> tempScoreList2(maxPatternSetSize);
+    double *curTempScoreList = tempScoreList1.data();
+    double *prevTempScoreList = tempScoreList2.data();
 
-    vector<double> *curTempScoreList = &tempScoreList1;
-    vector<double> *prevTempScoreList = &tempScoreList2;
-    vector<double> prevTempScoreListForLabel(maxPatternSetSize);
+    // accumulates weights
+    for (size_t pos = 0; pos < sequenceLength; ++pos) {
+        size_t offset = positionOffsetList[pos];
+        size_t listSize = positionOffsetList[pos + 1] - offset;
+        double *curWeightList = weightList.data() + offset;
+        curWeightList[0] = 0.0;
 
-    auto weightListList = getAccumulatedWeightListListForDecoding(patternListList, weights);
+        for (size_t index = 1; index < listSize; ++index) {
+            auto &curWeight = curWeightList[index];
+            const feature_index_t *featureIndexes = featureIndexList.data() + featureOffsetList[offset + index];
+            size_t featureCount = featureOffsetList[offset + index + 1] - featureOffsetList[offset + index];
+            curWeight = 0.0;
+            for (size_t i = 0; i < featureCount; ++i) {
+                feature_index_t f = featureIndexes[i];
+                double w = weight_to_double(weights[f & ~NEGATED_FEATURE_FLAG]);
+                curWeight += (f & NEGATED_FEATURE_FLAG) ? -w : w;
+            }
+            curWeight += curWeightList[longestSuffixIndexList[offset + index]];
+        }
+    }
 
-    (*prevTempScoreList)[0] = 0;
+    prevTempScoreList[0] = 0;
 
     for (size_t pos = 0; pos < sequenceLength; ++pos) {
-        auto &curPatternList = patternListList[pos];
-        auto &bestIndexList = bestIndexListList[pos];
-        auto &weightList = weightListList[pos];
-        size_t listSize = curPatternList.size();
-        size_t prevListSize = (pos > 0) ? patternListList[pos - 1].size() : 1;
-        
-        fill(curTempScoreList->begin(), curTempScoreList->begin() + listSize, -DBL_MAX);
+        size_t offset = positionOffsetList[pos];
+        size_t listSize = positionOffsetList[pos + 1] - offset;
+        size_t prevListSize = (pos > 0) ? offset - positionOffsetList[pos - 1] : 1;
+        pattern_index_t *curBestIndexList = bestIndexList.data() + offset;
+        const double *curWeightList = weightList.data() + offset;
+        const label_t *lastLabels = lastLabelList.data() + offset;
+        const pattern_index_t *prevPatternIndexes = prevPatternIndexList.data() + offset;
+        const pattern_index_t *prevLongestSuffixIndexes = (pos > 0) ? longestSuffixIndexList.data() + positionOffsetList[pos - 1] : nullptr;
+
+        fill(curTempScoreList, curTempScoreList + listSize, -DBL_MAX);
 
         label_t prevLabel = INVALID_LABEL;
         size_t prevIndex = prevListSize;
         double maxScore = -DBL_MAX;
 
         for (size_t index = listSize - 1; index > 0; --index) {
-            auto &curPattern = curPatternList[index];
-            if (curPattern.getLastLabel() != prevLabel) {
-                copy(prevTempScoreList->begin(), prevTempScoreList->begin() + prevListSize, prevTempScoreListForLabel.begin());
+            if (lastLabels[index] != prevLabel) {
+                copy(prevTempScoreList, prevTempScoreList + prevListSize, prevTempScoreListForLabel.begin());
                 for (size_t i = 0; i < prevListSize; ++i) {
                     bestPrefixIndexList[i] = (pattern_index_t)i;
                 }
                 prevIndex = prevListSize;
             }
-            prevLabel = curPattern.getLastLabel();
+            prevLabel = lastLabels[index];
             --prevIndex;
-            for (; prevIndex > curPattern.getPrevPatternIndex(); --prevIndex) {
-                auto longestSuffixIndex = patternListList[pos - 1][prevIndex].getLongestSuffixIndex();
+            for (; prevIndex > prevPatternIndexes[index]; --prevIndex) {
+                auto longestSuffixIndex = prevLongestSuffixIndexes[prevIndex];
                 if (prevTempScoreListForLabel[prevIndex] > prevTempScoreListForLabel[longestSuffixIndex]) {
                     prevTempScoreListForLabel[longestSuffixIndex] = prevTempScoreListForLabel[prevIndex];
                     bestPrefixIndexList[longestSuffixIndex] = bestPrefixIndexList[prevIndex];
                 }
             }
-            (*curTempScoreList)[index] = prevTempScoreListForLabel[prevIndex] + weightList[index];
-            bestIndexList[index] = bestPrefixIndexList[prevIndex];
-            if ((*curTempScoreList)[index] > maxScore) {
-                maxScore = (*curTempScoreList)[index];
+            curTempScoreList[index] = prevTempScoreListForLabel[prevIndex] + curWeightList[index];
+            curBestIndexList[index] = bestPrefixIndexList[prevIndex];
+            if (curTempScoreList[index] > maxScore) {
+                maxScore = curTempScoreList[index];
             }
         }
         swap(curTempScoreList, prevTempScoreList);
@@ -316,24 +440,20 @@ vector<label_t> PatternSetSequence::decode(const weight_t *weights) const {
 
     double lastBestScore = -DBL_MAX;
     size_t bestIndex = 0;
+    size_t lastListSize = positionOffsetList[sequenceLength] - positionOffsetList[sequenceLength - 1];
 
-    for (size_t index = 1; index < patternListList.back().size(); ++index) {
-        if ((*prevTempScoreList)[index] > lastBestScore) {
-            lastBestScore = (*prevTempScoreList)[index];
+    for (size_t index = 1; index < lastListSize; ++index) {
+        if (prevTempScoreList[index] > lastBestScore) {
+            lastBestScore = prevTempScoreList[index];
             bestIndex = index;
         }
     }
 
-    vector<label_t> bestLabelList(sequenceLength);
     for (size_t pos = sequenceLength; pos-- > 0;) {
-        auto &curPatternList = patternListList[pos];
-        auto &bestIndexList = bestIndexListList[pos];
-        
-        bestLabelList[pos] = curPatternList[bestIndex].getLastLabel();
-        bestIndex = bestIndexList[bestIndex];
+        size_t offset = positionOffsetList[pos];
+        labels[pos] = lastLabelList[offset + bestIndex];
+        bestIndex = bestIndexList[offset + bestIndex];
     }
-
-    return bestLabelList;
 }
 
 }  // namespace HighOrderCRF
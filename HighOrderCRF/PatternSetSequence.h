@@ -1,29 +1,74 @@
 #ifndef HOCRF_HIGH_ORDER_CRF_PATTERN_SET_SEQUENCE_H_
 #define HOCRF_HIGH_ORDER_CRF_PATTERN_SET_SEQUENCE_H_
 
+#include <cstdint>
+#include <ostream>
 #include <unordered_map>
 #include <vector>
 
 #include "../Utility/AtomicFixedPointNumber.h"
-#include "Pattern.h"
 #include "types.h"
 
 namespace HighOrderCRF {
 
+// Holds the pattern sets of a sequence in flat arrays. The patterns of all
+// the positions are stored one after another, and the pattern indices are
+// relative to the first pattern of each position. The feature indices of the
+// patterns are stored in CSR form. A feature index with NEGATED_FEATURE_FLAG
+// stands for the negated weight of the feature.
+//
+// The patterns of a position are added with addPattern(), starting with the
+// empty pattern, and the position is closed with finishPosition(). clear()
+// keeps the allocated memory, so a sequence can be reused as an arena for
+// many sentences.
 class PatternSetSequence
 {
 public:
-    PatternSetSequence(std::vector<std::vector<Pattern>> patternListList,
-                       std::vector<pattern_index_t> longestMatchIndexList) :
-    patternListList(move(patternListList)), longestMatchIndexList(longestMatchIndexList) {};
+    PatternSetSequence();
+    void clear();
+    void addPattern(pattern_index_t prevPatternIndex,
+                    pattern_index_t longestSuffixIndex,
+                    label_t lastLabel,
+                    const feature_index_t *featureIndexes,
+                    size_t featureCount);
+    void finishPosition(pattern_index_t longestMatchIndex);
+    void shrinkToFit();
+    size_t length() const;
+    size_t patternCount() const;
+    size_t getPatternSetSize(size_t pos) const;
+    // Writes the arrays in the native byte order.
+    void write(std::ostream *os) const;
+    // Reads a sequence written by write() from [*p, end) and advances *p.
+    // Returns false if the data are truncated.
+    bool read(const char **p, const char *end);
+
     void accumulateFeatureCounts(double *counts) const;
+    // Appends the features of all the patterns, which may be repeated.
+    void appendFeatureIndexes(std::vector<uint32_t> *featureIndexes) const;
     double accumulateFeatureExpectations(const double *expWeights, std::vector<Utility::AtomicFixedPointNumber64> *expectations) const;
+    // Runs the forward-backward calculations in single precision.
+    double accumulateFeatureExpectations(const float *expWeights, std::vector<Utility::AtomicFixedPointNumber64> *expectations) const;
+    // Accumulates into a buffer owned by the calling thread.
+    double accumulateFeatureExpectations(const double *expWeights, double *expectations) const;
+    double accumulateFeatureExpectations(const float *expWeights, double *expectations) const;
     std::vector<std::unordered_map<label_t, double>> calcLabelLikelihoods(const double *expWeights) const;
     std::vector<label_t> decode(const weight_t *weights) const;
-    
+    // labels must have room for length() labels
+    void decode(const weight_t *weights, label_t *labels) const;
+
 private:
-    double calcScores(const double *expWeights, std::vector<std::vector<double>> *scores) const;
-    std::vector<std::vector<Pattern>> patternListList;
+    size_t getMaxPatternSetSize() const;
+    template<typename T>
+    double calcScores(const T *expWeights, std::vector<T> *scores) const;
+    template<typename T, typename E>
+    double accumulateFeatureExpectationsWithScores(const T *expWeights, E *expectations) const;
+
+    std::vector<uint32_t> positionOffsetList;
+    std::vector<pattern_index_t> prevPatternIndexList;
+    std::vector<pattern_index_t> longestSuffixIndexList;
+    std::vector<label_t> lastLabelList;
+    std::vector<uint32_t> featureOffsetList;
+    std::vector<feature_index_t> featureIndexList;
     std::vector<pattern_index_t> longestMatchIndexList;
 };
 
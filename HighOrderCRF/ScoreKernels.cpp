@@ -0,0 +1,183 @@
+#include "ScoreKernels.h"
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HOCRF_USE_X86_KERNELS
+#endif
+
+namespace HighOrderCRF {
+
+template<typename T>
+static void multiplyBetasAndThetasScalar(T *betas, T *thetas, const T *weights, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        betas[i] *= weights[i];
+        thetas[i] *= betas[i];
+    }
+}
+
+template<typename T>
+static void divideScoresScalar(T *scores, size_t size, T divisor) {
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] /= divisor;
+    }
+}
+
+#ifdef HOCRF_USE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static void multiplyBetasAndThetasAvx2(double *betas, double *thetas, const double *weights, size_t size) {
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m256d b = _mm256_mul_pd(_mm256_loadu_pd(betas + i), _mm256_loadu_pd(weights + i));
+        _mm256_storeu_pd(betas + i, b);
+        _mm256_storeu_pd(thetas + i, _mm256_mul_pd(_mm256_loadu_pd(thetas + i), b));
+    }
+    multiplyBetasAndThetasScalar(betas + i, thetas + i, weights + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void divideScoresAvx2(double *scores, size_t size, double divisor) {
+    __m256d d = _mm256_set1_pd(divisor);
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        _mm256_storeu_pd(scores + i, _mm256_div_pd(_mm256_loadu_pd(scores + i), d));
+    }
+    divideScoresScalar(scores + i, size - i, divisor);
+}
+
+__attribute__((target("avx2")))
+static void multiplyBetasAndThetasAvx2(float *betas, float *thetas, const float *weights, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(betas + i), _mm256_loadu_ps(weights + i));
+        _mm256_storeu_ps(betas + i, b);
+        _mm256_storeu_ps(thetas + i, _mm256_mul_ps(_mm256_loadu_ps(thetas + i), b));
+    }
+    multiplyBetasAndThetasScalar(betas + i, thetas + i, weights + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static void divideScoresAvx2(float *scores, size_t size, float divisor) {
+    __m256 d = _mm256_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        _mm256_storeu_ps(scores + i, _mm256_div_ps(_mm256_loadu_ps(scores + i), d));
+    }
+    divideScoresScalar(scores + i, size - i, divisor);
+}
+
+__attribute__((target("avx512f")))
+static void multiplyBetasAndThetasAvx512(double *betas, double *thetas, const double *weights, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        __m512d b = _mm512_mul_pd(_mm512_loadu_pd(betas + i), _mm512_loadu_pd(weights + i));
+        _mm512_storeu_pd(betas + i, b);
+        _mm512_storeu_pd(thetas + i, _mm512_mul_pd(_mm512_loadu_pd(thetas + i), b));
+    }
+    multiplyBetasAndThetasScalar(betas + i, thetas + i, weights + i, size - i);
+}
+
+__attribute__((target("avx512f")))
+static void divideScoresAvx512(double *scores, size_t size, double divisor) {
+    __m512d d = _mm512_set1_pd(divisor);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        _mm512_storeu_pd(scores + i, _mm512_div_pd(_mm512_loadu_pd(scores + i), d));
+    }
+    divideScoresScalar(scores + i, size - i, divisor);
+}
+
+__attribute__((target("avx512f")))
+static void multiplyBetasAndThetasAvx512(float *betas, float *thetas, const float *weights, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m512 b = _mm512_mul_ps(_mm512_loadu_ps(betas + i), _mm512_loadu_ps(weights + i));
+        _mm512_storeu_ps(betas + i, b);
+        _mm512_storeu_ps(thetas + i, _mm512_mul_ps(_mm512_loadu_ps(thetas + i), b));
+    }
+    multiplyBetasAndThetasScalar(betas + i, thetas + i, weights + i, size - i);
+}
+
+__attribute__((target("avx512f")))
+static void divideScoresAvx512(float *scores, size_t size, float divisor) {
+    __m512 d = _mm512_set1_ps(divisor);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        _mm512_storeu_ps(scores + i, _mm512_div_ps(_mm512_loadu_ps(scores + i), d));
+    }
+    divideScoresScalar(scores + i, size - i, divisor);
+}
+
+#endif  // HOCRF_USE_X86_KERNELS
+
+template<typename T>
+static bool getScoreKernelSetOf(ScoreKernelType type, ScoreKernelSet<T> *kernels) {
+    switch (type) {
+    case SCALAR_KERNELS:
+        kernels->multiplyBetasAndThetas = multiplyBetasAndThetasScalar<T>;
+        kernels->divideScores = divideScoresScalar<T>;
+        return true;
+#ifdef HOCRF_USE_X86_KERNELS
+    case AVX2_KERNELS:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2")) {
+            return false;
+        }
+        kernels->multiplyBetasAndThetas = multiplyBetasAndThetasAvx2;
+        kernels->divideScores = divideScoresAvx2;
+        return true;
+    case AVX512_KERNELS:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx512f")) {
+            return false;
+        }
+        kernels->multiplyBetasAndThetas = multiplyBetasAndThetasAvx512;
+        kernels->divideScores = divideScoresAvx512;
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool getScoreKernelSet(ScoreKernelType type, ScoreKernelSet<double> *kernels) {
+    return getScoreKernelSetOf(type, kernels);
+}
+
+bool getScoreKernelSet(ScoreKernelType type, ScoreKernelSet<float> *kernels) {
+    return getScoreKernelSetOf(type, kernels);
+}
+
+// the fastest kernels the CPU supports
+template<typename T>
+static ScoreKernelSet<T> selectScoreKernelSet() {
+    ScoreKernelSet<T> kernels;
+    if (!getScoreKernelSetOf(AVX512_KERNELS, &kernels) && !getScoreKernelSetOf(AVX2_KERNELS, &kernels)) {
+        getScoreKernelSetOf(SCALAR_KERNELS, &kernels);
+    }
+    return kernels;
+}
+
+void multiplyBetasAndThetasVector(double *betas, double *thetas, const double *weights, size_t size) {
+    static const ScoreKernelSet<double> kernels = selectScoreKernelSet<double>();
+    kernels.multiplyBetasAndThetas(betas, thetas, weights, size);
+}
+
+void multiplyBetasAndThetasVector(float *betas, float *thetas, const float *weights, size_t size) {
+    static const ScoreKernelSet<float> kernels = selectScoreKernelSet<float>();
+    kernels.multiplyBetasAndThetas(betas, thetas, weights, size);
+}
+
+void divideScoresVector(double *scores, size_t size, double divisor) {
+    static const ScoreKernelSet<double> kernels = selectScoreKernelSet<double>();
+    kernels.divideScores(scores, size, divisor);
+}
+
+void divideScoresVector(float *scores, size_t size, float divisor) {
+    static const ScoreKernelSet<float> kernels = selectScoreKernelSet<float>();
+    kernels.divideScores(scores, size, divisor);
+}
+
+}  // namespace HighOrderCRF
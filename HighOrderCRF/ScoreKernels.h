@@ -0,0 +1,62 @@
+#ifndef HOCRF_HIGH_ORDER_CRF_SCORE_KERNELS_H_
+#define HOCRF_HIGH_ORDER_CRF_SCORE_KERNELS_H_
+
+#include <cstddef>
+
+namespace HighOrderCRF {
+
+// Dense stages of the forward-backward calculations. They use AVX-512 or AVX2
+// when the CPU supports them and give the same results as the scalar code,
+// since every element is computed with a single multiplication or division.
+// Sizes below MIN_VECTOR_KERNEL_SIZE, such as the pattern sets of the
+// segmenter, are computed inline, where a call costs more than it saves.
+
+static const size_t MIN_VECTOR_KERNEL_SIZE = 16;
+
+void multiplyBetasAndThetasVector(double *betas, double *thetas, const double *weights, size_t size);
+void multiplyBetasAndThetasVector(float *betas, float *thetas, const float *weights, size_t size);
+void divideScoresVector(double *scores, size_t size, double divisor);
+void divideScoresVector(float *scores, size_t size, float divisor);
+
+// betas[i] *= weights[i]; thetas[i] *= betas[i];
+template<typename T>
+inline void multiplyBetasAndThetas(T *betas, T *thetas, const T *weights, size_t size) {
+    if (size >= MIN_VECTOR_KERNEL_SIZE) {
+        multiplyBetasAndThetasVector(betas, thetas, weights, size);
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        betas[i] *= weights[i];
+        thetas[i] *= betas[i];
+    }
+}
+
+// scores[i] /= divisor;
+template<typename T>
+inline void divideScores(T *scores, size_t size, T divisor) {
+    if (size >= MIN_VECTOR_KERNEL_SIZE) {
+        divideScoresVector(scores, size, divisor);
+        return;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        scores[i] /= divisor;
+    }
+}
+
+enum ScoreKernelType { SCALAR_KERNELS, AVX2_KERNELS, AVX512_KERNELS };
+
+template<typename T>
+struct ScoreKernelSet {
+    void (*multiplyBetasAndThetas)(T *betas, T *thetas, const T *weights, size_t size);
+    void (*divideScores)(T *scores, size_t size, T divisor);
+};
+
+// Sets the scalar, AVX2 or AVX-512 kernels, or returns false if cpuid shows
+// that the CPU lacks them; the vector functions above use the fastest set,
+// chosen once on their first call.
+bool getScoreKernelSet(ScoreKernelType type, ScoreKernelSet<double> *kernels);
+bool getScoreKernelSet(ScoreKernelType type, ScoreKernelSet<float> *kernels);
+
+}  // namespace HighOrderCRF
+
+#endif  // HOCRF_HIGH_ORDER_CRF_SCORE_KERNELS_H_
@@ -0,0 +1,137 @@
+#include "DataSequence.h"
+#include "HighOrderCRFData.h"
+#include "InternalDataSequence.h"
+#include "PatternSetSequence.h"
+#include "ScoreKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace HighOrderCRF {
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::exit;
+using std::ifstream;
+using std::max;
+using std::sort;
+using std::string;
+using std::vector;
+
+// The sizes the kernels are called with in the backward pass: the pattern
+// set sizes of the positions minus the empty pattern.
+vector<size_t> readKernelSizeList(const string &modelFilename, const string &dataFilename) {
+    HighOrderCRFData modelData;
+    modelData.read(modelFilename);
+    ifstream ifs(dataFilename);
+    if (!ifs.is_open()) {
+        cerr << "Cannot open file: " << dataFilename << endl;
+        exit(1);
+    }
+    vector<size_t> sizeList;
+    PatternSetSequence patternSetSequence;
+    while (ifs) {
+        DataSequence dataSequence(ifs);
+        if (dataSequence.empty()) {
+            continue;
+        }
+        dataSequence
+            .toInternalDataSequence(modelData.getLabelMap())
+            .generatePatternSetSequence(modelData, false, &patternSetSequence);
+        for (size_t pos = 0; pos < patternSetSequence.length(); ++pos) {
+            sizeList.emplace_back(patternSetSequence.getPatternSetSize(pos) - 1);
+        }
+    }
+    return sizeList;
+}
+
+// Returns the nanoseconds per position of one call of each kernel.
+template<typename T, typename MultiplyProc, typename DivideProc>
+double runKernels(MultiplyProc multiply, DivideProc divide, const vector<size_t> &sizeList, size_t repeatCount) {
+    size_t maxSize = 0;
+    for (auto size : sizeList) {
+        maxSize = max(maxSize, size);
+    }
+    // multiplying and dividing by 1 keeps the values away from denormals
+    vector<T> betas(maxSize, (T)1.0);
+    vector<T> thetas(maxSize, (T)1.0);
+    vector<T> weights(maxSize, (T)1.0);
+    // the first round warms up the caches
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r <= repeatCount; ++r) {
+        if (r == 1) {
+            start = std::chrono::steady_clock::now();
+        }
+        for (auto size : sizeList) {
+            multiply(betas.data(), thetas.data(), weights.data(), size);
+            divide(thetas.data(), size, (T)1.0);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (repeatCount * sizeList.size());
+}
+
+template<typename T>
+void benchmark(const char *typeName, const vector<size_t> &sizeList, size_t repeatCount) {
+    static const ScoreKernelType typeList[] = { SCALAR_KERNELS, AVX2_KERNELS, AVX512_KERNELS };
+    static const char *nameList[] = { "scalar", "AVX2", "AVX-512" };
+    double scalarTime = 0.0;
+    for (size_t i = 0; i < sizeof(typeList) / sizeof(typeList[0]); ++i) {
+        ScoreKernelSet<T> kernels;
+        if (!getScoreKernelSet(typeList[i], &kernels)) {
+            cout << typeName << " " << nameList[i] << ": not supported" << endl;
+            continue;
+        }
+        double t = runKernels<T>(kernels.multiplyBetasAndThetas, kernels.divideScores, sizeList, repeatCount);
+        if (i == 0) {
+            scalarTime = t;
+        }
+        cout << typeName << " " << nameList[i] << ": " << t << " ns/position, " << scalarTime / t << "x" << endl;
+    }
+    // the functions used by the forward-backward calculations, inlined
+    double t = runKernels<T>([](T *betas, T *thetas, const T *weights, size_t size) { multiplyBetasAndThetas(betas, thetas, weights, size); },
+                             [](T *scores, size_t size, T divisor) { divideScores(scores, size, divisor); },
+                             sizeList, repeatCount);
+    cout << typeName << " dispatched: " << t << " ns/position, " << scalarTime / t << "x" << endl;
+}
+
+int mainProc(int argc, char **argv) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <model> <feature file> [repeat count]" << endl;
+        return 1;
+    }
+    auto sizeList = readKernelSizeList(argv[1], argv[2]);
+    if (sizeList.empty()) {
+        cerr << "No sequences in " << argv[2] << endl;
+        return 1;
+    }
+    size_t repeatCount = argc > 3 ? atoi(argv[3]) : 100;
+
+    auto sortedSizeList = sizeList;
+    sort(sortedSizeList.begin(), sortedSizeList.end());
+    double sum = 0.0;
+    for (auto size : sortedSizeList) {
+        sum += size;
+    }
+    size_t n = sortedSizeList.size();
+    cout << "positions: " << n << ", mean size: " << sum / n
+         << ", median: " << sortedSizeList[n / 2]
+         << ", 90th percentile: " << sortedSizeList[n * 9 / 10]
+         << ", max: " << sortedSizeList[n - 1] << endl;
+
+    benchmark<double>("double", sizeList, repeatCount);
+    benchmark<float>("float", sizeList, repeatCount);
+    return 0;
+}
+
+}  // namespace HighOrderCRF
+
+int main(int argc, char **argv) {
+    return HighOrderCRF::mainProc(argc, argv);
+}
@@ -0,0 +1,83 @@
+#include "SequenceShardStore.h"
+
+#include "../Utility/MappedFile.h"
+#include "PatternSetSequence.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace HighOrderCRF {
+
+using std::cerr;
+using std::endl;
+using std::exit;
+using std::ios;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::to_string;
+using std::vector;
+
+SequenceShardStore::SequenceShardStore(const string &directory, const string &name, size_t shardSize)
+    : directory(directory), name(name), shardSize(shardSize), shardCount(0), sequenceCount(0) {}
+
+string SequenceShardStore::getShardFilename(size_t shardIndex) const {
+    return directory + "/" + name + "." + to_string(shardIndex);
+}
+
+void SequenceShardStore::add(const PatternSetSequence &sequence) {
+    if (out.is_open() && (size_t)out.tellp() >= shardSize) {
+        out.close();
+    }
+    if (!out.is_open()) {
+        string filename = getShardFilename(shardCount);
+        out.open(filename, ios::out | ios::binary | ios::trunc);
+        if (!out.is_open()) {
+            cerr << "Cannot write to file: " << filename << endl;
+            exit(1);
+        }
+        ++shardCount;
+    }
+    sequence.write(&out);
+    if (!out) {
+        cerr << "Cannot write to file: " << getShardFilename(shardCount - 1) << endl;
+        exit(1);
+    }
+    ++sequenceCount;
+}
+
+void SequenceShardStore::finish() {
+    if (out.is_open()) {
+        out.close();
+    }
+}
+
+size_t SequenceShardStore::getShardCount() const {
+    return shardCount;
+}
+
+size_t SequenceShardStore::getSequenceCount() const {
+    return sequenceCount;
+}
+
+void SequenceShardStore::readShard(size_t shardIndex, vector<shared_ptr<PatternSetSequence>> *sequenceList) const {
+    string filename = getShardFilename(shardIndex);
+    Utility::MappedFile file(filename);
+    const char *p = file.data();
+    const char *end = p + file.size();
+    sequenceList->clear();
+    while (p < end) {
+        auto sequence = make_shared<PatternSetSequence>();
+        if (!sequence->read(&p, end)) {
+            cerr << "The shard file is corrupted: " << filename << endl;
+            exit(1);
+        }
+        sequenceList->emplace_back(sequence);
+    }
+}
+
+}  // namespace HighOrderCRF
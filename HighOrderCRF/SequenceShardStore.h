@@ -0,0 +1,42 @@
+#ifndef HOCRF_HIGH_ORDER_CRF_SEQUENCE_SHARD_STORE_H_
+#define HOCRF_HIGH_ORDER_CRF_SEQUENCE_SHARD_STORE_H_
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace HighOrderCRF {
+
+class PatternSetSequence;
+
+// Stores pattern set sequences in shard files of about shardSize bytes named
+// name.0, name.1, ... in a directory, so that training does not have to keep all of them in memory.
+// The sequences are added in order, and each shard is read back as a whole.
+class SequenceShardStore
+{
+public:
+    SequenceShardStore(const std::string &directory, const std::string &name, size_t shardSize);
+    void add(const PatternSetSequence &sequence);
+    // Closes the last shard. No sequences can be added afterwards.
+    void finish();
+    size_t getShardCount() const;
+    size_t getSequenceCount() const;
+    // Replaces the contents of sequenceList with the sequences of the shard.
+    void readShard(size_t shardIndex, std::vector<std::shared_ptr<PatternSetSequence>> *sequenceList) const;
+
+private:
+    SequenceShardStore(const SequenceShardStore &) = delete;
+    SequenceShardStore &operator=(const SequenceShardStore &) = delete;
+    std::string getShardFilename(size_t shardIndex) const;
+    std::string directory;
+    std::string name;
+    size_t shardSize;
+    size_t shardCount;
+    size_t sequenceCount;
+    std::ofstream out;
+};
+
+}  // namespace HighOrderCRF
+
+#endif  // HOCRF_HIGH_ORDER_CRF_SEQUENCE_SHARD_STORE_H_
@@ -0,0 +1,167 @@
+#include "TrainingCache.h"
+
+#include "../Utility/MappedFile.h"
+#include "HighOrderCRFData.h"
+#include "PatternSetSequence.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace HighOrderCRF {
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::exit;
+using std::ifstream;
+using std::ios;
+using std::make_shared;
+using std::ofstream;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+static const char TRAINING_CACHE_MAGIC[8] = { 'H', 'O', 'C', 'R', 'F', 'T', 'C', '\0' };
+static const uint32_t TRAINING_CACHE_VERSION = 1;
+static const uint32_t TRAINING_CACHE_BYTE_ORDER_MARK = 0x01020304;
+
+// The header is followed by the model image, the feature counts and the
+// sequences. The feature counts start at an offset aligned to 8 bytes.
+struct TrainingCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint64_t sourceFileSize;
+    int64_t sourceModificationTime;
+    uint64_t cutoff;
+    uint64_t modelImageSize;
+    uint64_t featureCount;
+    uint64_t sequenceCount;
+};
+
+static size_t alignTo8(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+static void getSourceFileStatus(const string &sourceFilename, uint64_t *size, int64_t *modificationTime) {
+    struct stat st;
+    if (stat(sourceFilename.c_str(), &st) != 0) {
+        cerr << "Cannot read from file: " << sourceFilename << endl;
+        exit(1);
+    }
+    *size = (uint64_t)st.st_size;
+    *modificationTime = (int64_t)st.st_mtime;
+}
+
+bool readTrainingCache(const string &cacheFilename,
+                       const string &sourceFilename,
+                       size_t cutoff,
+                       HighOrderCRFData *modelData,
+                       vector<double> *featureCountList,
+                       vector<shared_ptr<PatternSetSequence>> *sequenceList) {
+    ifstream probe(cacheFilename);
+    if (!probe.is_open()) {
+        return false;
+    }
+    probe.close();
+
+    Utility::MappedFile file(cacheFilename);
+    const char *p = file.data();
+    const char *end = p + file.size();
+    TrainingCacheHeader header;
+    if (file.size() < sizeof(header)) {
+        cout << "The training cache is corrupted and will be rebuilt." << endl;
+        return false;
+    }
+    memcpy(&header, p, sizeof(header));
+    uint64_t sourceFileSize;
+    int64_t sourceModificationTime;
+    getSourceFileStatus(sourceFilename, &sourceFileSize, &sourceModificationTime);
+    if (memcmp(header.magic, TRAINING_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRAINING_CACHE_VERSION ||
+        header.byteOrderMark != TRAINING_CACHE_BYTE_ORDER_MARK ||
+        header.sourceFileSize != sourceFileSize ||
+        header.sourceModificationTime != sourceModificationTime ||
+        header.cutoff != cutoff) {
+        cout << "The training cache is out of date and will be rebuilt." << endl;
+        return false;
+    }
+    p += sizeof(header);
+
+    size_t featureCountOffset = alignTo8(sizeof(header) + header.modelImageSize);
+    if (file.size() < featureCountOffset + sizeof(double) * header.featureCount) {
+        cout << "The training cache is corrupted and will be rebuilt." << endl;
+        return false;
+    }
+    modelData->readImage(p, header.modelImageSize);
+    p = file.data() + featureCountOffset;
+    featureCountList->resize(header.featureCount);
+    memcpy(featureCountList->data(), p, sizeof(double) * header.featureCount);
+    p += sizeof(double) * header.featureCount;
+
+    sequenceList->clear();
+    sequenceList->reserve(header.sequenceCount);
+    for (uint64_t i = 0; i < header.sequenceCount; ++i) {
+        auto sequence = make_shared<PatternSetSequence>();
+        if (!sequence->read(&p, end)) {
+            cout << "The training cache is corrupted and will be rebuilt." << endl;
+            sequenceList->clear();
+            return false;
+        }
+        sequenceList->emplace_back(sequence);
+    }
+    return true;
+}
+
+void writeTrainingCache(const string &cacheFilename,
+                        const string &sourceFilename,
+                        size_t cutoff,
+                        const HighOrderCRFData &modelData,
+                        const vector<double> &featureCountList,
+                        const vector<shared_ptr<PatternSetSequence>> &sequenceList) {
+    TrainingCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRAINING_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TRAINING_CACHE_VERSION;
+    header.byteOrderMark = TRAINING_CACHE_BYTE_ORDER_MARK;
+    getSourceFileStatus(sourceFilename, &header.sourceFileSize, &header.sourceModificationTime);
+    header.cutoff = cutoff;
+    size_t imageSize;
+    const char *image = modelData.getImage(&imageSize);
+    header.modelImageSize = imageSize;
+    header.featureCount = featureCountList.size();
+    header.sequenceCount = sequenceList.size();
+
+    // writes to a temporary file first so that an interrupted run does not
+    // leave a broken cache behind
+    string tempFilename = cacheFilename + ".tmp";
+    ofstream out(tempFilename, ios::out | ios::binary);
+    if (!out.is_open()) {
+        cerr << "Cannot write to file: " << tempFilename << endl;
+        exit(1);
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(image, imageSize);
+    static const char padding[8] = {};
+    out.write(padding, alignTo8(sizeof(header) + imageSize) - (sizeof(header) + imageSize));
+    out.write(reinterpret_cast<const char *>(featureCountList.data()), sizeof(double) * featureCountList.size());
+    for (const auto &sequence : sequenceList) {
+        sequence->write(&out);
+    }
+    out.close();
+    if (!out || std::rename(tempFilename.c_str(), cacheFilename.c_str()) != 0) {
+        cerr << "Cannot write to file: " << cacheFilename << endl;
+        exit(1);
+    }
+}
+
+}  // namespace HighOrderCRF
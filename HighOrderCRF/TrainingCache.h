@@ -0,0 +1,35 @@
+#ifndef HOCRF_HIGH_ORDER_CRF_TRAINING_CACHE_H_
+#define HOCRF_HIGH_ORDER_CRF_TRAINING_CACHE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace HighOrderCRF {
+
+class HighOrderCRFData;
+class PatternSetSequence;
+
+// A file that holds what training compiles from a training file: the model
+// image without weights, the counts of the features and the pattern sets of
+// the sequences. The file is mapped and read in bulk, and it is only used
+// when the size and the modification time of the training file and the
+// cutoff are the same as when it was written.
+// Returns false if there is no valid cache.
+bool readTrainingCache(const std::string &cacheFilename,
+                       const std::string &sourceFilename,
+                       size_t cutoff,
+                       HighOrderCRFData *modelData,
+                       std::vector<double> *featureCountList,
+                       std::vector<std::shared_ptr<PatternSetSequence>> *sequenceList);
+
+void writeTrainingCache(const std::string &cacheFilename,
+                        const std::string &sourceFilename,
+                        size_t cutoff,
+                        const HighOrderCRFData &modelData,
+                        const std::vector<double> &featureCountList,
+                        const std::vector<std::shared_ptr<PatternSetSequence>> &sequenceList);
+
+}  // namespace HighOrderCRF
+
+#endif  // HOCRF_HIGH_ORDER_CRF_TRAINING_CACHE_H_
@@ -3,136 +3,192 @@
 
 #include "types.h"
 
+#include <algorithm>
 #include <cassert>
-#include <memory>
+#include <cstdint>
 #include <vector>
 
 namespace HighOrderCRF {
 
-template<typename L>
-struct TrieNode {
-    L label;
-    std::vector<TrieNode> children;
-    int value;
-
-    TrieNode(L label) : label(label) {
-        value = -1;
-    }
-
-    size_t getChildCount() const {
-        return children.size();
-    }
-    
-    size_t getChildIndex(L label) const {
-        size_t index = 0;
-        if (children.size() < 32) {
-            for (index = 0; index < children.size() && label > children[index].label; ++index);
-            return index;
-        } else {
-            size_t start = 0;
-            size_t end = children.size();
-            while (start < end) {
-                index = (start + end) / 2;
-                if (label - children[index].label > 0) {
-                    start = index + 1;
-                } else {
-                    end = index;
-                }
-            }
-            return start;
-        }
-    }
-
-    TrieNode *getChild(size_t index, L label) const {
-        if (index < children.size() && children[index].label == label) {
-            return const_cast<TrieNode *>(&children[index]);
-        }
-        return 0;
-    }
-
-    TrieNode *addChild(size_t index, L label) {
-        assert(index >= 0 && index <= children.size());
-        return &(*children.emplace(children.begin() + index, label));
-    }
-};
-
-template<typename L>
-void visitValidNodesRec(std::vector<L> &labels, TrieNode<L> *node, TrieNode<L> *validParent, void (*proc)(L *, size_t, int, int, void *), void *data) {
-    TrieNode<L>* newParent;
-    if (node->value != -1) {
-        (*proc)(labels.data(), labels.size(), node->value, validParent->value, data);
-        newParent = node;
-    } else {
-        newParent = validParent;
-    }
-    for (TrieNode<L> &child : node->children) {
-        labels.emplace_back(child.label);
-        visitValidNodesRec(labels, &child, newParent, proc, data);
-        labels.pop_back();
-    }
-}
-
+// A trie whose nodes are kept in a single array. The children of a node are
+// found through an open-addressing hash table keyed by (parent, label), and
+// they are sorted by label only when the nodes are visited.
+//
+// clear() keeps the allocated memory, and the hash table is invalidated by
+// bumping an epoch counter instead of being overwritten, so a trie can be
+// reused for many sentences at no cost.
 template<typename L>
 class Trie {
 public:
-    Trie() : rootNode(-1) {
+    Trie() : epoch(1), slotMask(0) {
+        clear();
     }
 
-    ~Trie() {
+    void clear() {
+        nodeList.clear();
+        nodeList.emplace_back(Node(-1, NO_NODE));
+        if (++epoch == 0) {
+            for (auto &slot : slotList) {
+                slot.epoch = 0;
+            }
+            epoch = 1;
+        }
     }
 
-    bool isEmpty() {
-        return rootNode.getChildCount() == 0;
+    bool isEmpty() const {
+        return nodeList[0].firstChild == NO_NODE;
     }
 
     int findOrInsert(const L *data, size_t size, int value) {
-        TrieNode<L> *node = &rootNode;
+        uint32_t node = 0;
         for (size_t i = 0; i < size; ++i) {
-            size_t index = node->getChildIndex(data[i]);
-            TrieNode<L> *nextNode = node->getChild(index, data[i]);
-            if (!nextNode) {
-                nextNode = node->addChild(index, data[i]);
+            uint32_t nextNode = findChild(node, data[i]);
+            if (nextNode == NO_NODE) {
+                nextNode = addChild(node, data[i]);
             }
             node = nextNode;
         }
-        if (node->value == -1) {
-            node->value = value;
+        if (nodeList[node].value == -1) {
+            nodeList[node].value = value;
         }
-        return node->value;
+        return nodeList[node].value;
     }
 
     int find(const L *data, size_t size) const {
-        const TrieNode<L> *node = &rootNode;
+        uint32_t node = 0;
         for (size_t i = 0; i < size; ++i) {
-            node = node->getChild(node->getChildIndex(data[i]), data[i]);
-            assert(node != 0);
+            node = findChild(node, data[i]);
+            assert(node != NO_NODE);
         }
-        return node->value;
+        return nodeList[node].value;
     }
 
     int findLongestMatch(const L *data, size_t size) const {
-        const TrieNode<L> *node = &rootNode;
-        int value = node->value;
+        uint32_t node = 0;
+        int value = nodeList[node].value;
         for (size_t i = 0; i < size; ++i) {
-            TrieNode<L> *nextNode = node->getChild(node->getChildIndex(data[i]), data[i]);
-            if (!nextNode) {
+            uint32_t nextNode = findChild(node, data[i]);
+            if (nextNode == NO_NODE) {
                 return value;
             }
             node = nextNode;
-            if (node->value != -1) {
-                value = node->value;
+            if (nodeList[node].value != -1) {
+                value = nodeList[node].value;
             }
         }
         return value;
     }
 
+    // Visits the nodes with values in depth-first order, the children of
+    // each node in ascending order of their labels.
     void visitValidNodes(void (*proc)(L *, size_t, int, int, void *), void *data) {
-        std::vector<L> v;
-        visitValidNodesRec(v, &rootNode, &rootNode, proc, data);
+        labelList.clear();
+        childList.clear();
+        visitValidNodesRec(0, 0, proc, data);
     }
 
 private:
-    TrieNode<L> rootNode;
+    static const uint32_t NO_NODE = (uint32_t)-1;
+
+    struct Node {
+        Node(L label, uint32_t parent) : label(label), value(-1), parent(parent), firstChild(NO_NODE), nextSibling(NO_NODE) {}
+        L label;
+        int value;
+        uint32_t parent;
+        uint32_t firstChild;
+        uint32_t nextSibling;
+    };
+
+    struct Slot {
+        uint32_t epoch;
+        uint32_t node;
+    };
+
+    static size_t hash(uint32_t parent, L label) {
+        uint32_t h = parent * 0x9e3779b1u ^ (uint32_t)label * 0x85ebca77u;
+        return h ^ (h >> 15);
+    }
+
+    uint32_t findChild(uint32_t parent, L label) const {
+        if (slotList.empty()) {
+            return NO_NODE;
+        }
+        for (size_t i = hash(parent, label) & slotMask; slotList[i].epoch == epoch; i = (i + 1) & slotMask) {
+            const Node &node = nodeList[slotList[i].node];
+            if (node.parent == parent && node.label == label) {
+                return slotList[i].node;
+            }
+        }
+        return NO_NODE;
+    }
+
+    void insertSlot(uint32_t index) {
+        const Node &node = nodeList[index];
+        size_t i = hash(node.parent, node.label) & slotMask;
+        while (slotList[i].epoch == epoch) {
+            i = (i + 1) & slotMask;
+        }
+        slotList[i].epoch = epoch;
+        slotList[i].node = index;
+    }
+
+    uint32_t addChild(uint32_t parent, L label) {
+        uint32_t index = (uint32_t)nodeList.size();
+        nodeList.emplace_back(Node(label, parent));
+        nodeList[index].nextSibling = nodeList[parent].firstChild;
+        nodeList[parent].firstChild = index;
+
+        // keeps the load factor at most 1/2
+        if (nodeList.size() * 2 > slotList.size()) {
+            size_t capacity = slotList.empty() ? 64 : slotList.size() * 2;
+            slotList.assign(capacity, Slot());
+            for (auto &slot : slotList) {
+                slot.epoch = 0;
+            }
+            epoch = 1;
+            slotMask = capacity - 1;
+            for (uint32_t i = 1; i < nodeList.size(); ++i) {
+                insertSlot(i);
+            }
+        }
+        else {
+            insertSlot(index);
+        }
+        return index;
+    }
+
+    void visitValidNodesRec(uint32_t index, uint32_t validParent, void (*proc)(L *, size_t, int, int, void *), void *data) {
+        uint32_t newParent;
+        if (nodeList[index].value != -1) {
+            (*proc)(labelList.data(), labelList.size(), nodeList[index].value, nodeList[validParent].value, data);
+            newParent = index;
+        } else {
+            newParent = validParent;
+        }
+        size_t start = childList.size();
+        for (uint32_t child = nodeList[index].firstChild; child != NO_NODE; child = nodeList[child].nextSibling) {
+            childList.emplace_back(child);
+        }
+        size_t end = childList.size();
+        const auto &nodes = nodeList;
+        std::sort(childList.begin() + start, childList.end(), [&nodes](uint32_t a, uint32_t b) {
+            return nodes[a].label < nodes[b].label;
+        });
+        for (size_t i = start; i < end; ++i) {
+            uint32_t child = childList[i];
+            labelList.emplace_back(nodeList[child].label);
+            visitValidNodesRec(child, newParent, proc, data);
+            labelList.pop_back();
+        }
+        childList.resize(start);
+    }
+
+    std::vector<Node> nodeList;
+    std::vector<Slot> slotList;
+    uint32_t epoch;
+    size_t slotMask;
+    std::vector<L> labelList;
+    std::vector<uint32_t> childList;
 };
 
 }  // namespace HighOrderCRF
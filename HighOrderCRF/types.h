@@ -10,6 +10,9 @@ typedef int32_t label_t;
 typedef uint16_t pattern_index_t;
 typedef uint32_t feature_index_t;
 #define INVALID_FEATURE ((uint32_t)-1);
+// Set on the index of a feature whose weight is negated by signed hashing.
+#define NEGATED_FEATURE_FLAG ((feature_index_t)0x80000000)
+#define INVALID_FEATURE_TEMPLATE ((uint32_t)-1)
 
 typedef uint32_t weight_t;
 
@@ -1,79 +1,91 @@
-#ifndef HOCRF_MAX_ENT_OBSERVATION_H_
-#define HOCRF_MAX_ENT_OBSERVATION_H_
-
 #include "CompiledData.h"
 
+#include "GatherKernels.h"
+
 #include <cassert>
 #include <cmath>
 #include <cstdint>
-#include <limits>
-#include <mutex>
-#include <string>
 #include <vector>
 
 namespace MaxEnt {
 
-using std::mutex;
-using std::numeric_limits;
-using std::string;
 using std::vector;
 
-CompiledData::CompiledData(vector<vector<uint32_t>> featureIndexListList,
-                           vector<string> labelStringList,
-                           size_t correctLabelIndex) {
-    assert(featureIndexListList.size() == labelStringList.size());
-    assert(correctLabelIndex < labelStringList.size());
-    this->featureIndexListList = featureIndexListList;
-    this->labelStringList = labelStringList;
-    this->correctLabelIndex = correctLabelIndex;
+CompiledData::CompiledData() {
+    clear();
+}
+
+void CompiledData::clear() {
+    labelOffsetList.assign(1, 0);
+    correctLabelIndexList.clear();
+    featureOffsetList.assign(1, 0);
+    featureIndexList.clear();
+}
+
+void CompiledData::addLabel(const uint32_t *featureIndexes, size_t featureCount) {
+    featureIndexList.insert(featureIndexList.end(), featureIndexes, featureIndexes + featureCount);
+    featureOffsetList.emplace_back(featureIndexList.size());
+}
+
+void CompiledData::finishObservation(size_t correctLabelIndex) {
+    // featureOffsetList has an offset for each label after the first one
+    size_t labelCount = featureOffsetList.size() - 1;
+    assert(correctLabelIndex < labelCount - labelOffsetList.back());
+    correctLabelIndexList.emplace_back(correctLabelIndex);
+    labelOffsetList.emplace_back(labelCount);
+}
+
+void CompiledData::shrinkToFit() {
+    labelOffsetList.shrink_to_fit();
+    correctLabelIndexList.shrink_to_fit();
+    featureOffsetList.shrink_to_fit();
+    featureIndexList.shrink_to_fit();
+}
+
+size_t CompiledData::size() const {
+    return correctLabelIndexList.size();
 }
 
-void CompiledData::accumulateFeatureCounts(double *counts) const {
-    for (size_t featureIndex : featureIndexListList[correctLabelIndex]) {
-        counts[featureIndex] += 1.0;
+size_t CompiledData::getFeatureCount(size_t observationIndex) const {
+    return featureOffsetList[labelOffsetList[observationIndex + 1]] - featureOffsetList[labelOffsetList[observationIndex]];
+}
+
+void CompiledData::accumulateFeatureCounts(size_t observationIndex, double *counts) const {
+    size_t label = labelOffsetList[observationIndex] + correctLabelIndexList[observationIndex];
+    for (size_t i = featureOffsetList[label]; i < featureOffsetList[label + 1]; ++i) {
+        counts[featureIndexList[i]] += 1.0;
     }
 }
 
-static mutex expectationMutex;
-// returns log likelihood of the sequence
-double CompiledData::accumulateFeatureExpectations(const double *expWeights, double *expectations) const {
-    size_t labelCount = featureIndexListList.size();
+void CompiledData::appendFeatureIndexes(size_t observationIndex, vector<uint32_t> *featureIndexes) const {
+    featureIndexes->insert(featureIndexes->end(),
+                           featureIndexList.begin() + featureOffsetList[labelOffsetList[observationIndex]],
+                           featureIndexList.begin() + featureOffsetList[labelOffsetList[observationIndex + 1]]);
+}
+
+// returns log likelihood of the observation
+double CompiledData::accumulateFeatureExpectations(size_t observationIndex, const double *expWeights, double *expectations) const {
+    size_t labelBegin = labelOffsetList[observationIndex];
+    size_t labelCount = labelOffsetList[observationIndex + 1] - labelBegin;
+    const uint32_t *featureOffsets = featureOffsetList.data() + labelBegin;
     double sum = 0.0;
-    vector<double> scoreList(labelCount);
-    for (size_t labelIndex = 0; labelIndex < featureIndexListList.size(); ++labelIndex) {
-        scoreList[labelIndex] = 1.0;
-        for (uint32_t featureIndex : featureIndexListList[labelIndex]) {
-            scoreList[labelIndex] *= expWeights[featureIndex];
-        }
+    static thread_local vector<double> scoreList;
+    if (scoreList.size() < labelCount) {
+        scoreList.resize(labelCount);
+    }
+    for (size_t labelIndex = 0; labelIndex < labelCount; ++labelIndex) {
+        scoreList[labelIndex] = gatherProduct(expWeights,
+                                              featureIndexList.data() + featureOffsets[labelIndex],
+                                              featureOffsets[labelIndex + 1] - featureOffsets[labelIndex]);
         sum += scoreList[labelIndex];
     }
-    for (size_t labelIndex = 0; labelIndex < featureIndexListList.size(); ++labelIndex) {
+    for (size_t labelIndex = 0; labelIndex < labelCount; ++labelIndex) {
         double prob = scoreList[labelIndex] / sum;
-        expectationMutex.lock();
-        for (uint32_t featureIndex : featureIndexListList[labelIndex]) {
-            expectations[featureIndex] += prob;
-        }
-        expectationMutex.unlock();
-    }
-    return log(scoreList[correctLabelIndex] / sum);
-}
-
-const string &CompiledData::inferLabel(const double *weights) const {
-    double maxScore = numeric_limits<double>::lowest();
-    size_t bestLabelIndex = 0;
-    for (size_t labelIndex = 0; labelIndex < featureIndexListList.size(); ++labelIndex) {
-        auto &featureIndexList = featureIndexListList[labelIndex];
-        double score = 0.0;
-        for (uint32_t featureIndex : featureIndexList) {
-            score += weights[featureIndex];
-        }
-        if (score > maxScore) {
-            maxScore = score;
-            bestLabelIndex = labelIndex;
+        for (size_t i = featureOffsets[labelIndex]; i < featureOffsets[labelIndex + 1]; ++i) {
+            expectations[featureIndexList[i]] += prob;
         }
     }
-    return labelStringList[bestLabelIndex];
+    return log(scoreList[correctLabelIndexList[observationIndex]] / sum);
 }
 
 }  // namespace MaxEnt
-#endif  // HOCRF_MAX_ENT_OBSERVATION_H_
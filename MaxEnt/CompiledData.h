@@ -1,26 +1,46 @@
 #ifndef HOCRF_MAX_ENT_COMPILED_DATA_H_
 #define HOCRF_MAX_ENT_COMPILED_DATA_H_
 
+#include <cstddef>
 #include <cstdint>
-#include <string>
 #include <vector>
 
 namespace MaxEnt {
 
+// Holds compiled observations in CSR form. The labels of all the
+// observations are stored one after another, and the feature indices of the
+// labels are stored in one array. A label is identified by its position in
+// the possible label set of the observation, not by its string.
+//
+// The labels of an observation are added with addLabel(), and the
+// observation is closed with finishObservation(). clear() keeps the
+// allocated memory.
 class CompiledData
 {
 public:
-    CompiledData(std::vector<std::vector<uint32_t>> featureIndexListList,
-                 std::vector<std::string> labelStringList,
-                 size_t correctLabelIndex);
-    void accumulateFeatureCounts(double *counts) const;
-    double accumulateFeatureExpectations(const double *expWeights, double *expectations) const;
-    const std::string &inferLabel(const double *expWeights) const;
-    
+    CompiledData();
+    void clear();
+    void addLabel(const uint32_t *featureIndexes, size_t featureCount);
+    // correctLabelIndex is the position among the labels added, not the ID.
+    void finishObservation(size_t correctLabelIndex);
+    void shrinkToFit();
+    // the number of the observations
+    size_t size() const;
+
+    // the number of the features of all the labels of the observation
+    size_t getFeatureCount(size_t observationIndex) const;
+    void accumulateFeatureCounts(size_t observationIndex, double *counts) const;
+    // Appends the features of all the labels, which may be repeated.
+    void appendFeatureIndexes(size_t observationIndex, std::vector<uint32_t> *featureIndexes) const;
+    // Accumulates into a buffer owned by the calling thread. The scores of
+    // the labels are kept in a buffer of the thread as well.
+    double accumulateFeatureExpectations(size_t observationIndex, const double *expWeights, double *expectations) const;
+
 private:
-    std::vector<std::vector<uint32_t>> featureIndexListList;
-    std::vector<std::string> labelStringList;
-    size_t correctLabelIndex;
+    std::vector<uint32_t> labelOffsetList;
+    std::vector<uint32_t> correctLabelIndexList;
+    std::vector<uint32_t> featureOffsetList;
+    std::vector<uint32_t> featureIndexList;
 };
 
 }  // namespace MaxEnt
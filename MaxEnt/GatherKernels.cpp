@@ -0,0 +1,74 @@
+#include "GatherKernels.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HOCRF_USE_X86_KERNELS
+#endif
+
+namespace MaxEnt {
+
+typedef double (*GatherProc)(const double *, const uint32_t *, size_t);
+
+// Lane j takes the elements whose positions are j modulo 4 up to the last
+// full block of four. The lanes are multiplied as (0 * 1) * (2 * 3), and
+// the rest of the elements are multiplied one by one.
+
+static double gatherProductScalar(const double *values, const uint32_t *indexes, size_t size) {
+    double lanes[4] = { 1.0, 1.0, 1.0, 1.0 };
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        for (size_t j = 0; j < 4; ++j) {
+            lanes[j] *= values[indexes[i + j]];
+        }
+    }
+    double result = (lanes[0] * lanes[1]) * (lanes[2] * lanes[3]);
+    for (; i < size; ++i) {
+        result *= values[indexes[i]];
+    }
+    return result;
+}
+
+#ifdef HOCRF_USE_X86_KERNELS
+
+__attribute__((target("avx2")))
+static double gatherProductAvx2(const double *values, const uint32_t *indexes, size_t size) {
+    __m256d acc = _mm256_set1_pd(1.0);
+    const __m256d allLanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        __m128i idx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(indexes + i));
+        // the masked form starts from an explicit source, which the
+        // unmasked one leaves undefined
+        __m256d gathered = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values, idx, allLanes, 8);
+        acc = _mm256_mul_pd(acc, gathered);
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double result = (lanes[0] * lanes[1]) * (lanes[2] * lanes[3]);
+    for (; i < size; ++i) {
+        result *= values[indexes[i]];
+    }
+    return result;
+}
+
+#endif  // HOCRF_USE_X86_KERNELS
+
+static GatherProc selectGatherProduct() {
+#ifdef HOCRF_USE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return gatherProductAvx2;
+    }
+#endif
+    return gatherProductScalar;
+}
+
+double gatherProduct(const double *values, const uint32_t *indexes, size_t size) {
+    static const GatherProc proc = selectGatherProduct();
+    return proc(values, indexes, size);
+}
+
+}  // namespace MaxEnt
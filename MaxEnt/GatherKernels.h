@@ -0,0 +1,16 @@
+#ifndef HOCRF_MAX_ENT_GATHER_KERNELS_H_
+#define HOCRF_MAX_ENT_GATHER_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MaxEnt {
+
+// The product of values[indexes[i]] over i < size. It uses AVX2 gathers when
+// the CPU supports them. The scalar code runs the same four lanes in the
+// same order, so the result does not depend on the CPU.
+double gatherProduct(const double *values, const uint32_t *indexes, size_t size);
+
+}  // namespace MaxEnt
+
+#endif  // HOCRF_MAX_ENT_GATHER_KERNELS_H_
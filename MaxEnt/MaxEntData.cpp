@@ -1,56 +1,239 @@
 #include "MaxEntData.h"
 #include "Observation.h"
+#include "../Utility/MappedFile.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
-
 namespace MaxEnt {
 
+using std::cerr;
+using std::count;
+using std::endl;
+using std::exit;
+using std::find;
 using std::ios;
 using std::ifstream;
 using std::make_pair;
+using std::make_shared;
+using std::move;
 using std::ofstream;
 using std::pair;
+using std::set;
+using std::sort;
 using std::string;
 using std::unordered_map;
 using std::vector;
 
+// The layout of the memory-mappable model file. All the numbers are stored
+// in the native byte order, which is checked by byteOrderMark when reading.
+// Each section starts at an offset aligned to 8 bytes. The hash values are
+// stored in the file, so they must not depend on the platform.
+//
+// The label sets are looked up through an open-addressing hash table whose
+// slots hold label set indexes (INVALID_INDEX for an empty slot), and are
+// checked against the strings, whose bytes for the i-th label set are
+//   labelSetStringData[labelSetStringOffsetList[i]
+//                      .. labelSetStringOffsetList[i + 1]].
+// The attributes are looked up through a perfect hash whose slots hold
+// attribute indexes, and are checked against the attribute IDs.
+// The weight row table is keyed by (label set index << 32 | attribute index)
+// (EMPTY_WEIGHT_ROW_KEY for an empty slot) and holds the offsets of the rows
+// in the weight rows. The table sizes are powers of two and collisions are
+// resolved by linear probing.
+enum ModelImageSection {
+    LABEL_SET_HASH_TABLE,
+    LABEL_SET_STRING_OFFSETS,
+    LABEL_SET_STRINGS,
+    LABEL_SET_LABEL_COUNTS,
+    ATTRIBUTE_DISPLACEMENTS,
+    ATTRIBUTE_SLOTS,
+    ATTRIBUTE_IDS,
+    WEIGHT_ROW_KEYS,
+    WEIGHT_ROW_OFFSETS,
+    WEIGHT_ROWS,
+    MODEL_IMAGE_SECTION_COUNT
+};
+
+struct ModelImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t labelSetCount;
+    uint32_t labelSetHashTableSize;
+    uint32_t attrCount;
+    uint32_t attrBucketCount;
+    uint32_t attrSlotCount;
+    uint32_t weightRowTableSize;
+    uint64_t weightRowListSize;
+    uint64_t imageSize;
+    uint64_t sectionOffsetList[MODEL_IMAGE_SECTION_COUNT];
+};
+
+static const char MODEL_IMAGE_MAGIC[8] = { 'H', 'O', 'C', 'R', 'F', 'M', 'E', 'M' };
+// The training format has the layout of the legacy format after this magic,
+// but holds the attribute IDs as 64-bit numbers instead of the strings.
+static const char MODEL_ID_FORMAT_MAGIC[8] = { 'H', 'O', 'C', 'R', 'F', 'M', 'E', 'I' };
+// version 1 held the attribute strings instead of the IDs
+static const uint32_t MODEL_IMAGE_VERSION = 2;
+static const uint32_t MODEL_IMAGE_BYTE_ORDER_MARK = 0x01020304;
+static const uint32_t INVALID_INDEX = UINT32_MAX;
+static const uint64_t EMPTY_WEIGHT_ROW_KEY = UINT64_MAX;
+static const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+static uint64_t hashBytes(uint64_t h, const char *str, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        h ^= (unsigned char)str[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+// FNV-1a over the labels joined with ':', the same bytes as the label set
+// part of the label strings.
+static uint64_t hashLabelSet(const set<string> &labelSet) {
+    uint64_t h = FNV_OFFSET_BASIS;
+    bool isFirst = true;
+    for (const auto &label : labelSet) {
+        if (!isFirst) {
+            h = hashBytes(h, ":", 1);
+        }
+        h = hashBytes(h, label.data(), label.size());
+        isFirst = false;
+    }
+    return h;
+}
+
+static bool matchLabelSet(const char *str, size_t length, const set<string> &labelSet) {
+    size_t pos = 0;
+    bool isFirst = true;
+    for (const auto &label : labelSet) {
+        if (!isFirst) {
+            if (pos >= length || str[pos] != ':') {
+                return false;
+            }
+            ++pos;
+        }
+        if (length - pos < label.size() || memcmp(str + pos, label.data(), label.size()) != 0) {
+            return false;
+        }
+        pos += label.size();
+        isFirst = false;
+    }
+    return pos == length;
+}
+
+uint64_t MaxEntData::getAttributeId(const char *str, size_t length) {
+    return hashBytes(FNV_OFFSET_BASIS, str, length);
+}
+
+uint64_t MaxEntData::extendAttributeId(uint64_t attributeId, const char *str, size_t length) {
+    return hashBytes(attributeId, str, length);
+}
+
+// the finalizer of SplitMix64
+static uint64_t mixHash(uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+// The attributes are placed by hash and displace: the attributes are put
+// into buckets by their hash values, and each bucket has a displacement
+// that sends all its attributes to free slots.
+static size_t getAttrBucket(uint64_t h, size_t bucketCount) {
+    return (size_t)((h >> 32) % bucketCount);
+}
+
+static size_t getAttrSlot(uint64_t h, uint32_t displacement, size_t slotCount) {
+    return (size_t)(mixHash(h + displacement * 0x9e3779b97f4a7c15ULL) % slotCount);
+}
+
+static size_t getHashTableSize(size_t entryCount) {
+    size_t size = 1;
+    while (size < entryCount * 2) {
+        size <<= 1;
+    }
+    return size;
+}
+
+// Splits a label string of the form "label/label set" whose label is one of
+// the labels of the label set. Labels may contain '/' and ':'.
+static bool splitLabelString(const string &str, string *label, string *labelSetStr) {
+    for (size_t pos = str.find('/'); pos != string::npos; pos = str.find('/', pos + 1)) {
+        string l = str.substr(0, pos);
+        string s = str.substr(pos + 1);
+        for (size_t begin = 0; begin + l.size() <= s.size(); ) {
+            size_t end = begin + l.size();
+            if (s.compare(begin, l.size(), l) == 0 && (end == s.size() || s[end] == ':')) {
+                *label = move(l);
+                *labelSetStr = move(s);
+                return true;
+            }
+            begin = s.find(':', begin);
+            if (begin == string::npos) {
+                break;
+            }
+            ++begin;
+        }
+    }
+    return false;
+}
+
 template<class T>
-T readNumber(ifstream *ifs) {
-    T num;
-    memset(&num, 0, sizeof(T));
+void appendSection(vector<char> *image, uint64_t *offset, const T *data, size_t count) {
+    image->resize((image->size() + 7) & ~(size_t)7);
+    *offset = image->size();
+    const char *p = reinterpret_cast<const char *>(data);
+    image->insert(image->end(), p, p + sizeof(T) * count);
+}
+
+template<class T>
+void writeNumber(ofstream *ofs, T num) {
     unsigned char val;
     size_t shift = 0;
     for (size_t i = 0; i < sizeof(T); ++i) {
-        ifs->read((char *)&val, 1);
-        num |= ((T)val << shift);
+        val = num >> shift & 0xff;
+        ofs->write((char *)&val, 1);
         shift += 8;
     }
-    return num;
 }
 
 template<class T>
-void writeNumber(ofstream *ofs, T num) {
-    unsigned char val;
+T readNumber(ifstream *ifs) {
+    T num;
+    memset(&num, 0, sizeof(T));
+    unsigned char val = 0;
     size_t shift = 0;
     for (size_t i = 0; i < sizeof(T); ++i) {
-        val = num >> shift & 0xff;
-        ofs->write((char *)&val, 1);
+        ifs->read((char *)&val, 1);
+        num |= ((T)val << shift);
         shift += 8;
     }
+    return num;
 }
 
-string readString(ifstream *ifs, vector<char> *buffer) {
+// Reads nothing if the length is over maxLength, which fails the stream.
+string readString(ifstream *ifs, vector<char> *buffer, size_t maxLength) {
     string str;
     uint32_t len = readNumber<uint32_t>(ifs);
+    if (len > maxLength) {
+        ifs->setstate(ios::failbit);
+        return str;
+    }
     if (len > buffer->size()) {
         buffer->resize(len);
     }
@@ -64,16 +247,196 @@ void writeString(ofstream *ofs, const string &str) {
     ofs->write(str.data(), str.size());
 }
 
-MaxEntData::MaxEntData() {}
+vector<char> buildImage(const unordered_map<string, uint32_t> &labelToIndexMap,
+                        const unordered_map<uint64_t, uint32_t> &attrToIndexMap,
+                        const unordered_map<pair<uint32_t, uint32_t>, uint32_t> &indexPairToFeatureIndexMap,
+                        const vector<double> &bestWeightList) {
+    // group the labels by label set, and sort them as in a set<string>
+    vector<uint32_t> labelSetStringOffsetList(1, 0);
+    vector<char> labelSetStringData;
+    vector<uint32_t> labelSetLabelCountList;
+    vector<uint32_t> labelSetIndexList(labelToIndexMap.size(), INVALID_INDEX);
+    vector<uint32_t> labelPositionList(labelToIndexMap.size(), INVALID_INDEX);
+    {
+        vector<const string *> labelStringList(labelToIndexMap.size());
+        for (const auto &e : labelToIndexMap) {
+            labelStringList[e.second] = &e.first;
+        }
+        unordered_map<string, uint32_t> labelSetStrToIndexMap;
+        vector<string> labelSetStrList;
+        vector<vector<pair<string, uint32_t>>> labelSetLabelListList;
+        for (uint32_t i = 0; i < labelStringList.size(); ++i) {
+            string label;
+            string labelSetStr;
+            if (!splitLabelString(*labelStringList[i], &label, &labelSetStr)) {
+                continue;
+            }
+            auto it = labelSetStrToIndexMap.find(labelSetStr);
+            if (it == labelSetStrToIndexMap.end()) {
+                it = labelSetStrToIndexMap.insert(make_pair(labelSetStr, (uint32_t)labelSetStrList.size())).first;
+                labelSetStrList.emplace_back(labelSetStr);
+                labelSetLabelListList.emplace_back();
+            }
+            labelSetLabelListList[it->second].emplace_back(move(label), i);
+        }
+
+        for (size_t i = 0; i < labelSetStrList.size(); ++i) {
+            auto &labelList = labelSetLabelListList[i];
+            sort(labelList.begin(), labelList.end());
+            set<string> labelSet;
+            for (const auto &p : labelList) {
+                labelSet.insert(p.first);
+            }
+            // a label set whose labels are not all in the model is left out
+            if (!matchLabelSet(labelSetStrList[i].data(), labelSetStrList[i].size(), labelSet)) {
+                continue;
+            }
+            uint32_t labelSetIndex = labelSetStringOffsetList.size() - 1;
+            for (size_t j = 0; j < labelList.size(); ++j) {
+                labelSetIndexList[labelList[j].second] = labelSetIndex;
+                labelPositionList[labelList[j].second] = j;
+            }
+            labelSetStringData.insert(labelSetStringData.end(), labelSetStrList[i].begin(), labelSetStrList[i].end());
+            labelSetStringOffsetList.emplace_back(labelSetStringData.size());
+            labelSetLabelCountList.emplace_back(labelList.size());
+        }
+    }
+    size_t labelSetCount = labelSetStringOffsetList.size() - 1;
+    vector<uint32_t> labelSetHashTable(getHashTableSize(labelSetCount), INVALID_INDEX);
+    for (uint32_t i = 0; i < labelSetCount; ++i) {
+        uint32_t begin = labelSetStringOffsetList[i];
+        uint64_t h = hashBytes(FNV_OFFSET_BASIS, labelSetStringData.data() + begin, labelSetStringOffsetList[i + 1] - begin);
+        size_t slot = h & (labelSetHashTable.size() - 1);
+        while (labelSetHashTable[slot] != INVALID_INDEX) {
+            slot = (slot + 1) & (labelSetHashTable.size() - 1);
+        }
+        labelSetHashTable[slot] = i;
+    }
+
+    // the attribute IDs and their perfect hash
+    size_t attrCount = attrToIndexMap.size();
+    vector<uint64_t> attrIdList(attrCount);
+    for (const auto &e : attrToIndexMap) {
+        attrIdList[e.second] = e.first;
+    }
+    size_t bucketCount = attrCount / 4 + 1;
+    size_t slotCount = attrCount + attrCount / 4 + 1;
+    vector<vector<uint32_t>> bucketList(bucketCount);
+    for (uint32_t i = 0; i < attrCount; ++i) {
+        bucketList[getAttrBucket(attrIdList[i], bucketCount)].emplace_back(i);
+    }
+    // the largest buckets are placed first, while most slots are free
+    vector<uint32_t> bucketOrder(bucketCount);
+    for (uint32_t i = 0; i < bucketCount; ++i) {
+        bucketOrder[i] = i;
+    }
+    sort(bucketOrder.begin(), bucketOrder.end(), [&bucketList](uint32_t b1, uint32_t b2) {
+        return bucketList[b1].size() != bucketList[b2].size() ? bucketList[b1].size() > bucketList[b2].size() : b1 < b2;
+    });
+    vector<uint32_t> attrDisplacementList(bucketCount, 0);
+    vector<uint32_t> attrSlotList(slotCount, INVALID_INDEX);
+    vector<size_t> slots;
+    for (uint32_t b : bucketOrder) {
+        const auto &bucket = bucketList[b];
+        for (uint32_t displacement = 0; !bucket.empty(); ++displacement) {
+            slots.clear();
+            bool isFree = true;
+            for (uint32_t attrIndex : bucket) {
+                size_t slot = getAttrSlot(attrIdList[attrIndex], displacement, slotCount);
+                if (attrSlotList[slot] != INVALID_INDEX || find(slots.begin(), slots.end(), slot) != slots.end()) {
+                    isFree = false;
+                    break;
+                }
+                slots.emplace_back(slot);
+            }
+            if (isFree) {
+                for (size_t i = 0; i < bucket.size(); ++i) {
+                    attrSlotList[slots[i]] = bucket[i];
+                }
+                attrDisplacementList[b] = displacement;
+                break;
+            }
+        }
+    }
+
+    // the weight rows, in the order of the features
+    vector<pair<uint32_t, uint32_t>> featureList(bestWeightList.size(), make_pair(INVALID_INDEX, INVALID_INDEX));
+    for (const auto &e : indexPairToFeatureIndexMap) {
+        if (e.second < featureList.size()) {
+            featureList[e.second] = e.first;
+        }
+    }
+    unordered_map<uint64_t, uint32_t> weightRowMap;
+    vector<double> weightRowList;
+    for (size_t i = 0; i < featureList.size(); ++i) {
+        uint32_t labelIndex = featureList[i].first;
+        if (labelIndex >= labelSetIndexList.size() || labelSetIndexList[labelIndex] == INVALID_INDEX) {
+            continue;
+        }
+        uint32_t labelSetIndex = labelSetIndexList[labelIndex];
+        uint64_t key = ((uint64_t)labelSetIndex << 32) | featureList[i].second;
+        auto it = weightRowMap.find(key);
+        if (it == weightRowMap.end()) {
+            it = weightRowMap.insert(make_pair(key, (uint32_t)weightRowList.size())).first;
+            weightRowList.resize(weightRowList.size() + labelSetLabelCountList[labelSetIndex], 0.0);
+        }
+        weightRowList[it->second + labelPositionList[labelIndex]] = bestWeightList[i];
+    }
+    vector<uint64_t> weightRowKeyList(getHashTableSize(weightRowMap.size()), EMPTY_WEIGHT_ROW_KEY);
+    vector<uint32_t> weightRowOffsetList(weightRowKeyList.size(), 0);
+    for (const auto &e : weightRowMap) {
+        size_t slot = mixHash(e.first) & (weightRowKeyList.size() - 1);
+        while (weightRowKeyList[slot] != EMPTY_WEIGHT_ROW_KEY) {
+            slot = (slot + 1) & (weightRowKeyList.size() - 1);
+        }
+        weightRowKeyList[slot] = e.first;
+        weightRowOffsetList[slot] = e.second;
+    }
+
+    ModelImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MODEL_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = MODEL_IMAGE_VERSION;
+    header.byteOrderMark = MODEL_IMAGE_BYTE_ORDER_MARK;
+    header.labelSetCount = labelSetCount;
+    header.labelSetHashTableSize = labelSetHashTable.size();
+    header.attrCount = attrCount;
+    header.attrBucketCount = bucketCount;
+    header.attrSlotCount = slotCount;
+    header.weightRowTableSize = weightRowKeyList.size();
+    header.weightRowListSize = weightRowList.size();
+
+    vector<char> image(sizeof(header));
+    auto offsets = header.sectionOffsetList;
+    appendSection(&image, &offsets[LABEL_SET_HASH_TABLE], labelSetHashTable.data(), labelSetHashTable.size());
+    appendSection(&image, &offsets[LABEL_SET_STRING_OFFSETS], labelSetStringOffsetList.data(), labelSetStringOffsetList.size());
+    appendSection(&image, &offsets[LABEL_SET_STRINGS], labelSetStringData.data(), labelSetStringData.size());
+    appendSection(&image, &offsets[LABEL_SET_LABEL_COUNTS], labelSetLabelCountList.data(), labelSetLabelCountList.size());
+    appendSection(&image, &offsets[ATTRIBUTE_DISPLACEMENTS], attrDisplacementList.data(), attrDisplacementList.size());
+    appendSection(&image, &offsets[ATTRIBUTE_SLOTS], attrSlotList.data(), attrSlotList.size());
+    appendSection(&image, &offsets[ATTRIBUTE_IDS], attrIdList.data(), attrIdList.size());
+    appendSection(&image, &offsets[WEIGHT_ROW_KEYS], weightRowKeyList.data(), weightRowKeyList.size());
+    appendSection(&image, &offsets[WEIGHT_ROW_OFFSETS], weightRowOffsetList.data(), weightRowOffsetList.size());
+    appendSection(&image, &offsets[WEIGHT_ROWS], weightRowList.data(), weightRowList.size());
+    image.resize((image.size() + 7) & ~(size_t)7);
+    header.imageSize = image.size();
+    memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+MaxEntData::MaxEntData() {
+    buildInferenceIndex();
+}
 
 MaxEntData::MaxEntData(unordered_map<string, uint32_t> labelToIndexMap,
-    unordered_map<string, uint32_t> attrToIndexMap,
+    unordered_map<uint64_t, uint32_t> attrToIndexMap,
     unordered_map<pair<uint32_t, uint32_t>, uint32_t> indexPairToFeatureIndexMap,
     vector<double> bestWeightList) {
     this->labelToIndexMap = move(labelToIndexMap);
     this->attrToIndexMap = move(attrToIndexMap);
     this->indexPairToFeatureIndexMap = move(indexPairToFeatureIndexMap);
     this->bestWeightList = move(bestWeightList);
+    buildInferenceIndex();
 }
 
 const vector<double> &MaxEntData::getBestWeightList() const {
@@ -84,7 +447,7 @@ unordered_map<string, uint32_t> &MaxEntData::getLabelToIndexMap() {
     return labelToIndexMap;
 }
 
-unordered_map<string, uint32_t> &MaxEntData::getAttrToIndexMap() {
+unordered_map<uint64_t, uint32_t> &MaxEntData::getAttrToIndexMap() {
     return attrToIndexMap;
 }
 
@@ -93,36 +456,75 @@ unordered_map<pair<uint32_t, uint32_t>, uint32_t> &MaxEntData::getIndexPairToFea
 }
 
 void MaxEntData::read(const string &filename) {
+    auto file = make_shared<Utility::MappedFile>(filename);
+    if (file->size() >= sizeof(MODEL_IMAGE_MAGIC) && memcmp(file->data(), MODEL_IMAGE_MAGIC, sizeof(MODEL_IMAGE_MAGIC)) == 0) {
+        labelToIndexMap.clear();
+        attrToIndexMap.clear();
+        indexPairToFeatureIndexMap.clear();
+        bestWeightList.clear();
+        imageBuffer.clear();
+        mappedFile = file;
+        setImage(mappedFile->data(), mappedFile->size());
+        return;
+    }
+    size_t fileSize = file->size();
+    file.reset();
+    // Counts that the rest of the file cannot hold are corrupted, and are
+    // rejected before the memory for them is reserved.
+    auto checkCount = [fileSize](uint32_t count, size_t entrySize) {
+        if (count > fileSize / entrySize) {
+            cerr << "The model file is corrupted." << endl;
+            exit(1);
+        }
+    };
+
     ifstream in(filename, ios::in | ios::binary);
     vector<char> buffer;
+    char magic[sizeof(MODEL_ID_FORMAT_MAGIC)];
+    bool hasAttributeIds = in.read(magic, sizeof(magic)) && memcmp(magic, MODEL_ID_FORMAT_MAGIC, sizeof(magic)) == 0;
+    if (!hasAttributeIds) {
+        in.clear();
+        in.seekg(0);
+    }
 
     buffer.reserve(1024);  // a buffer of an arbitrary size
 
     {
         uint32_t num = readNumber<uint32_t>(&in);
+        checkCount(num, sizeof(uint32_t));
         labelToIndexMap.clear();
         labelToIndexMap.reserve(num);
-        for (uint32_t i = 0; i < num; ++i) {
-            string str =  readString(&in, &buffer);
+        for (uint32_t i = 0; i < num && in; ++i) {
+            string str =  readString(&in, &buffer, fileSize);
             labelToIndexMap.insert(make_pair(str, i));
         }
     }
     
     {
         uint32_t num = readNumber<uint32_t>(&in);
+        checkCount(num, hasAttributeIds ? sizeof(uint64_t) : sizeof(uint32_t));
         attrToIndexMap.clear();
         attrToIndexMap.reserve(num);
-        for (uint32_t i = 0; i < num; ++i) {
-            string str = readString(&in, &buffer);
-            attrToIndexMap.insert(make_pair(str, i));
+        for (uint32_t i = 0; i < num && in; ++i) {
+            if (hasAttributeIds) {
+                attrToIndexMap.insert(make_pair(readNumber<uint64_t>(&in), i));
+                continue;
+            }
+            string str = readString(&in, &buffer, fileSize);
+            if (in && !attrToIndexMap.insert(make_pair(getAttributeId(str.data(), str.size()), i)).second) {
+                cerr << "The IDs of two attributes in the model collide: " << str << endl;
+                exit(1);
+            }
         }
     }
     
     uint32_t featureNum = readNumber<uint32_t>(&in);
+    // a pair of indexes and a weight for each feature
+    checkCount(featureNum, sizeof(uint32_t) * 2 + sizeof(uint64_t));
     {
         indexPairToFeatureIndexMap.clear();
         indexPairToFeatureIndexMap.reserve(featureNum);
-        for (uint32_t i = 0; i < featureNum; ++i) {
+        for (uint32_t i = 0; i < featureNum && in; ++i) {
             uint32_t first = readNumber<uint32_t>(&in);
             uint32_t second = readNumber<uint32_t>(&in);
             indexPairToFeatureIndexMap.insert(make_pair(make_pair(first, second), i));
@@ -132,16 +534,25 @@ void MaxEntData::read(const string &filename) {
     {
         bestWeightList.clear();
         bestWeightList.reserve(featureNum);
-        for (uint32_t i = 0; i < featureNum; ++i) {
+        for (uint32_t i = 0; i < featureNum && in; ++i) {
             uint64_t t = readNumber<uint64_t>(&in);  // assuming that the size of double is 64 bits
             bestWeightList.emplace_back(*(double *)&t);
         }
     }
 
+    if (!in) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
     in.close();
+    buildInferenceIndex();
 }
 
 void MaxEntData::trim() {
+    // a mapped model has been trimmed when it was written
+    if (mappedFile) {
+        return;
+    }
     // set valid attribute flags
     vector<bool> attributeIsValidFlagList(attrToIndexMap.size());
     for (auto &entry : indexPairToFeatureIndexMap) {
@@ -209,18 +620,204 @@ void MaxEntData::trim() {
         }
     }
     indexPairToFeatureIndexMap = move(newMap);
+    buildInferenceIndex();
+}
+
+void MaxEntData::buildInferenceIndex() {
+    auto newImage = buildImage(labelToIndexMap, attrToIndexMap, indexPairToFeatureIndexMap, bestWeightList);
+    mappedFile.reset();
+    imageBuffer = move(newImage);
+    setImage(imageBuffer.data(), imageBuffer.size());
+}
+
+void MaxEntData::setImage(const char *image, size_t imageSize) {
+    ModelImageHeader header;
+    if (imageSize < sizeof(header)) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, MODEL_IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.byteOrderMark != MODEL_IMAGE_BYTE_ORDER_MARK) {
+        cerr << "The model file is not in the mappable format of this platform." << endl;
+        exit(1);
+    }
+    if (header.version != MODEL_IMAGE_VERSION) {
+        cerr << "Unsupported model file version: " << header.version << endl;
+        exit(1);
+    }
+    // the hash tables need an empty slot to end the probes
+    if (header.imageSize != imageSize ||
+        header.labelSetHashTableSize <= header.labelSetCount || (header.labelSetHashTableSize & (header.labelSetHashTableSize - 1)) != 0 ||
+        header.weightRowTableSize == 0 || (header.weightRowTableSize & (header.weightRowTableSize - 1)) != 0 ||
+        header.attrBucketCount == 0 || header.attrSlotCount == 0) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+
+    // Checks that a section lies within the image and returns its address.
+    auto section = [&](ModelImageSection s, size_t byteSize) {
+        uint64_t offset = header.sectionOffsetList[s];
+        if (offset % 8 != 0 || offset > imageSize || byteSize > imageSize - offset) {
+            cerr << "The model file is corrupted." << endl;
+            exit(1);
+        }
+        return image + offset;
+    };
+    labelSetHashTable = reinterpret_cast<const uint32_t *>(section(LABEL_SET_HASH_TABLE, sizeof(uint32_t) * header.labelSetHashTableSize));
+    labelSetStringOffsetList = reinterpret_cast<const uint32_t *>(section(LABEL_SET_STRING_OFFSETS, sizeof(uint32_t) * ((size_t)header.labelSetCount + 1)));
+    labelSetStringData = section(LABEL_SET_STRINGS, labelSetStringOffsetList[header.labelSetCount]);
+    labelSetLabelCountList = reinterpret_cast<const uint32_t *>(section(LABEL_SET_LABEL_COUNTS, sizeof(uint32_t) * header.labelSetCount));
+    attrDisplacementList = reinterpret_cast<const uint32_t *>(section(ATTRIBUTE_DISPLACEMENTS, sizeof(uint32_t) * header.attrBucketCount));
+    attrSlotList = reinterpret_cast<const uint32_t *>(section(ATTRIBUTE_SLOTS, sizeof(uint32_t) * header.attrSlotCount));
+    attrIdList = reinterpret_cast<const uint64_t *>(section(ATTRIBUTE_IDS, sizeof(uint64_t) * header.attrCount));
+    weightRowKeyList = reinterpret_cast<const uint64_t *>(section(WEIGHT_ROW_KEYS, sizeof(uint64_t) * header.weightRowTableSize));
+    weightRowOffsetList = reinterpret_cast<const uint32_t *>(section(WEIGHT_ROW_OFFSETS, sizeof(uint32_t) * header.weightRowTableSize));
+    weightRowList = reinterpret_cast<const double *>(section(WEIGHT_ROWS, sizeof(double) * header.weightRowListSize));
+
+    this->image = image;
+    this->imageSize = imageSize;
+    labelSetCount = header.labelSetCount;
+    labelSetHashTableMask = header.labelSetHashTableSize - 1;
+    attrCount = header.attrCount;
+    attrBucketCount = header.attrBucketCount;
+    attrSlotCount = header.attrSlotCount;
+    weightRowTableMask = header.weightRowTableSize - 1;
+    weightRowListSize = header.weightRowListSize;
+    validateImage();
+}
+
+// Checks the contents of the sections, so that the lookups never read out
+// of the image.
+void MaxEntData::validateImage() const {
+    bool valid = labelSetStringOffsetList[0] == 0;
+    for (uint32_t i = 0; valid && i < labelSetCount; ++i) {
+        uint32_t begin = labelSetStringOffsetList[i];
+        uint32_t end = labelSetStringOffsetList[i + 1];
+        // each label of a set is followed by ':' but the last
+        valid = begin <= end && labelSetLabelCountList[i] > 0 &&
+            labelSetLabelCountList[i] <= (size_t)count(labelSetStringData + begin, labelSetStringData + end, ':') + 1;
+    }
+    bool hasEmptySlot = false;
+    for (size_t i = 0; valid && i <= labelSetHashTableMask; ++i) {
+        hasEmptySlot |= labelSetHashTable[i] == INVALID_INDEX;
+        valid = labelSetHashTable[i] == INVALID_INDEX || labelSetHashTable[i] < labelSetCount;
+    }
+    valid = valid && hasEmptySlot;
+    for (size_t i = 0; valid && i < attrSlotCount; ++i) {
+        valid = attrSlotList[i] == INVALID_INDEX || attrSlotList[i] < attrCount;
+    }
+    hasEmptySlot = false;
+    for (size_t i = 0; valid && i <= weightRowTableMask; ++i) {
+        uint64_t key = weightRowKeyList[i];
+        if (key == EMPTY_WEIGHT_ROW_KEY) {
+            hasEmptySlot = true;
+            continue;
+        }
+        uint32_t labelSetIndex = (uint32_t)(key >> 32);
+        valid = labelSetIndex < labelSetCount && (uint32_t)key < attrCount &&
+            weightRowOffsetList[i] <= weightRowListSize &&
+            labelSetLabelCountList[labelSetIndex] <= weightRowListSize - weightRowOffsetList[i];
+    }
+    if (!valid || !hasEmptySlot) {
+        cerr << "The model file is corrupted." << endl;
+        exit(1);
+    }
+}
+
+uint32_t MaxEntData::findLabelSet(const set<string> &labelSet) const {
+    size_t slot = hashLabelSet(labelSet) & labelSetHashTableMask;
+    for (size_t i = 0; i <= labelSetHashTableMask; ++i) {
+        uint32_t index = labelSetHashTable[slot];
+        if (index == INVALID_INDEX) {
+            return INVALID_INDEX;
+        }
+        uint32_t begin = labelSetStringOffsetList[index];
+        if (matchLabelSet(labelSetStringData + begin, labelSetStringOffsetList[index + 1] - begin, labelSet)) {
+            return index;
+        }
+        slot = (slot + 1) & labelSetHashTableMask;
+    }
+    return INVALID_INDEX;
+}
+
+uint32_t MaxEntData::findAttribute(uint64_t attributeId) const {
+    uint32_t displacement = attrDisplacementList[getAttrBucket(attributeId, attrBucketCount)];
+    uint32_t index = attrSlotList[getAttrSlot(attributeId, displacement, attrSlotCount)];
+    if (index == INVALID_INDEX || attrIdList[index] != attributeId) {
+        return INVALID_INDEX;
+    }
+    return index;
+}
+
+const double *MaxEntData::findWeightRow(uint32_t labelSetIndex, uint32_t attrIndex) const {
+    uint64_t key = ((uint64_t)labelSetIndex << 32) | attrIndex;
+    size_t slot = mixHash(key) & weightRowTableMask;
+    for (size_t i = 0; i <= weightRowTableMask; ++i) {
+        uint64_t k = weightRowKeyList[slot];
+        if (k == key) {
+            return weightRowList + weightRowOffsetList[slot];
+        }
+        if (k == EMPTY_WEIGHT_ROW_KEY) {
+            return nullptr;
+        }
+        slot = (slot + 1) & weightRowTableMask;
+    }
+    return nullptr;
+}
+
+size_t MaxEntData::inferLabel(const vector<uint64_t> &attributeIdList, const set<string> &possibleLabelSet) const {
+    uint32_t labelSetIndex = findLabelSet(possibleLabelSet);
+    if (labelSetIndex == INVALID_INDEX) {
+        return 0;
+    }
+    size_t labelCount = labelSetLabelCountList[labelSetIndex];
+    // only a corrupted model has more labels than the set it has matched
+    if (labelCount > possibleLabelSet.size()) {
+        return 0;
+    }
+    static thread_local vector<double> scoreList;
+    scoreList.assign(labelCount, 0.0);
+    for (uint64_t attributeId : attributeIdList) {
+        uint32_t attrIndex = findAttribute(attributeId);
+        if (attrIndex == INVALID_INDEX) {
+            continue;
+        }
+        const double *weightRow = findWeightRow(labelSetIndex, attrIndex);
+        if (!weightRow) {
+            continue;
+        }
+        for (size_t i = 0; i < labelCount; ++i) {
+            scoreList[i] += weightRow[i];
+        }
+    }
+    size_t bestLabel = 0;
+    for (size_t i = 1; i < labelCount; ++i) {
+        if (scoreList[i] > scoreList[bestLabel]) {
+            bestLabel = i;
+        }
+    }
+    return bestLabel;
 }
 
 void MaxEntData::write(const string &filename) const {
+    // checked before the file is opened, which would truncate it
+    if (mappedFile) {
+        cerr << "A model in the mappable format cannot be written in the training format." << endl;
+        exit(1);
+    }
     ofstream out(filename, ios::out | ios::binary);
+    if (!out.is_open()) {
+        cerr << "Cannot write to file: " << filename << endl;
+        exit(1);
+    }
+    out.write(MODEL_ID_FORMAT_MAGIC, sizeof(MODEL_ID_FORMAT_MAGIC));
 
     {
         vector<string> v(labelToIndexMap.size());
-
         for (const auto &e : labelToIndexMap) {
             v[e.second] = e.first;
         }
-    
         writeNumber<uint32_t>(&out, v.size());
         for (uint32_t i = 0; i < v.size(); ++i) {
             writeString(&out, v[i]);
@@ -228,26 +825,21 @@ void MaxEntData::write(const string &filename) const {
     }
 
     {
-        vector<string> v(attrToIndexMap.size());
-
+        vector<uint64_t> v(attrToIndexMap.size());
         for (const auto &e : attrToIndexMap) {
             v[e.second] = e.first;
         }
-    
         writeNumber<uint32_t>(&out, (uint32_t)v.size());
         for (uint32_t i = 0; i < v.size(); ++i) {
-            writeString(&out, v[i]);
+            writeNumber<uint64_t>(&out, v[i]);
         }
     }
 
     {
         vector<pair<uint32_t, uint32_t>> v(indexPairToFeatureIndexMap.size());
-
         for (const auto &e : indexPairToFeatureIndexMap) {
             v[e.second] = e.first;
         }
-    
-        assert(bestWeightList.size() == bestWeightList.size());
         writeNumber<uint32_t>(&out, (uint32_t)v.size());
         for (uint32_t i = 0; i < v.size(); ++i) {
             writeNumber<uint32_t>(&out, v[i].first);
@@ -257,12 +849,29 @@ void MaxEntData::write(const string &filename) const {
 
     {
         for (uint32_t i = 0; i < bestWeightList.size(); ++i) {
-            double expectation = bestWeightList[i];
-            writeNumber<uint64_t>(&out, *((uint64_t*)(&expectation)));  // assuming that the size of double is 64 bits
+            double weight = bestWeightList[i];
+            writeNumber<uint64_t>(&out, *((uint64_t*)(&weight)));  // assuming that the size of double is 64 bits
         }
     }
-    
+
     out.close();
 }
 
+// Writes to a temporary file first and renames it, since the image may be
+// mapped from the file being replaced.
+void MaxEntData::writeMapped(const string &filename) const {
+    string tempFilename = filename + ".tmp";
+    ofstream out(tempFilename, ios::out | ios::binary);
+    if (!out.is_open()) {
+        cerr << "Cannot write to file: " << tempFilename << endl;
+        exit(1);
+    }
+    out.write(image, imageSize);
+    out.close();
+    if (!out || std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        cerr << "Cannot write to file: " << filename << endl;
+        exit(1);
+    }
+}
+
 }  // namespace MaxEnt
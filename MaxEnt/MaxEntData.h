@@ -3,6 +3,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -20,29 +21,88 @@ namespace std {
 }
 #endif  // UINT_PAIR_KEY
 
+namespace Utility {
+class MappedFile;
+}
+
 namespace MaxEnt {
 
+// Besides the maps used in training, the model holds an inference index: a
+// hash table of the label sets, a perfect hash of the attributes, and a hash
+// table that maps a pair of a label set and an attribute to a row of
+// weights, one for each label of the set. The index is a flat image whose
+// layout is identical to that of the memory-mappable model file. A model
+// read from that format has the index only, so it can be used for inference
+// but not trimmed or written in the training format.
+//
+// Attributes are identified by 64-bit IDs, the FNV-1a hashes of their
+// strings, so that callers can build the IDs from the parts of the strings
+// without concatenating them. Attributes whose IDs collide are merged. The
+// chance is negligible for a 64-bit hash, and training reports it.
 class MaxEntData
 {
 public:
     MaxEntData();
     MaxEntData(std::unordered_map<std::string, uint32_t> labelToIndexMap,
-               std::unordered_map<std::string, uint32_t> attrToIndexMap,
+               std::unordered_map<uint64_t, uint32_t> attrToIndexMap,
                std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t> indexPairToFeatureIndexMap,
                std::vector<double> bestWeightList);
     void read(const std::string &filename);
     void trim();
+    // Writes the training format, which holds the maps with the attribute
+    // IDs, so the model can be read back, trimmed and converted. Legacy
+    // models, which hold the attribute strings, can still be read.
     void write(const std::string &filename) const;
+    void writeMapped(const std::string &filename) const;
     const std::vector<double> &getBestWeightList() const;
     std::unordered_map<std::string, uint32_t> &getLabelToIndexMap();
-    std::unordered_map<std::string, uint32_t> &getAttrToIndexMap();
+    std::unordered_map<uint64_t, uint32_t> &getAttrToIndexMap();
     std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t> &getIndexPairToFeatureIndexMap();
+    // Returns the position in possibleLabelSet of the label with the highest
+    // score, or 0 if the label set is not in the model. It does not allocate
+    // memory.
+    size_t inferLabel(const std::vector<uint64_t> &attributeIdList, const std::set<std::string> &possibleLabelSet) const;
+    static uint64_t getAttributeId(const char *str, size_t length);
+    // Returns the ID of the attribute whose string is that of attributeId
+    // followed by str.
+    static uint64_t extendAttributeId(uint64_t attributeId, const char *str, size_t length);
     
 private:
+    MaxEntData(const MaxEntData &) = delete;
+    MaxEntData &operator=(const MaxEntData &) = delete;
+    void buildInferenceIndex();
+    void setImage(const char *image, size_t imageSize);
+    void validateImage() const;
+    uint32_t findLabelSet(const std::set<std::string> &labelSet) const;
+    uint32_t findAttribute(uint64_t attributeId) const;
+    const double *findWeightRow(uint32_t labelSetIndex, uint32_t attrIndex) const;
+
     std::unordered_map<std::string, uint32_t> labelToIndexMap;
-    std::unordered_map<std::string, uint32_t> attrToIndexMap;
+    std::unordered_map<uint64_t, uint32_t> attrToIndexMap;
     std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t> indexPairToFeatureIndexMap;
     std::vector<double> bestWeightList;
+
+    std::vector<char> imageBuffer;
+    std::shared_ptr<Utility::MappedFile> mappedFile;
+    const char *image;
+    size_t imageSize;
+    uint32_t labelSetCount;
+    size_t labelSetHashTableMask;
+    const uint32_t *labelSetHashTable;
+    const uint32_t *labelSetStringOffsetList;
+    const char *labelSetStringData;
+    const uint32_t *labelSetLabelCountList;
+    uint32_t attrCount;
+    uint32_t attrBucketCount;
+    uint32_t attrSlotCount;
+    const uint32_t *attrDisplacementList;
+    const uint32_t *attrSlotList;
+    const uint64_t *attrIdList;
+    size_t weightRowTableMask;
+    const uint64_t *weightRowKeyList;
+    const uint32_t *weightRowOffsetList;
+    const double *weightRowList;
+    uint64_t weightRowListSize;
 };
 
 }  // namespace MaxEnt
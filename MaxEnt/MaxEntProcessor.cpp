@@ -1,55 +1,194 @@
 #include "MaxEntProcessor.h"
 
 #include "../Optimizer/OptimizerClass.h"
-#include "../task/task_queue.hpp"
+#include "../Optimizer/StochasticOptimizer.h"
+#include "../Optimizer/WorkerPool.h"
 #include "CompiledData.h"
 #include "MaxEntData.h"
 #include "Observation.h"
 
 #include <cmath>
 #include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
 #include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
-using std::future;
+using std::cerr;
+using std::endl;
+using std::exit;
 using std::make_shared;
 using std::move;
+using std::next;
 using std::pair;
-using std::shared_ptr;
+using std::set;
 using std::string;
 using std::unordered_map;
 using std::vector;
 
 namespace MaxEnt {
 
-double maxEntUpdateProc(void *updateData, const double *x, double *g, int n, size_t concurrency) {
-    
-    auto compiledDataList = static_cast<shared_ptr<vector<shared_ptr<CompiledData>>> *>(updateData);
-    hwm::task_queue tq(concurrency);
-    vector<future<double>> futureList;
+// The number of epochs of stochastic optimization unless maxIters is given.
+const size_t DEFAULT_EPOCH_COUNT = 10;
+
+struct MaxEntUpdateData {
+    const CompiledData *compiledData;
+    vector<vector<size_t>> chunkList;
+    size_t chunkCount;
+    vector<vector<double>> gradientBufferList;
+    // the features of the observations selected by maxEntSelectProc, or null
+    // if all the observations are selected. Only these are read and written.
+    const vector<uint32_t> *featureIndexList;
+    // set on each evaluation
+    const double *expWeights;
+    int featureCount;
+    vector<double> chunkLogLikelihoodList;
+};
 
-    for (auto &data : **compiledDataList) {
-        future<double> f = tq.enqueue([](shared_ptr<CompiledData> pat, const double* expWeightArray, double* expectationArray) -> double {
-                return pat->accumulateFeatureExpectations(expWeightArray, expectationArray);
-            },
-            data,
-            x,
-            g);
-        futureList.emplace_back(move(f));
+// Accumulates the expectations of a chunk into a buffer of its own, so that
+// the threads share no memory they write to. There is one buffer per chunk
+// rather than per thread, so the result does not depend on which thread has
+// run which chunk.
+void accumulateChunk(void *updateData, size_t chunkIndex) {
+    auto data = static_cast<MaxEntUpdateData *>(updateData);
+    double *gradientBuffer = data->gradientBufferList[chunkIndex].data();
+    double logLikelihood = 0.0;
+    for (size_t i : data->chunkList[chunkIndex]) {
+        logLikelihood += data->compiledData->accumulateFeatureExpectations(i, data->expWeights, gradientBuffer);
     }
-    tq.wait();
+    data->chunkLogLikelihoodList[chunkIndex] = logLikelihood;
+}
 
+void clearGradientBuffer(void *updateData, size_t bufferIndex) {
+    auto data = static_cast<MaxEntUpdateData *>(updateData);
+    auto &gradientBuffer = data->gradientBufferList[bufferIndex];
+    if (data->featureIndexList && gradientBuffer.size() == (size_t)data->featureCount) {
+        for (auto i : *data->featureIndexList) {
+            gradientBuffer[i] = 0.0;
+        }
+    }
+    else {
+        gradientBuffer.assign(data->featureCount, 0.0);
+    }
+}
+
+// Adds up the features in the slice of all the buffers into the first
+// buffer by pairwise (tree) reduction.
+void reduceGradientBuffers(void *updateData, size_t slice) {
+    auto data = static_cast<MaxEntUpdateData *>(updateData);
+    auto &gradientBufferList = data->gradientBufferList;
+    const auto *featureIndexList = data->featureIndexList;
+    size_t bufferCount = gradientBufferList.size();
+    size_t size = featureIndexList ? featureIndexList->size() : data->featureCount;
+    size_t begin = size * slice / bufferCount;
+    size_t end = size * (slice + 1) / bufferCount;
+    for (size_t step = 1; step < bufferCount; step *= 2) {
+        for (size_t b = 0; b + step < bufferCount; b += step * 2) {
+            double *dest = gradientBufferList[b].data();
+            const double *src = gradientBufferList[b + step].data();
+            if (featureIndexList) {
+                for (size_t j = begin; j < end; ++j) {
+                    uint32_t i = (*featureIndexList)[j];
+                    dest[i] += src[i];
+                }
+            }
+            else {
+                for (size_t i = begin; i < end; ++i) {
+                    dest[i] += src[i];
+                }
+            }
+        }
+    }
+}
+
+double maxEntUpdateProc(void *updateData, const double *x, double *g, int n, Optimizer::WorkerPool *pool) {
+    auto data = static_cast<MaxEntUpdateData *>(updateData);
+    size_t chunkCount = data->chunkList.size();
+    if (chunkCount == 0) {
+        return 0.0;
+    }
+    data->expWeights = x;
+    data->featureCount = n;
+    // the buffers are kept between the calls, so that a call on a few
+    // observations only clears and adds up the features of the observations
+    data->gradientBufferList.resize(chunkCount);
+    pool->run(chunkCount, &clearGradientBuffer, data);
+    data->chunkLogLikelihoodList.assign(chunkCount, 0.0);
+    pool->run(chunkCount, &accumulateChunk, data);
+    pool->run(chunkCount, &reduceGradientBuffers, data);
+
+    const auto &gradient = data->gradientBufferList[0];
+    if (data->featureIndexList) {
+        for (auto i : *data->featureIndexList) {
+            g[i] += gradient[i];
+        }
+    }
+    else {
+        for (int i = 0; i < n; ++i) {
+            g[i] += gradient[i];
+        }
+    }
     double logLikelihood = 0.0;
-    for (auto &f : futureList) {
-        logLikelihood += f.get();
+    for (double d : data->chunkLogLikelihoodList) {
+        logLikelihood += d;
     }
     return logLikelihood;
 }
 
-MaxEntProcessor::MaxEntProcessor() : modelData(new MaxEntData) {}
+vector<vector<size_t>> makeChunks(const CompiledData &compiledData, const size_t *itemList, size_t itemCount, size_t chunkCount) {
+    vector<size_t> costList;
+    costList.reserve(itemCount);
+    for (size_t i = 0; i < itemCount; ++i) {
+        costList.emplace_back(compiledData.getFeatureCount(itemList ? itemList[i] : i));
+    }
+    auto chunkList = Optimizer::WorkerPool::makeBalancedChunks(costList, chunkCount);
+    if (itemList) {
+        for (auto &chunk : chunkList) {
+            for (auto &i : chunk) {
+                i = itemList[i];
+            }
+        }
+    }
+    return chunkList;
+}
+
+// Restricts the data that maxEntUpdateProc runs on to the items, adds their
+// feature counts and appends their features to featureIndexList, or lifts
+// the restriction if itemList is null. maxEntUpdateProc only updates the
+// features in featureIndexList, which must be kept until the next call.
+void maxEntSelectProc(void *updateData, const size_t *itemList, size_t itemCount, double *featureCounts, vector<uint32_t> *featureIndexList) {
+    auto data = static_cast<MaxEntUpdateData *>(updateData);
+    const auto &compiledData = *data->compiledData;
+    if (!itemList) {
+        data->chunkList = makeChunks(compiledData, nullptr, compiledData.size(), data->chunkCount);
+        data->featureIndexList = nullptr;
+        return;
+    }
+    for (size_t i = 0; i < itemCount; ++i) {
+        compiledData.accumulateFeatureCounts(itemList[i], featureCounts);
+        compiledData.appendFeatureIndexes(itemList[i], featureIndexList);
+    }
+    data->featureIndexList = featureIndexList;
+    data->chunkList = makeChunks(compiledData, itemList, itemCount, data->chunkCount);
+}
+
+MaxEntProcessor::MaxEntProcessor() : modelData(new MaxEntData), batchSize(0), learningRate(0.0), checkpointInterval(0), resume(false) {}
+
+void MaxEntProcessor::setStochasticOptimization(size_t batchSize, double learningRate) {
+    this->batchSize = batchSize;
+    this->learningRate = learningRate;
+}
+
+void MaxEntProcessor::setCheckpoint(const string &checkpointFilename, size_t checkpointInterval, bool resume) {
+    this->checkpointFilename = checkpointFilename;
+    this->checkpointInterval = checkpointInterval;
+    this->resume = resume;
+}
 
 void MaxEntProcessor::train(const vector<Observation> &observationList,
                             size_t concurrency,
@@ -58,30 +197,52 @@ void MaxEntProcessor::train(const vector<Observation> &observationList,
                             double regularizationCoefficientL2,
                             double epsilonForConvergence) {
 
-    auto compiledDataList = make_shared<vector<shared_ptr<CompiledData>>>();
+    CompiledData compiledData;
     unordered_map<string, uint32_t> labelToIndexMap;
-    unordered_map<string, uint32_t> attrToIndexMap;
+    unordered_map<uint64_t, uint32_t> attrToIndexMap;
     unordered_map<pair<uint32_t, uint32_t>, uint32_t> indexPairToFeatureIndexMap;
-    compiledDataList->reserve(observationList.size());
         
     for (auto &obs : observationList) {
-        compiledDataList->emplace_back(obs.compile(&labelToIndexMap, &attrToIndexMap, &indexPairToFeatureIndexMap, true));
+        obs.compile(&labelToIndexMap, &attrToIndexMap, &indexPairToFeatureIndexMap, true, &compiledData);
     }
+    compiledData.shrinkToFit();
     vector<double> featureCountList(indexPairToFeatureIndexMap.size());
-    for (auto &data : (*compiledDataList)) {
-        data->accumulateFeatureCounts(featureCountList.data());
+    for (size_t i = 0; i < compiledData.size(); ++i) {
+        compiledData.accumulateFeatureCounts(i, featureCountList.data());
     }
         
-    auto optimizer = make_shared<Optimizer::OptimizerClass>(maxEntUpdateProc, static_cast<void *>(&compiledDataList), move(featureCountList), concurrency, maxIters, regularizationCoefficientL1, regularizationCoefficientL2, epsilonForConvergence);
+    MaxEntUpdateData updateData;
+    updateData.compiledData = &compiledData;
+    // one chunk per thread, since each chunk has a gradient buffer of its own
+    updateData.chunkCount = concurrency;
+    updateData.chunkList = makeChunks(compiledData, nullptr, compiledData.size(), updateData.chunkCount);
+    updateData.featureIndexList = nullptr;
+
     vector<double> initialWeightList(featureCountList.size());
-    optimizer->optimize(initialWeightList.data());
-    auto bestWeightList = optimizer->getBestWeightList();
+    vector<double> bestWeightList;
+    if (batchSize > 0) {
+        if (!checkpointFilename.empty()) {
+            cerr << "Checkpoints cannot be used with stochastic optimization." << endl;
+            exit(1);
+        }
+        auto optimizer = make_shared<Optimizer::StochasticOptimizer>(maxEntUpdateProc, maxEntSelectProc, static_cast<void *>(&updateData), compiledData.size(), featureCountList.size(), concurrency, maxIters > 0 ? maxIters : DEFAULT_EPOCH_COUNT, batchSize, learningRate, regularizationCoefficientL1, regularizationCoefficientL2);
+        optimizer->optimize(initialWeightList.data());
+        bestWeightList = optimizer->getWeightList();
+    }
+    else {
+        auto optimizer = make_shared<Optimizer::OptimizerClass>(maxEntUpdateProc, static_cast<void *>(&updateData), move(featureCountList), concurrency, maxIters, regularizationCoefficientL1, regularizationCoefficientL2, epsilonForConvergence);
+        if (!checkpointFilename.empty()) {
+            optimizer->setCheckpoint(checkpointFilename, checkpointInterval, resume);
+        }
+        optimizer->optimize(initialWeightList.data());
+        bestWeightList = optimizer->getBestWeightList();
+    }
         
     modelData = make_shared<MaxEntData>(move(labelToIndexMap), move(attrToIndexMap), move(indexPairToFeatureIndexMap), move(bestWeightList));
 }
 
-string MaxEntProcessor::inferLabel(const Observation &obs) const {
-    return obs.compile(&modelData->getLabelToIndexMap(), &modelData->getAttrToIndexMap(), &modelData->getIndexPairToFeatureIndexMap(), false)->inferLabel(modelData->getBestWeightList().data());
+const string &MaxEntProcessor::inferLabel(const vector<uint64_t> &attributeIdList, const set<string> &possibleLabelSet) const {
+    return *next(possibleLabelSet.begin(), modelData->inferLabel(attributeIdList, possibleLabelSet));
 }
 
 void MaxEntProcessor::writeModel(const string &filename) {
@@ -89,6 +250,11 @@ void MaxEntProcessor::writeModel(const string &filename) {
     modelData->write(filename);
 }
 
+void MaxEntProcessor::writeMappedModel(const string &filename) {
+    modelData->trim();
+    modelData->writeMapped(filename);
+}
+
 void MaxEntProcessor::readModel(const string &filename) {
     modelData->read(filename);
 }        
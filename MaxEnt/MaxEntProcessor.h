@@ -7,6 +7,8 @@
 #include "MaxEntData.h"
 #include "Observation.h"
 
+#include <cstdint>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -24,16 +26,30 @@ class MaxEntProcessor
                double regularizationCoefficientL1,
                double regularizationCoefficientL2,
                double epsilonForConvergence);
+    // Trains the model by mini-batch SGD instead of L-BFGS, with maxIters as
+    // the number of epochs. batchSize 0 (the default) selects L-BFGS.
+    void setStochasticOptimization(size_t batchSize, double learningRate);
+    // Writes the state of L-BFGS to the checkpoint file every interval
+    // iterations, and continues from the state in it if resume is true.
+    void setCheckpoint(const std::string &checkpointFilename, size_t checkpointInterval, bool resume);
 
-    std::string inferLabel(const Observation &obs) const;
+    // Returns the label in possibleLabelSet with the highest score. The
+    // attribute IDs must have no duplicates.
+    const std::string &inferLabel(const std::vector<uint64_t> &attributeIdList, const std::set<std::string> &possibleLabelSet) const;
 
     void writeModel(const std::string &filename);
+    void writeMappedModel(const std::string &filename);
     void readModel(const std::string &filename);
 
  private:
     std::shared_ptr<MaxEntData> modelData;
     std::shared_ptr<std::vector<double>> expWeightList;
     std::shared_ptr<std::vector<std::string>> labelStringList;
+    size_t batchSize;
+    double learningRate;
+    std::string checkpointFilename;
+    size_t checkpointInterval;
+    bool resume;
 };
 
 } // namespace MaxEnt
@@ -1,35 +1,37 @@
 #include "CompiledData.h"
 #include "Observation.h"
 
+#include <algorithm>
 #include <cmath>
-#include <memory>
 #include <ostream>
 #include <set>
 #include <sstream>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace MaxEnt {
 
+using std::dec;
 using std::endl;
+using std::hex;
 using std::make_pair;
-using std::make_shared;
 using std::move;
 using std::ostream;
 using std::pair;
 using std::set;
-using std::shared_ptr;
+using std::sort;
 using std::stringstream;
 using std::string;
 using std::unordered_map;
-using std::unordered_set;
+using std::unique;
 using std::vector;
 
-Observation::Observation(unordered_set<string> attributeSet, string correctLabel, set<string> possibleLabelSet) {
-    this->attributeSet = attributeSet;
+Observation::Observation(vector<uint64_t> attributeIdList, string correctLabel, set<string> possibleLabelSet) {
+    sort(attributeIdList.begin(), attributeIdList.end());
+    attributeIdList.erase(unique(attributeIdList.begin(), attributeIdList.end()), attributeIdList.end());
+    this->attributeIdList = move(attributeIdList);
     this->correctLabel = correctLabel;
     this->possibleLabelSet = possibleLabelSet;
 }
@@ -41,18 +43,15 @@ void Observation::output(ostream &os) {
     }
     os << endl;
     os << "correct label: " << correctLabel << endl;
-    os << "attributes:";
-    for (auto attr : attributeSet) {
-        os << " " << attr;
+    os << "attributes:" << hex;
+    for (auto attributeId : attributeIdList) {
+        os << " " << attributeId;
     }
-    os << endl << endl;
+    os << dec << endl << endl;
 }
 
-shared_ptr<CompiledData> Observation::compile(unordered_map<string, uint32_t> *labelToIndexMap, unordered_map<string, uint32_t> *attrToIndexMap, unordered_map<pair<uint32_t, uint32_t>, uint32_t> *indexPairToFeatureIndexMap, bool extendMaps) const {
-    vector<vector<uint32_t>> featureIndexListList;
-    vector<string> labelStringList;
-    
-    uint32_t index = 0;
+void Observation::compile(unordered_map<string, uint32_t> *labelToIndexMap, unordered_map<uint64_t, uint32_t> *attrToIndexMap, unordered_map<pair<uint32_t, uint32_t>, uint32_t> *indexPairToFeatureIndexMap, bool extendMaps, CompiledData *compiledData) const {
+    size_t index = 0;
     size_t correctLabelIndex = 0;
     stringstream ss;
 
@@ -65,11 +64,8 @@ shared_ptr<CompiledData> Observation::compile(unordered_map<string, uint32_t> *l
         isFirst = false;
     }
     string setStr = ss.str();
+    vector<uint32_t> v;
     for (const auto &label : possibleLabelSet) {
-        if (!correctLabel.empty() && label == correctLabel) {
-            correctLabelIndex = index;
-        }
-        vector<uint32_t> v;
         string labelAndLabelSetStr = label + "/" + setStr;
         auto itLabel = labelToIndexMap->find(labelAndLabelSetStr);
         if (itLabel == labelToIndexMap->end()) {
@@ -78,14 +74,17 @@ shared_ptr<CompiledData> Observation::compile(unordered_map<string, uint32_t> *l
             }
             itLabel = labelToIndexMap->insert(make_pair(labelAndLabelSetStr, labelToIndexMap->size())).first;
         }
-        labelStringList.emplace_back(label);
-        for (const auto &attr : attributeSet) {
-            auto itAttr = attrToIndexMap->find(attr);
+        if (!correctLabel.empty() && label == correctLabel) {
+            correctLabelIndex = index;
+        }
+        v.clear();
+        for (uint64_t attributeId : attributeIdList) {
+            auto itAttr = attrToIndexMap->find(attributeId);
             if (itAttr == attrToIndexMap->end()) {
                 if (!extendMaps) {
                     continue;
                 }
-                itAttr = attrToIndexMap->insert(make_pair(attr, attrToIndexMap->size())).first;
+                itAttr = attrToIndexMap->insert(make_pair(attributeId, attrToIndexMap->size())).first;
             }
             auto indexPair = make_pair(itLabel->second, itAttr->second);
             auto itIndexPair = indexPairToFeatureIndexMap->find(indexPair);
@@ -97,14 +96,13 @@ shared_ptr<CompiledData> Observation::compile(unordered_map<string, uint32_t> *l
             }
             v.emplace_back(itIndexPair->second);
         }
-        featureIndexListList.emplace_back(move(v));
+        compiledData->addLabel(v.data(), v.size());
         ++index;
     }
-    if (labelStringList.empty()) {
-        labelStringList.emplace_back(*(possibleLabelSet.begin()));
-        featureIndexListList.emplace_back(vector<uint32_t>());
+    if (index == 0) {
+        compiledData->addLabel(nullptr, 0);
     }
-    return make_shared<CompiledData>(move(featureIndexListList), move(labelStringList), correctLabelIndex);
+    compiledData->finishObservation(correctLabelIndex);
 }
 
 }  // namespace MaxEnt
@@ -2,12 +2,11 @@
 #define HOCRF_MAX_ENT_OBSERVATION_H_
 
 #include <cstdint>
-#include <memory>
 #include <ostream>
 #include <set>
 #include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 #ifndef UINT_PAIR_KEY
 #define UINT_PAIR_KEY
@@ -30,15 +29,20 @@ class CompiledData;
 class Observation
 {
 public:
-    Observation(std::unordered_set<std::string> attributeSet, std::string correctLabel, std::set<std::string> possibleLabelSet);
-    std::shared_ptr<CompiledData> compile(std::unordered_map<std::string, uint32_t> *labelToIndexMap,
-                                     std::unordered_map<std::string, uint32_t> *attrToIndexMap,
-                                     std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t> *indexPairToFeatureIndexMap,
-                                     bool extendMap) const;
+    // The attributes are given by their IDs (see MaxEntData::getAttributeId).
+    // Duplicate IDs are removed.
+    Observation(std::vector<uint64_t> attributeIdList, std::string correctLabel, std::set<std::string> possibleLabelSet);
+    // Appends the observation to compiledData. The label IDs are the
+    // positions in the possible label set.
+    void compile(std::unordered_map<std::string, uint32_t> *labelToIndexMap,
+                 std::unordered_map<uint64_t, uint32_t> *attrToIndexMap,
+                 std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t> *indexPairToFeatureIndexMap,
+                 bool extendMap,
+                 CompiledData *compiledData) const;
     void output(std::ostream &os);
     
 private:
-    std::unordered_set<std::string> attributeSet;
+    std::vector<uint64_t> attributeIdList;
     std::string correctLabel;
     std::set<std::string> possibleLabelSet;
 };
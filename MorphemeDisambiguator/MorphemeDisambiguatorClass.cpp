@@ -1,6 +1,7 @@
 #include "MorphemeDisambiguatorClass.h"
 
 #include "../Dictionary/DictionaryClass.h"
+#include "../MaxEnt/MaxEntData.h"
 #include "../MaxEnt/MaxEntProcessor.h"
 #include "../Utility/FileUtil.h"
 #include "../Utility/StringUtil.h"
@@ -9,14 +10,17 @@
 #include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <ostream>
 #include <set>
-#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -24,18 +28,26 @@
 namespace MorphemeDisambiguator {
 
 using Dictionary::DictionaryClass;
+using MaxEnt::MaxEntData;
 using MaxEnt::MaxEntProcessor;
 using MaxEnt::Observation;
 
 using std::back_inserter;
+using std::cerr;
+using std::endl;
 using std::equal;
+using std::exit;
 using std::ifstream;
+using std::make_pair;
 using std::make_shared;
 using std::move;
+using std::pair;
 using std::set;
-using std::showpos;
+using std::sort;
 using std::string;
-using std::stringstream;
+using std::to_string;
+using std::unique;
+using std::unordered_map;
 using std::unordered_set;
 using std::vector;
 
@@ -58,7 +70,75 @@ vector<vector<vector<string>>> lookupSentence(const vector<string> &sentence, co
     return ret;
 }
 
-vector<unordered_set<string>> convertSentenceToCommonAttributeSetList(const vector<string> &sentence, const vector<vector<vector<string>>> &dictResultListList, const MorphemeDisambiguatorOptions &opt) {
+// Keeps the string of every attribute ID made in training, so that two
+// attributes whose IDs collide are reported instead of being merged.
+class AttributeIdChecker {
+public:
+    void check(uint64_t attributeId, const string &attributeString) {
+        auto result = attributeStringMap.insert(make_pair(attributeId, attributeString));
+        if (result.first->second != attributeString) {
+            cerr << "The IDs of two attributes collide: " << result.first->second << " " << attributeString << endl;
+            exit(1);
+        }
+    }
+
+private:
+    unordered_map<uint64_t, string> attributeStringMap;
+};
+
+// Builds an attribute ID from the parts of the attribute string without
+// concatenating them (see MaxEntData::getAttributeId). The string itself is
+// only built when there is a checker.
+class AttributeIdBuilder {
+public:
+    AttributeIdBuilder(const char *str, AttributeIdChecker *checker) : checker(checker) {
+        size_t length = strlen(str);
+        attributeId = MaxEntData::getAttributeId(str, length);
+        if (checker) {
+            attributeString.assign(str, length);
+        }
+    }
+    AttributeIdBuilder &append(const char *str, size_t length) {
+        attributeId = MaxEntData::extendAttributeId(attributeId, str, length);
+        if (checker) {
+            attributeString.append(str, length);
+        }
+        return *this;
+    }
+    AttributeIdBuilder &append(const string &str) {
+        return append(str.data(), str.size());
+    }
+    AttributeIdBuilder &append(const char *str) {
+        return append(str, strlen(str));
+    }
+    // appends the decimal digits of the number
+    AttributeIdBuilder &append(long long number) {
+        char buf[24];
+        int length = snprintf(buf, sizeof(buf), "%lld", number);
+        return append(buf, length);
+    }
+    uint64_t getAttributeId() const {
+        if (checker) {
+            checker->check(attributeId, attributeString);
+        }
+        return attributeId;
+    }
+
+private:
+    AttributeIdChecker *checker;
+    uint64_t attributeId;
+    string attributeString;
+};
+
+bool equalsConcatenation(const string &str, const string &prefix, const string &suffix) {
+    return str.size() == prefix.size() + suffix.size() &&
+        str.compare(0, prefix.size(), prefix) == 0 &&
+        str.compare(prefix.size(), suffix.size(), suffix) == 0;
+}
+
+// Returns the IDs of the attributes of each position, sorted and without
+// duplicates.
+vector<vector<uint64_t>> convertSentenceToCommonAttributeIdList(const vector<string> &sentence, const vector<vector<vector<string>>> &dictResultListList, const MorphemeDisambiguatorOptions &opt, AttributeIdChecker *checker) {
     assert(sentence.size() == dictResultListList.size());
     vector<vector<string>> wordAndLabelList;
     
@@ -67,12 +147,14 @@ vector<unordered_set<string>> convertSentenceToCommonAttributeSetList(const vect
         wordAndLabelList.emplace_back(move(wordAndLabel));
     }
     
-    vector<unordered_set<string>> ret(sentence.size());
+    vector<vector<uint64_t>> ret(sentence.size());
+    // the separators and the words or labels joined into an attribute
+    vector<pair<const char *, const string *>> partList;
     for (size_t i = 0; i < sentence.size(); ++i) {
-        unordered_set<string> commonAttributeSet;
         if (dictResultListList[i].size() < 2) {
             continue;
         }
+        auto &attributeIdList = ret[i];
         
         for (int j = -(int)opt.columnMaxWindow; j <= (int)opt.columnMaxWindow; ++j) {
             int pos = i + j;
@@ -82,17 +164,15 @@ vector<unordered_set<string>> convertSentenceToCommonAttributeSetList(const vect
             if (dictResultListList[pos].empty()) {
                 continue;
             }
-            stringstream posPrefix;
-            posPrefix << "P" << showpos << j << "-";
             for (const auto &dictResult : dictResultListList[pos]) {
                 for (size_t k = 0; k < dictResult.size(); ++k) {
                     if (opt.featureColumnSet.find(k) == opt.featureColumnSet.end()) {
                         continue;
                     }
-                    stringstream fieldPrefix;
-                    fieldPrefix << "F" << k << ":";
-                    commonAttributeSet.insert(fieldPrefix.str() + dictResult[k]);
-//                    commonAttributeSet.insert(posPrefix.str() + fieldPrefix.str() + dictResult[k]);
+                    // "F<k>:<field>"
+                    AttributeIdBuilder builder("F", checker);
+                    builder.append((long long)k).append(":").append(dictResult[k]);
+                    attributeIdList.emplace_back(builder.getAttributeId());
                 }
             }
         }
@@ -100,9 +180,8 @@ vector<unordered_set<string>> convertSentenceToCommonAttributeSetList(const vect
         for (int wordOrLabel : {0, 1}) {
             for (int sign : { -1, +1 }) {
                 for (int startOffset : {0, 1}) {
-                    stringstream ss;
+                    partList.clear();
                     for (int j = startOffset; j <= (int)(wordOrLabel == 0 ? opt.wordMaxWindow : opt.labelMaxWindow); ++j) {
-                        int startPos = i + (sign * startOffset);
                         if (j == 0 && sign == -1) {
                             continue;
                         }
@@ -110,21 +189,26 @@ vector<unordered_set<string>> convertSentenceToCommonAttributeSetList(const vect
                         if (pos < 0 || pos >= (int)sentence.size()) {
                             continue;
                         }
-                        ss << (j == startOffset ? ":" : "-") << wordAndLabelList[pos][wordOrLabel];
-                        stringstream attr;
-                        attr << (wordOrLabel == 0 ? "W" : "L") << (sign == -1 ? "-" : "+") << startOffset << "-" << j << ss.str();
-                        commonAttributeSet.insert(attr.str());
+                        partList.emplace_back(j == startOffset ? ":" : "-", &wordAndLabelList[pos][wordOrLabel]);
+                        // "W+<startOffset>-<j>:<word>-<word>..." and the like
+                        AttributeIdBuilder builder(wordOrLabel == 0 ? "W" : "L", checker);
+                        builder.append(sign == -1 ? "-" : "+").append((long long)startOffset).append("-").append((long long)j);
+                        for (const auto &part : partList) {
+                            builder.append(part.first).append(*part.second);
+                        }
+                        attributeIdList.emplace_back(builder.getAttributeId());
                     }
                 }
             }
         }
-        ret[i] = move(commonAttributeSet);
+        sort(attributeIdList.begin(), attributeIdList.end());
+        attributeIdList.erase(unique(attributeIdList.begin(), attributeIdList.end()), attributeIdList.end());
     }
 
     return ret;
 }
 
-vector<Observation> generateTrainingObservationList(const vector<vector<string>> &dictResultList, const unordered_set<string>& commonAttributeSet, const vector<string> &correctResult) {
+vector<Observation> generateTrainingObservationList(const vector<vector<string>> &dictResultList, const vector<uint64_t> &commonAttributeIdList, const vector<string> &correctResult, AttributeIdChecker *checker) {
     vector<Observation> ret;
     if (dictResultList.size() < 2 || correctResult.empty()) {
         return ret;
@@ -134,7 +218,7 @@ vector<Observation> generateTrainingObservationList(const vector<vector<string>>
     for (size_t i = 0; i < dictResultList.size(); ++i) {
         survivors.insert(i);
     }
-    unordered_set<string> attributeSet(commonAttributeSet);
+    vector<uint64_t> attributeIdList(commonAttributeIdList);
     for (size_t i = 0; i < correctResult.size(); ++i) {
         unordered_set<size_t> nextSurvivors;
         for (size_t j : survivors) {
@@ -145,27 +229,24 @@ vector<Observation> generateTrainingObservationList(const vector<vector<string>>
         if (nextSurvivors.empty()) {
             break;
         }
-        stringstream ss;
-        ss << "E" << i << ":";
-        string prefix(ss.str());
+        string prefix = "E" + to_string(i) + ":";
         if (nextSurvivors.size() < survivors.size()) {
             set<string> possibleLabelSet;
             for (size_t j : survivors) {
-                stringstream ss;
                 possibleLabelSet.insert(prefix + dictResultList[j][i]);
             }
-            ret.emplace_back(attributeSet, prefix + correctResult[i], move(possibleLabelSet));
+            ret.emplace_back(attributeIdList, prefix + correctResult[i], move(possibleLabelSet));
             survivors = nextSurvivors;
             if (survivors.size() == 1) {
                 break;
             }
         }
-        attributeSet.insert(prefix + correctResult[i]);
+        attributeIdList.emplace_back(AttributeIdBuilder(prefix.c_str(), checker).append(correctResult[i]).getAttributeId());
     }
     return ret;
 }
 
-size_t inferCorrectResult(const vector<vector<string>> &dictResultList, const unordered_set<string> &commonAttributeSet, const MaxEntProcessor &maxEntProcessor) {
+size_t inferCorrectResult(const vector<vector<string>> &dictResultList, const vector<uint64_t> &commonAttributeIdList, const MaxEntProcessor &maxEntProcessor) {
     if (dictResultList.size() < 2) {
         return 0;
     }
@@ -173,21 +254,19 @@ size_t inferCorrectResult(const vector<vector<string>> &dictResultList, const un
     for (size_t i = 0; i < dictResultList.size(); ++i) {
         survivors.insert(i);
     }
-    unordered_set<string> attributeSet(commonAttributeSet);
+    static thread_local vector<uint64_t> attributeIdList;
+    attributeIdList.assign(commonAttributeIdList.begin(), commonAttributeIdList.end());
     for (size_t i = 0; i < dictResultList[0].size(); ++i) {
         set<string> possibleLabelSet;
-        stringstream ss;
-        ss << "E" << i << ":";
-        string prefix(ss.str());
+        string prefix = "E" + to_string(i) + ":";
         for (size_t j : survivors) {
             possibleLabelSet.insert(prefix + dictResultList[j][i]);
         }
         if (possibleLabelSet.size() > 1) {
-            const vector<string> &result = dictResultList[*(survivors.begin())];
-            string inferredLabel = maxEntProcessor.inferLabel(Observation(attributeSet, string(), move(possibleLabelSet)));
+            const string &inferredLabel = maxEntProcessor.inferLabel(attributeIdList, possibleLabelSet);
             unordered_set<size_t> nextSurvivors;
             for (size_t j : survivors) {
-                if (prefix + dictResultList[j][i] == inferredLabel) {
+                if (equalsConcatenation(inferredLabel, prefix, dictResultList[j][i])) {
                     nextSurvivors.insert(j);
                 }
             }
@@ -199,7 +278,9 @@ size_t inferCorrectResult(const vector<vector<string>> &dictResultList, const un
                 break;
             }
         }
-        attributeSet.insert(prefix + dictResultList[*(survivors.begin())][i]);
+        // the E attributes of different positions never coincide, so the
+        // list stays free of duplicates
+        attributeIdList.emplace_back(AttributeIdBuilder(prefix.c_str(), nullptr).append(dictResultList[*(survivors.begin())][i]).getAttributeId());
     }
     return *(survivors.begin());
 }
@@ -215,21 +296,30 @@ void splitSentenceAndResult(const vector<string> &input, vector<string> *sentenc
     }
 }
 
-MorphemeDisambiguatorClass::MorphemeDisambiguatorClass(const MorphemeDisambiguatorOptions &options) {
+MorphemeDisambiguatorClass::MorphemeDisambiguatorClass(const MorphemeDisambiguatorOptions &options) : checkpointInterval(0), resume(false) {
     this->options = options;
     assert(!options.dictionaries.empty());
     dictionary = make_shared<DictionaryClass>(options.dictionaries);
 };
 
+void MorphemeDisambiguatorClass::setCheckpoint(const string &checkpointFilename, size_t checkpointInterval, bool resume) {
+    this->checkpointFilename = checkpointFilename;
+    this->checkpointInterval = checkpointInterval;
+    this->resume = resume;
+}
+
 void MorphemeDisambiguatorClass::train(const string &trainingFilename,
                                        size_t concurrency,
                                        size_t maxIter,
                                        double regularizationCoefficientL1,
                                        double regularizationCoefficientL2,
                                        double epsilonForConvergence,
+                                       size_t batchSize,
+                                       double learningRate,
                                        const std::string &modelFilename) {
     ifstream ifs(trainingFilename);
     vector<Observation> observationList;
+    AttributeIdChecker checker;
 
     while (true) {
         vector<string> sequence = Utility::readSequence(ifs);
@@ -252,19 +342,25 @@ void MorphemeDisambiguatorClass::train(const string &trainingFilename,
         vector<vector<string>> correctResultList;
         splitSentenceAndResult(sequence, &sentence, &correctResultList);
         auto dictResultListList = lookupSentence(sentence, *dictionary);
-        auto commonAttributeSetList = convertSentenceToCommonAttributeSetList(sentence, dictResultListList, options);
+        auto commonAttributeIdList = convertSentenceToCommonAttributeIdList(sentence, dictResultListList, options, &checker);
         assert(sentence.size() == dictResultListList.size() &&
-               sentence.size() == commonAttributeSetList.size());
+               sentence.size() == commonAttributeIdList.size());
         for (size_t i = 0; i < sentence.size(); ++i) {
             if (!has_flags || flags[i]) {
-                auto o = generateTrainingObservationList(dictResultListList[i], commonAttributeSetList[i], correctResultList[i]);
+                auto o = generateTrainingObservationList(dictResultListList[i], commonAttributeIdList[i], correctResultList[i], &checker);
                 move(o.begin(), o.end(), back_inserter(observationList));
             }
         }
     }
     ifs.close();
+    // the strings are not needed in the optimization
+    checker = AttributeIdChecker();
 
     MaxEntProcessor maxent;
+    maxent.setStochasticOptimization(batchSize, learningRate);
+    if (!checkpointFilename.empty()) {
+        maxent.setCheckpoint(checkpointFilename, checkpointInterval, resume);
+    }
     maxent.train(observationList, concurrency, maxIter, regularizationCoefficientL1, regularizationCoefficientL2, epsilonForConvergence);
     maxent.writeModel(modelFilename);
 }
@@ -275,14 +371,14 @@ vector<vector<string>> MorphemeDisambiguatorClass::tag(vector<string> sentence)
         return ret;
     }
     auto dictResultListList = lookupSentence(sentence, *dictionary);
-    auto commonAttributeSetList = convertSentenceToCommonAttributeSetList(sentence, dictResultListList, options);
+    auto commonAttributeIdList = convertSentenceToCommonAttributeIdList(sentence, dictResultListList, options, nullptr);
     assert(sentence.size() == dictResultListList.size() &&
-           sentence.size() == commonAttributeSetList.size());
+           sentence.size() == commonAttributeIdList.size());
     for (size_t i = 0; i < sentence.size(); ++i) {
         auto wordAndLabel = Utility::rsplit2(sentence[i], '/');
         vector<string> result(wordAndLabel);
         if (dictResultListList[i].size() != 0) {
-            size_t j = inferCorrectResult(dictResultListList[i], commonAttributeSetList[i], *maxEntProcessor);
+            size_t j = inferCorrectResult(dictResultListList[i], commonAttributeIdList[i], *maxEntProcessor);
             auto &inferredResult = (dictResultListList[i])[j];
             result.insert(result.end(), inferredResult.begin(), inferredResult.end());
         }
@@ -24,7 +24,13 @@ public:
                double regularizationCoefficientL1,
                double regularizationCoefficientL2,
                double epsilonForConvergence,
+               size_t batchSize,
+               double learningRate,
                const std::string &modelFilename);
+    // Writes the state of L-BFGS to the checkpoint file every interval
+    // iterations during training, and continues from the state in it if
+    // resume is true.
+    void setCheckpoint(const std::string &checkpointFilename, size_t checkpointInterval, bool resume);
     std::vector<std::vector<std::string>> tag(std::vector<std::string> sentence) const;
     void test(const std::string &testFilename) const;
     void readModel(const std::string &modelFilename);
@@ -33,6 +39,9 @@ private:
     std::shared_ptr<Dictionary::DictionaryClass> dictionary;
     std::shared_ptr<MaxEnt::MaxEntProcessor> maxEntProcessor;
     MorphemeDisambiguatorOptions options;
+    std::string checkpointFilename;
+    size_t checkpointInterval;
+    bool resume;
 };
 
 }
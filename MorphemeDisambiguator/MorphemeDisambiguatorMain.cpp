@@ -1,5 +1,6 @@
 #include "MorphemeDisambiguatorClass.h"
 
+#include "../MaxEnt/MaxEntProcessor.h"
 #include "../optionparser/optionparser.h"
 #include "../task/task_queue.hpp"
 #include "../Utility/FileUtil.h"
@@ -26,7 +27,7 @@ using std::queue;
 using std::string;
 using std::vector;
 
-enum optionIndex { UNKNOWN, HELP, TRAIN, TAG, TEST, MODEL, DICT, THREADS, WORD_W, LABEL_W, COLUMN_W, FCOLUMN, C1, C2, EPSILON, MAXITER };
+enum optionIndex { UNKNOWN, HELP, TRAIN, TAG, TEST, MODEL, DICT, THREADS, WORD_W, LABEL_W, COLUMN_W, FCOLUMN, C1, C2, EPSILON, MAXITER, SGD, LEARNING_RATE, CHECKPOINT, CHECKPOINT_INTERVAL, RESUME, CONVERT };
 
 struct Arg : public option::Arg
 {
@@ -44,6 +45,7 @@ const option::Descriptor usage[] =
     { UNKNOWN, 0, "", "", Arg::None, "USAGE:  [options]\n\n"
     "Options:" },
     { HELP, 0, "h", "help", Arg::None, "  -h, --help  \tPrints usage and exit." },
+    { CONVERT, 0, "", "convert", Arg::Required, "  --convert  <file>\tConverts the model designated by --model into the memory-mappable format and writes it to <file>. A model in that format is loaded without parsing." },
     { MODEL, 0, "", "model", Arg::Required, "  --model  <file>\tDesignates the model file to be saved/loaded." },
     { DICT, 0, "", "dict", Arg::Required, "  --dict  <file>\tDesignates the dictionary file to be loaded." },
     { WORD_W, 0, "", "wordw", Arg::Required, "  --wordw  <number>\tWindow width for words." },
@@ -57,6 +59,11 @@ const option::Descriptor usage[] =
     { C2, 0, "", "c2", Arg::Required, "  --c2  <number>\t(For training) Sets the coefficient for L2 regularization. The default value is 0 (no L2 regularization)." },
     { EPSILON, 0, "", "epsilon", Arg::Required, "  --epsilon  <number>\tSets the epsilon for convergence." },
     { MAXITER, 0, "", "maxiter", Arg::Required, "  --maxiter  <number>\tSets the maximum iteration count." },
+    { SGD, 0, "", "sgd", Arg::Required, "  --sgd  <number>\t(For training) Trains the model by mini-batch SGD with batches of <number> observations instead of L-BFGS. --maxiter sets the number of epochs, which defaults to 10." },
+    { LEARNING_RATE, 0, "", "learning-rate", Arg::Required, "  --learning-rate  <number>\t(For training with --sgd) Sets the initial learning rate. The default value is 1.0." },
+    { CHECKPOINT, 0, "", "checkpoint", Arg::Required, "  --checkpoint  <file>\t(For training with L-BFGS) Writes the state of the optimization to <file> periodically, so that the training can be resumed with --resume." },
+    { CHECKPOINT_INTERVAL, 0, "", "checkpoint-interval", Arg::Required, "  --checkpoint-interval  <number>\t(For training with --checkpoint) Sets the number of iterations between checkpoints. The default value is 10." },
+    { RESUME, 0, "", "resume", Arg::None, "  --resume  \t(For training with --checkpoint) Continues the training from the state in the checkpoint file. The training file and the options must be the same." },
     { THREADS, 0, "", "threads", Arg::Required, "  --threads  <number>\tDesignates the number of threads to run concurrently." },
     { 0, 0, 0, 0, 0, 0 }
 };
@@ -140,10 +147,45 @@ int mainProc(int argc, char **argv) {
         if (c1 == 0.0 && c2 == 0.0) {
             c1 = 0.05;
         }
+        size_t batchSize = 0;
+        double learningRate = 1.0;
+        if (options[SGD]) {
+            int size = atoi(options[SGD].arg);
+            if (size < 1) {
+                cerr << "--sgd must be a positive number." << endl;
+                exit(1);
+            }
+            batchSize = size;
+        }
+        if (options[LEARNING_RATE]) {
+            learningRate = atof(options[LEARNING_RATE].arg);
+        }
         
         MorphemeDisambiguator::MorphemeDisambiguatorClass s(op);
+        if (options[CHECKPOINT]) {
+            int checkpointInterval = 10;
+            if (options[CHECKPOINT_INTERVAL]) {
+                checkpointInterval = atoi(options[CHECKPOINT_INTERVAL].arg);
+                if (checkpointInterval < 1) {
+                    cerr << "--checkpoint-interval must be a positive number." << endl;
+                    exit(1);
+                }
+            }
+            s.setCheckpoint(options[CHECKPOINT].arg, checkpointInterval, options[RESUME]);
+        }
+        else if (options[RESUME]) {
+            cerr << "--resume requires --checkpoint." << endl;
+            exit(1);
+        }
+
+        s.train(trainingFilename, numThreads, maxIter, c1, c2, epsilon, batchSize, learningRate, modelFilename);
+        return 0;
+    }
 
-        s.train(trainingFilename, numThreads, maxIter, c1, c2, epsilon, modelFilename);
+    if (options[CONVERT]) {
+        MaxEnt::MaxEntProcessor proc;
+        proc.readModel(modelFilename);
+        proc.writeMappedModel(options[CONVERT].arg);
         return 0;
     }
 
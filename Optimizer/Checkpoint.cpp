@@ -0,0 +1,198 @@
+#include "Checkpoint.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Optimizer {
+
+using std::cerr;
+using std::endl;
+using std::exit;
+using std::ifstream;
+using std::ios;
+using std::lock_guard;
+using std::mutex;
+using std::ofstream;
+using std::string;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+static const char CHECKPOINT_MAGIC[8] = { 'H', 'O', 'C', 'R', 'F', 'C', 'P', '\0' };
+static const uint32_t CHECKPOINT_VERSION = 1;
+static const uint32_t CHECKPOINT_BYTE_ORDER_MARK = 0x01020304;
+
+// The header is followed by x, g and d, the m pairs of s and y, ys and the
+// past values of the objective function.
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint64_t fingerprint;
+    uint64_t variableCount;
+    uint32_t memorySize;
+    uint32_t pastCount;
+    int32_t iteration;
+    int32_t end;
+    double fx;
+    double step;
+};
+
+static void readArray(ifstream *in, vector<double> *v, size_t size) {
+    v->resize(size);
+    in->read(reinterpret_cast<char *>(v->data()), sizeof(double) * size);
+}
+
+static void writeArray(ofstream *out, const vector<double> &v) {
+    out->write(reinterpret_cast<const char *>(v.data()), sizeof(double) * v.size());
+}
+
+void readCheckpoint(const string &filename, Checkpoint *checkpoint) {
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.is_open()) {
+        cerr << "Cannot read from file: " << filename << endl;
+        exit(1);
+    }
+    in.seekg(0, ios::end);
+    uint64_t fileSize = in.tellg();
+    in.seekg(0, ios::beg);
+    CheckpointHeader header;
+    in.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!in ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CHECKPOINT_VERSION ||
+        header.byteOrderMark != CHECKPOINT_BYTE_ORDER_MARK) {
+        cerr << "Not a valid checkpoint: " << filename << endl;
+        exit(1);
+    }
+    // The counts are checked against the size of the file before anything
+    // is allocated for them, without overflowing.
+    uint64_t valueCount = (fileSize - sizeof(header)) / sizeof(double);
+    uint64_t arrayCount = 3 + 2 * (uint64_t)header.memorySize;
+    uint64_t restCount = (uint64_t)header.memorySize + header.pastCount;
+    if ((fileSize - sizeof(header)) % sizeof(double) != 0 ||
+        (header.variableCount > 0 && arrayCount > valueCount / header.variableCount) ||
+        header.variableCount * arrayCount + restCount != valueCount ||
+        // the iteration counter starts at 1, and end indexes the memory
+        header.iteration < 1 || header.end < 0 || (uint32_t)header.end >= header.memorySize) {
+        cerr << "Not a valid checkpoint: " << filename << endl;
+        exit(1);
+    }
+    checkpoint->fingerprint = header.fingerprint;
+    checkpoint->iteration = header.iteration;
+    checkpoint->end = header.end;
+    checkpoint->fx = header.fx;
+    checkpoint->step = header.step;
+    size_t n = header.variableCount;
+    readArray(&in, &checkpoint->x, n);
+    readArray(&in, &checkpoint->g, n);
+    readArray(&in, &checkpoint->d, n);
+    checkpoint->s.resize(header.memorySize);
+    checkpoint->y.resize(header.memorySize);
+    for (uint32_t i = 0; i < header.memorySize; ++i) {
+        readArray(&in, &checkpoint->s[i], n);
+        readArray(&in, &checkpoint->y[i], n);
+    }
+    readArray(&in, &checkpoint->ys, header.memorySize);
+    readArray(&in, &checkpoint->pastFxList, header.pastCount);
+    if (!in) {
+        cerr << "The checkpoint is truncated: " << filename << endl;
+        exit(1);
+    }
+}
+
+void writeCheckpoint(const string &filename, const Checkpoint &checkpoint) {
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.byteOrderMark = CHECKPOINT_BYTE_ORDER_MARK;
+    header.fingerprint = checkpoint.fingerprint;
+    header.variableCount = checkpoint.x.size();
+    header.memorySize = (uint32_t)checkpoint.s.size();
+    header.pastCount = (uint32_t)checkpoint.pastFxList.size();
+    header.iteration = checkpoint.iteration;
+    header.end = checkpoint.end;
+    header.fx = checkpoint.fx;
+    header.step = checkpoint.step;
+
+    string tempFilename = filename + ".tmp";
+    ofstream out(tempFilename, ios::out | ios::binary);
+    if (!out.is_open()) {
+        cerr << "Cannot write to file: " << tempFilename << endl;
+        exit(1);
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeArray(&out, checkpoint.x);
+    writeArray(&out, checkpoint.g);
+    writeArray(&out, checkpoint.d);
+    for (size_t i = 0; i < checkpoint.s.size(); ++i) {
+        writeArray(&out, checkpoint.s[i]);
+        writeArray(&out, checkpoint.y[i]);
+    }
+    writeArray(&out, checkpoint.ys);
+    writeArray(&out, checkpoint.pastFxList);
+    out.close();
+    if (!out || std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        cerr << "Cannot write to file: " << filename << endl;
+        exit(1);
+    }
+}
+
+CheckpointWriter::CheckpointWriter(const string &filename) : filename(filename), pending(false), stopping(false) {
+    writerThread = thread(&CheckpointWriter::writerLoop, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        lock_guard<mutex> lock(writerMutex);
+        stopping = true;
+    }
+    writerCondition.notify_all();
+    writerThread.join();
+}
+
+Checkpoint *CheckpointWriter::acquire() {
+    lock_guard<mutex> lock(writerMutex);
+    return pending ? nullptr : &buffer;
+}
+
+void CheckpointWriter::submit() {
+    {
+        lock_guard<mutex> lock(writerMutex);
+        pending = true;
+    }
+    writerCondition.notify_all();
+}
+
+void CheckpointWriter::wait() {
+    unique_lock<mutex> lock(writerMutex);
+    writerCondition.wait(lock, [this] { return !pending; });
+}
+
+void CheckpointWriter::writerLoop() {
+    unique_lock<mutex> lock(writerMutex);
+    while (true) {
+        writerCondition.wait(lock, [this] { return pending || stopping; });
+        if (!pending) {
+            return;
+        }
+        // the buffer is not touched by the optimizer while pending
+        lock.unlock();
+        writeCheckpoint(filename, buffer);
+        lock.lock();
+        pending = false;
+        writerCondition.notify_all();
+    }
+}
+
+}  // namespace Optimizer
@@ -0,0 +1,68 @@
+#ifndef HOCRF_OPTIMIZER_CHECKPOINT_H_
+#define HOCRF_OPTIMIZER_CHECKPOINT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Optimizer {
+
+// The state of an L-BFGS optimization at the beginning of an iteration: the
+// weights, the gradients, the search direction, the limited memory and the
+// iteration counter. fingerprint identifies the training the state belongs
+// to.
+struct Checkpoint {
+    uint64_t fingerprint;
+    int iteration;
+    int end;
+    double fx;
+    double step;
+    std::vector<double> x;
+    std::vector<double> g;
+    std::vector<double> d;
+    std::vector<std::vector<double>> s;
+    std::vector<std::vector<double>> y;
+    std::vector<double> ys;
+    std::vector<double> pastFxList;
+};
+
+// Exits if the file cannot be read or is broken.
+void readCheckpoint(const std::string &filename, Checkpoint *checkpoint);
+
+// Writes to a temporary file first and renames it, so that the last
+// checkpoint survives if the process is killed while writing.
+void writeCheckpoint(const std::string &filename, const Checkpoint &checkpoint);
+
+// Writes checkpoints on a thread of its own. The optimizer fills the buffer
+// returned by acquire() and passes it on with submit(); acquire() returns
+// null while the previous checkpoint is still being written, so that the
+// optimizer never waits for the disk.
+class CheckpointWriter
+{
+public:
+    explicit CheckpointWriter(const std::string &filename);
+    ~CheckpointWriter();
+    Checkpoint *acquire();
+    void submit();
+    // Waits until the submitted checkpoint has been written.
+    void wait();
+
+private:
+    CheckpointWriter(const CheckpointWriter &) = delete;
+    CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+    void writerLoop();
+
+    std::string filename;
+    Checkpoint buffer;
+    std::mutex writerMutex;
+    std::condition_variable writerCondition;
+    bool pending;
+    bool stopping;
+    std::thread writerThread;
+};
+
+}  // namespace Optimizer
+#endif  // HOCRF_OPTIMIZER_CHECKPOINT_H_
@@ -0,0 +1,33 @@
+#ifndef HOCRF_OPTIMIZER_COMMUNICATOR_H_
+#define HOCRF_OPTIMIZER_COMMUNICATOR_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Optimizer {
+
+// The transport between the processes of distributed training. The
+// processes are numbered from 0 to getSize() - 1, and every process must
+// make the same sequence of calls.
+class Communicator
+{
+public:
+    virtual ~Communicator() {}
+    virtual size_t getRank() const = 0;
+    virtual size_t getSize() const = 0;
+    // Copies the data of rank 0 to all the other ranks.
+    virtual void broadcast(double *data, size_t size) = 0;
+    // Replaces the data on rank 0 with the sum over the ranks, which is
+    // added up in the order of the ranks. The data on the other ranks are
+    // left as they are.
+    virtual void reduce(double *data, size_t size) = 0;
+    // Replaces the data on every rank with the sum over the ranks, which is
+    // added up in the order of the ranks.
+    virtual void allReduce(double *data, size_t size) = 0;
+    // Returns the bytes given by all the ranks, in the order of the ranks.
+    virtual std::vector<std::string> allGather(const std::string &data) = 0;
+};
+
+}  // namespace Optimizer
+#endif  // HOCRF_OPTIMIZER_COMMUNICATOR_H_
@@ -0,0 +1,66 @@
+#include "DistributedUpdate.h"
+
+#include "Communicator.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Optimizer {
+
+using std::vector;
+
+enum DistributedCommand {
+    COMMAND_FINISH,
+    COMMAND_UPDATE
+};
+
+DistributedUpdate::DistributedUpdate(Communicator *communicator,
+                                     double (*updateProc)(void *, const double *, double *, int, WorkerPool *),
+                                     void *updateData,
+                                     size_t featureCount)
+    : communicator(communicator), innerUpdateProc(updateProc), innerUpdateData(updateData),
+      weightBuffer(featureCount), reduceBuffer(featureCount + 1) {}
+
+double DistributedUpdate::updateProc(void *distributedUpdate, const double *x, double *g, int n, WorkerPool *pool) {
+    auto self = static_cast<DistributedUpdate *>(distributedUpdate);
+    double command = COMMAND_UPDATE;
+    self->communicator->broadcast(&command, 1);
+    std::copy(x, x + n, self->weightBuffer.begin());
+    self->communicator->broadcast(self->weightBuffer.data(), n);
+
+    double logLikelihood = self->innerUpdateProc(self->innerUpdateData, x, g, n, pool);
+    auto &buffer = self->reduceBuffer;
+    std::copy(g, g + n, buffer.begin());
+    buffer[n] = logLikelihood;
+    self->communicator->reduce(buffer.data(), n + 1);
+    std::copy(buffer.begin(), buffer.begin() + n, g);
+    return buffer[n];
+}
+
+void DistributedUpdate::finish(const vector<double> &weightList) {
+    double command = COMMAND_FINISH;
+    communicator->broadcast(&command, 1);
+    weightBuffer = weightList;
+    communicator->broadcast(weightBuffer.data(), weightBuffer.size());
+}
+
+vector<double> DistributedUpdate::serve(WorkerPool *pool) {
+    int n = (int)weightBuffer.size();
+    vector<double> gradient(n);
+    while (true) {
+        double command;
+        communicator->broadcast(&command, 1);
+        communicator->broadcast(weightBuffer.data(), n);
+        if (command == COMMAND_FINISH) {
+            return weightBuffer;
+        }
+        std::fill(gradient.begin(), gradient.end(), 0.0);
+        reduceBuffer[n] = innerUpdateProc(innerUpdateData, weightBuffer.data(), gradient.data(), n, pool);
+        std::copy(gradient.begin(), gradient.end(), reduceBuffer.begin());
+        // only rank 0 needs the sum
+        communicator->reduce(reduceBuffer.data(), n + 1);
+    }
+}
+
+}  // namespace Optimizer
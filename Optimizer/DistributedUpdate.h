@@ -0,0 +1,43 @@
+#ifndef HOCRF_OPTIMIZER_DISTRIBUTED_UPDATE_H_
+#define HOCRF_OPTIMIZER_DISTRIBUTED_UPDATE_H_
+
+#include "WorkerPool.h"
+
+#include <vector>
+
+namespace Optimizer {
+
+class Communicator;
+
+// Runs an update procedure on the data of all the processes. The optimizer
+// runs on rank 0 with updateProc() and this object as its update data; it
+// sends the weights to the other ranks, which run serve(), and sums the
+// gradients and the log likelihoods. The gradient is only initialized to
+// the negated feature counts on rank 0, so the counts must be those of the
+// whole data.
+class DistributedUpdate
+{
+public:
+    DistributedUpdate(Communicator *communicator,
+                      double (*updateProc)(void *, const double *, double *, int, WorkerPool *),
+                      void *updateData,
+                      size_t featureCount);
+    static double updateProc(void *distributedUpdate, const double *x, double *g, int n, WorkerPool *pool);
+    // Called on rank 0 after the optimization. Stops the other ranks and
+    // sends them the weights.
+    void finish(const std::vector<double> &weightList);
+    // Called on the other ranks. Runs the update procedure until rank 0
+    // finishes, and returns the weights sent by it.
+    std::vector<double> serve(WorkerPool *pool);
+
+private:
+    Communicator *communicator;
+    double (*innerUpdateProc)(void *, const double *, double *, int, WorkerPool *);
+    void *innerUpdateData;
+    std::vector<double> weightBuffer;
+    // the gradient followed by the log likelihood
+    std::vector<double> reduceBuffer;
+};
+
+}  // namespace Optimizer
+#endif  // HOCRF_OPTIMIZER_DISTRIBUTED_UPDATE_H_
@@ -1,19 +1,29 @@
 #include "OptimizerClass.h"
 
 #include "../liblbfgs/lbfgs.h"
-#include "../task/task_queue.hpp"
+#include "Checkpoint.h"
+#include "WorkerPool.h"
 
 #include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <thread>
 #include <utility>
 #include <vector>
 
 namespace Optimizer {
 
+using std::cerr;
 using std::cout;
 using std::endl;
+using std::exit;
+using std::make_shared;
 using std::move;
+using std::string;
 using std::vector;
 
 double lbfgsEvaluate(void *instance,
@@ -37,16 +47,80 @@ int lbfgsProgress(void *instance,
     return ((OptimizerClass*)instance)->progress(x, g, fx, xnorm, gnorm, step, n, k, ls);
 }
 
-OptimizerClass::OptimizerClass(double (*updateProc)(void *, const double *, double *, int, size_t), void *updateData, vector<double> featureCountList,
-    size_t concurrency, size_t maxIter, double regularizationCoefficientL1, double regularizationCoefficientL2, double epsilonForConvergence) {
+void lbfgsCheckpoint(void *instance,
+                     const lbfgs_state_t *state,
+                     int n) {
+    auto optimizer = (OptimizerClass*)instance;
+    auto checkpoint = optimizer->beginCheckpoint(state->k);
+    if (!checkpoint) {
+        return;
+    }
+    checkpoint->iteration = state->k;
+    checkpoint->end = state->end;
+    checkpoint->fx = state->fx;
+    checkpoint->step = state->step;
+    checkpoint->x.assign(state->x, state->x + n);
+    checkpoint->g.assign(state->g, state->g + n);
+    checkpoint->d.assign(state->d, state->d + n);
+    for (size_t i = 0; i < checkpoint->s.size(); ++i) {
+        checkpoint->s[i].assign(state->s[i], state->s[i] + n);
+        checkpoint->y[i].assign(state->y[i], state->y[i] + n);
+        checkpoint->ys[i] = state->ys[i];
+    }
+    if (state->pf) {
+        memcpy(checkpoint->pastFxList.data(), state->pf, sizeof(double) * checkpoint->pastFxList.size());
+    }
+    optimizer->endCheckpoint();
+}
+
+OptimizerClass::OptimizerClass(double (*updateProc)(void *, const double *, double *, int, WorkerPool *), void *updateData, vector<double> featureCountList,
+    size_t concurrency, size_t maxIter, double regularizationCoefficientL1, double regularizationCoefficientL2, double epsilonForConvergence) : pool(concurrency) {
     this->updateProc = updateProc;
     this->updateData = updateData;
     this->featureCountList = move(featureCountList);
-    this->concurrency = concurrency;
     this->maxIter = maxIter;
     this->regularizationCoefficientL1 = regularizationCoefficientL1;
     this->regularizationCoefficientL2 = regularizationCoefficientL2;
     this->epsilonForConvergence = epsilonForConvergence;
+    checkpointInterval = 0;
+    resume = false;
+    firstIteration = 1;
+}
+
+void OptimizerClass::setCheckpoint(const string &filename, size_t interval, bool resume) {
+    checkpointFilename = filename;
+    checkpointInterval = interval;
+    this->resume = resume;
+}
+
+// Identifies the training by the feature counts and the regularization, so
+// that a checkpoint is not resumed for other training data.
+uint64_t OptimizerClass::getFingerprint() const {
+    // FNV-1a over the bytes
+    uint64_t h = 14695981039346656037ULL;
+    auto addBytes = [&h](const void *p, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            h ^= static_cast<const unsigned char *>(p)[i];
+            h *= 1099511628211ULL;
+        }
+    };
+    addBytes(featureCountList.data(), sizeof(double) * featureCountList.size());
+    addBytes(&regularizationCoefficientL1, sizeof(regularizationCoefficientL1));
+    addBytes(&regularizationCoefficientL2, sizeof(regularizationCoefficientL2));
+    return h;
+}
+
+Checkpoint *OptimizerClass::beginCheckpoint(int iteration) {
+    // the state at the beginning of an iteration follows iteration - 1
+    // finished ones
+    if (!checkpointWriter || iteration == firstIteration || (iteration - 1) % checkpointInterval != 0) {
+        return nullptr;
+    }
+    return checkpointWriter->acquire();
+}
+
+void OptimizerClass::endCheckpoint() {
+    checkpointWriter->submit();
 }
 
 void OptimizerClass::optimize(const double* featureWeights) {
@@ -57,8 +131,8 @@ void OptimizerClass::optimize(const double* featureWeights) {
 
     cout << "L-BFGS optimization" << endl;
     size_t featureListSize = featureCountList.size();
-    bestWeightList.resize(featureListSize);
-    buffer.resize(featureListSize);
+    bestWeightList.assign(featureWeights, featureWeights + featureListSize);
+    buffer.assign(featureWeights, featureWeights + featureListSize);
     
     if (maxIter != 0) {
         lbfgsParam.max_iterations = maxIter;
@@ -72,7 +146,53 @@ void OptimizerClass::optimize(const double* featureWeights) {
     } else {
         lbfgsParam.orthantwise_c = 0.0;
     }
-    auto ret = lbfgs(featureListSize, buffer.data(), 0, lbfgsEvaluate, lbfgsProgress, this, &lbfgsParam);
+
+    Checkpoint resumedCheckpoint;
+    lbfgs_state_t initialState;
+    vector<double *> sList;
+    vector<double *> yList;
+    if (resume) {
+        readCheckpoint(checkpointFilename, &resumedCheckpoint);
+        if (resumedCheckpoint.fingerprint != getFingerprint() ||
+            resumedCheckpoint.x.size() != featureListSize ||
+            resumedCheckpoint.s.size() != (size_t)lbfgsParam.m ||
+            resumedCheckpoint.pastFxList.size() != (size_t)lbfgsParam.past) {
+            cerr << "The checkpoint was made for other training data or options: " << checkpointFilename << endl;
+            exit(1);
+        }
+        for (int i = 0; i < lbfgsParam.m; ++i) {
+            sList.emplace_back(resumedCheckpoint.s[i].data());
+            yList.emplace_back(resumedCheckpoint.y[i].data());
+        }
+        initialState.k = resumedCheckpoint.iteration;
+        initialState.end = resumedCheckpoint.end;
+        initialState.fx = resumedCheckpoint.fx;
+        initialState.step = resumedCheckpoint.step;
+        initialState.x = resumedCheckpoint.x.data();
+        initialState.g = resumedCheckpoint.g.data();
+        initialState.d = resumedCheckpoint.d.data();
+        initialState.s = sList.data();
+        initialState.y = yList.data();
+        initialState.ys = resumedCheckpoint.ys.data();
+        initialState.pf = resumedCheckpoint.pastFxList.data();
+        firstIteration = resumedCheckpoint.iteration;
+        bestWeightList = resumedCheckpoint.x;
+        cout << "Resuming from iteration #" << firstIteration << endl;
+    }
+    if (checkpointInterval > 0) {
+        checkpointWriter = make_shared<CheckpointWriter>(checkpointFilename);
+        auto checkpoint = checkpointWriter->acquire();
+        checkpoint->fingerprint = getFingerprint();
+        checkpoint->s.resize(lbfgsParam.m);
+        checkpoint->y.resize(lbfgsParam.m);
+        checkpoint->ys.resize(lbfgsParam.m);
+        checkpoint->pastFxList.resize(lbfgsParam.past);
+    }
+    auto ret = lbfgs_resume(featureListSize, buffer.data(), 0, lbfgsEvaluate, lbfgsProgress, checkpointWriter ? lbfgsCheckpoint : nullptr, resume ? &initialState : nullptr, this, &lbfgsParam);
+    if (checkpointWriter) {
+        checkpointWriter->wait();
+        checkpointWriter.reset();
+    }
 
     if (ret == LBFGS_CONVERGENCE) {
         cout << "L-BFGS resulted in convergence." << endl;
@@ -95,7 +215,7 @@ double OptimizerClass::evaluate(const double *x, double *g, int n) {
         g[i] = -featureCountList[i];
     }
 
-    double logLikelihood = updateProc(updateData, expWeights.data(), g, n, concurrency);
+    double logLikelihood = updateProc(updateData, expWeights.data(), g, n, &pool);
 
     if (regularizationCoefficientL2 > 0.0) {
         for (size_t i = 0; i < featureListSize; ++i) {
@@ -1,7 +1,11 @@
 #ifndef HOCRF_OPTIMIZER_OPTIMIZER_CLASS_H
 #define HOCRF_OPTIMIZER_OPTIMIZER_CLASS_H
 
+#include "Checkpoint.h"
+#include "WorkerPool.h"
+
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace Optimizer {
@@ -9,23 +13,38 @@ namespace Optimizer {
 class OptimizerClass
 {
 public:
-    OptimizerClass(double (*updateProc)(void *, const double *, double *, int n, size_t), void *updateData, std::vector<double> featureCountList, size_t concurrency, size_t maxIters, double  regularizationCoefficientL1, double regularizationCoefficientL2, double epsilonForConvergence);
+    // updateProc can run its work on the pool, which is kept for all the
+    // iterations.
+    OptimizerClass(double (*updateProc)(void *, const double *, double *, int n, WorkerPool *), void *updateData, std::vector<double> featureCountList, size_t concurrency, size_t maxIters, double  regularizationCoefficientL1, double regularizationCoefficientL2, double epsilonForConvergence);
     double evaluate(const double *x, double *g, int n);
     void optimize(const double *featureWeights);
     int progress(const double *x, const double *g, const double fx, const double xnorm, const double gnorm, const double step, int n, int k, int ls);
     const std::vector<double> &getBestWeightList();
+    // Writes the state to filename every interval iterations, and continues
+    // from the state in it if resume is true.
+    void setCheckpoint(const std::string &filename, size_t interval, bool resume);
+    // Returns the buffer to store the state at the beginning of the
+    // iteration in, or null if no checkpoint is to be written.
+    Checkpoint *beginCheckpoint(int iteration);
+    void endCheckpoint();
 
 private:
-    double (*updateProc)(void *, const double *, double *, int, size_t);
+    uint64_t getFingerprint() const;
+    double (*updateProc)(void *, const double *, double *, int, WorkerPool *);
     void *updateData;
     std::vector<double> featureCountList;
     std::vector<double> buffer;
     std::vector<double> bestWeightList;
-    size_t concurrency;
+    WorkerPool pool;
     size_t maxIter;
     double regularizationCoefficientL1;
     double regularizationCoefficientL2;
     double epsilonForConvergence;
+    std::string checkpointFilename;
+    size_t checkpointInterval;
+    bool resume;
+    int firstIteration;
+    std::shared_ptr<CheckpointWriter> checkpointWriter;
 };
 
 }  // namespace Optimizer
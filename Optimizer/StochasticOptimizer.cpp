@@ -0,0 +1,163 @@
+#include "StochasticOptimizer.h"
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace Optimizer {
+
+using std::cout;
+using std::endl;
+using std::mt19937;
+using std::vector;
+
+constexpr double StochasticOptimizer::DECAY;
+constexpr uint32_t StochasticOptimizer::SEED;
+
+StochasticOptimizer::StochasticOptimizer(double (*updateProc)(void *, const double *, double *, int, WorkerPool *),
+                                         void (*selectProc)(void *, const size_t *, size_t, double *, vector<uint32_t> *),
+                                         void *updateData,
+                                         size_t itemCount,
+                                         size_t featureCount,
+                                         size_t concurrency,
+                                         size_t epochCount,
+                                         size_t batchSize,
+                                         double learningRate,
+                                         double regularizationCoefficientL1,
+                                         double regularizationCoefficientL2)
+    : updateProc(updateProc), selectProc(selectProc), updateData(updateData), itemCount(itemCount),
+      epochCount(epochCount), batchSize(std::max<size_t>(1, batchSize)), learningRate(learningRate),
+      regularizationCoefficientL1(regularizationCoefficientL1), regularizationCoefficientL2(regularizationCoefficientL2),
+      pool(concurrency), weightList(featureCount), expWeightList(featureCount), gradient(featureCount),
+      featureUpdateList(featureCount), updateCount(0), totalLogDecay(0.0), appliedLogDecayList(featureCount),
+      totalPenalty(0.0), appliedPenaltyList(featureCount) {}
+
+void StochasticOptimizer::optimize(const double *featureWeights) {
+    cout << "Mini-batch SGD optimization" << endl;
+    size_t featureCount = weightList.size();
+    for (size_t i = 0; i < featureCount; ++i) {
+        weightList[i] = featureWeights[i];
+        expWeightList[i] = exp(weightList[i]);
+    }
+
+    vector<size_t> itemList(itemCount);
+    for (size_t i = 0; i < itemCount; ++i) {
+        itemList[i] = i;
+    }
+    mt19937 rng(SEED);
+    size_t updatesPerEpoch = (itemCount + batchSize - 1) / batchSize;
+    for (size_t epoch = 1; epoch <= epochCount; ++epoch) {
+        std::shuffle(itemList.begin(), itemList.end(), rng);
+        double logLikelihood = 0.0;
+        for (size_t begin = 0; begin < itemCount; begin += batchSize) {
+            double eta = learningRate * pow(DECAY, (double)updateCount / updatesPerEpoch);
+            update(itemList.data() + begin, std::min(batchSize, itemCount - begin), eta, &logLikelihood);
+        }
+        settleAll();
+
+        size_t activeFeatureCount = 0;
+        double norm = 0.0;
+        for (size_t i = 0; i < featureCount; ++i) {
+            if (weightList[i] != 0.0) {
+                ++activeFeatureCount;
+            }
+            norm += weightList[i] * weightList[i];
+        }
+        cout << "***** Epoch #" << epoch << "*****" << endl;
+        cout << "Log-likelihood: " << logLikelihood << endl;
+        cout << "Feature norm: " << sqrt(norm) << endl;
+        cout << "Active features :" << activeFeatureCount << endl;
+        cout << "Learning rate: " << learningRate * pow(DECAY, (double)updateCount / updatesPerEpoch) << endl << endl;
+    }
+    // restores the updates of the procedure to the whole data
+    selectProc(updateData, nullptr, 0, nullptr, nullptr);
+}
+
+void StochasticOptimizer::update(const size_t *itemList, size_t itemCount, double learningRate, double *logLikelihood) {
+    ++updateCount;
+    batchFeatureIndexList.clear();
+    selectProc(updateData, itemList, itemCount, gradient.data(), &batchFeatureIndexList);
+    size_t batchFeatureCount = 0;
+    for (auto i : batchFeatureIndexList) {
+        if (featureUpdateList[i] == updateCount) {
+            continue;
+        }
+        featureUpdateList[i] = updateCount;
+        batchFeatureIndexList[batchFeatureCount++] = i;
+        gradient[i] = -gradient[i];
+        // the batch is evaluated with the decay of the updates it missed
+        if (appliedLogDecayList[i] != totalLogDecay) {
+            applyPendingL2Decay(i);
+            expWeightList[i] = exp(weightList[i]);
+        }
+    }
+    batchFeatureIndexList.resize(batchFeatureCount);
+    *logLikelihood += updateProc(updateData, expWeightList.data(), gradient.data(), (int)weightList.size(), &pool);
+
+    // the objective of an update is the mean loss of the batch plus the
+    // regularization terms divided by the number of the items
+    double scale = 1.0 / itemCount;
+    double l2 = 2.0 * regularizationCoefficientL2 / this->itemCount;
+    totalPenalty += learningRate * regularizationCoefficientL1 / this->itemCount;
+    if (l2 > 0.0) {
+        totalLogDecay += log1p(-learningRate * l2);
+    }
+    for (auto i : batchFeatureIndexList) {
+        double g = gradient[i] * scale + l2 * weightList[i];
+        gradient[i] = 0.0;
+        appliedLogDecayList[i] = totalLogDecay;
+        if (g == 0.0) {
+            continue;
+        }
+        weightList[i] -= learningRate * g;
+        if (regularizationCoefficientL1 > 0.0) {
+            applyL1Penalty(i);
+        }
+        expWeightList[i] = exp(weightList[i]);
+    }
+}
+
+void StochasticOptimizer::applyPendingL2Decay(size_t featureIndex) {
+    weightList[featureIndex] *= exp(totalLogDecay - appliedLogDecayList[featureIndex]);
+    appliedLogDecayList[featureIndex] = totalLogDecay;
+}
+
+void StochasticOptimizer::applyL1Penalty(size_t featureIndex) {
+    double &w = weightList[featureIndex];
+    double &q = appliedPenaltyList[featureIndex];
+    double z = w;
+    if (w > 0.0) {
+        w = std::max(0.0, w - (totalPenalty + q));
+    }
+    else if (w < 0.0) {
+        w = std::min(0.0, w + (totalPenalty - q));
+    }
+    q += w - z;
+}
+
+// applies the pending decay and penalty of all the weights
+void StochasticOptimizer::settleAll() {
+    for (size_t i = 0; i < weightList.size(); ++i) {
+        double w = weightList[i];
+        if (appliedLogDecayList[i] != totalLogDecay) {
+            applyPendingL2Decay(i);
+        }
+        if (regularizationCoefficientL1 > 0.0) {
+            applyL1Penalty(i);
+        }
+        if (weightList[i] != w) {
+            expWeightList[i] = exp(weightList[i]);
+        }
+    }
+}
+
+const vector<double> &StochasticOptimizer::getWeightList() {
+    return weightList;
+}
+
+}  // namespace Optimizer
@@ -0,0 +1,78 @@
+#ifndef HOCRF_OPTIMIZER_STOCHASTIC_OPTIMIZER_H_
+#define HOCRF_OPTIMIZER_STOCHASTIC_OPTIMIZER_H_
+
+#include "WorkerPool.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Optimizer {
+
+// Mini-batch SGD with the cumulative L1 penalty of Tsuruoka et al. (2009).
+// It uses the same update procedure as OptimizerClass, restricted to a batch
+// of the items by selectProc, which also adds the feature counts of the
+// items to its fourth argument and appends the indexes of the features the
+// items touch to its last one. The list may have duplicates, which are
+// removed before the update procedure is called, and the procedure only
+// needs to compute the gradients of the features in the list.
+//
+// Each update costs in proportion to the features of the batch. The L2
+// decay and the L1 penalty of the other features are applied when they are
+// next touched, and to all the features at the end of each epoch. The
+// learning rate decays exponentially, by the decay factor per epoch.
+class StochasticOptimizer
+{
+public:
+    StochasticOptimizer(double (*updateProc)(void *, const double *, double *, int, WorkerPool *),
+                        void (*selectProc)(void *, const size_t *, size_t, double *, std::vector<uint32_t> *),
+                        void *updateData,
+                        size_t itemCount,
+                        size_t featureCount,
+                        size_t concurrency,
+                        size_t epochCount,
+                        size_t batchSize,
+                        double learningRate,
+                        double regularizationCoefficientL1,
+                        double regularizationCoefficientL2);
+    void optimize(const double *featureWeights);
+    // the weights after the last epoch
+    const std::vector<double> &getWeightList();
+
+private:
+    static constexpr double DECAY = 0.85;
+    static constexpr uint32_t SEED = 1;
+    void update(const size_t *itemList, size_t itemCount, double learningRate, double *logLikelihood);
+    void applyPendingL2Decay(size_t featureIndex);
+    void applyL1Penalty(size_t featureIndex);
+    void settleAll();
+
+    double (*updateProc)(void *, const double *, double *, int, WorkerPool *);
+    void (*selectProc)(void *, const size_t *, size_t, double *, std::vector<uint32_t> *);
+    void *updateData;
+    size_t itemCount;
+    size_t epochCount;
+    size_t batchSize;
+    double learningRate;
+    double regularizationCoefficientL1;
+    double regularizationCoefficientL2;
+    WorkerPool pool;
+    std::vector<double> weightList;
+    std::vector<double> expWeightList;
+    // 0 except for the features of the batch being updated
+    std::vector<double> gradient;
+    std::vector<uint32_t> batchFeatureIndexList;
+    // the last update in which each feature was added to the list
+    std::vector<size_t> featureUpdateList;
+    size_t updateCount;
+    // the sum of log(1 - eta * l2) over the updates so far, and its value at
+    // the last update of each weight
+    double totalLogDecay;
+    std::vector<double> appliedLogDecayList;
+    // the total L1 penalty that could have been applied to each weight, and
+    // the penalty actually applied
+    double totalPenalty;
+    std::vector<double> appliedPenaltyList;
+};
+
+}  // namespace Optimizer
+#endif  // HOCRF_OPTIMIZER_STOCHASTIC_OPTIMIZER_H_
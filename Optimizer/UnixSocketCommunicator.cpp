@@ -0,0 +1,222 @@
+#include "UnixSocketCommunicator.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace Optimizer {
+
+using std::cerr;
+using std::endl;
+using std::exit;
+using std::string;
+using std::vector;
+
+#ifndef _WIN32
+
+// how long the other ranks wait for rank 0 to listen
+static const int CONNECT_RETRY_COUNT = 600;
+static const useconds_t CONNECT_RETRY_INTERVAL = 100000;
+
+UnixSocketCommunicator::UnixSocketCommunicator(const string &path, size_t rank, size_t size) : path(path), rank(rank), size(size) {
+    if (rank >= size) {
+        cerr << "The rank must be less than the number of processes." << endl;
+        exit(1);
+    }
+    if (size == 1) {
+        return;
+    }
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "The socket path is too long: " << path << endl;
+        exit(1);
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    if (rank == 0) {
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path.c_str());
+        if (listener < 0 ||
+            bind(listener, (sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(listener, (int)size) != 0) {
+            cerr << "Cannot listen on socket: " << path << endl;
+            exit(1);
+        }
+        socketList.assign(size, -1);
+        for (size_t i = 1; i < size; ++i) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                cerr << "Cannot accept a connection on socket: " << path << endl;
+                exit(1);
+            }
+            uint32_t peerRank;
+            receiveAll(fd, &peerRank, sizeof(peerRank));
+            if (peerRank == 0 || peerRank >= size || socketList[peerRank] != -1) {
+                cerr << "Invalid rank from a process: " << peerRank << endl;
+                exit(1);
+            }
+            socketList[peerRank] = fd;
+        }
+        close(listener);
+        unlink(path.c_str());
+    }
+    else {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        int retry = 0;
+        while (connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+            if (++retry == CONNECT_RETRY_COUNT) {
+                cerr << "Cannot connect to socket: " << path << endl;
+                exit(1);
+            }
+            usleep(CONNECT_RETRY_INTERVAL);
+        }
+        uint32_t myRank = (uint32_t)rank;
+        sendAll(fd, &myRank, sizeof(myRank));
+        socketList.assign(1, fd);
+    }
+}
+
+UnixSocketCommunicator::~UnixSocketCommunicator() {
+    for (int fd : socketList) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+void UnixSocketCommunicator::sendAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written <= 0) {
+            cerr << "Cannot send data to another process." << endl;
+            exit(1);
+        }
+        p += written;
+        size -= written;
+    }
+}
+
+void UnixSocketCommunicator::receiveAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t received = read(fd, p, size);
+        if (received <= 0) {
+            cerr << "Cannot receive data from another process." << endl;
+            exit(1);
+        }
+        p += received;
+        size -= received;
+    }
+}
+
+#else
+
+UnixSocketCommunicator::UnixSocketCommunicator(const string &path, size_t rank, size_t size) : path(path), rank(rank), size(size) {
+    if (size > 1) {
+        cerr << "Distributed training is not supported on this platform." << endl;
+        exit(1);
+    }
+}
+
+UnixSocketCommunicator::~UnixSocketCommunicator() {}
+
+void UnixSocketCommunicator::sendAll(int fd, const void *data, size_t size) {}
+
+void UnixSocketCommunicator::receiveAll(int fd, void *data, size_t size) {}
+
+#endif
+
+size_t UnixSocketCommunicator::getRank() const {
+    return rank;
+}
+
+size_t UnixSocketCommunicator::getSize() const {
+    return size;
+}
+
+void UnixSocketCommunicator::broadcast(double *data, size_t size) {
+    if (this->size == 1) {
+        return;
+    }
+    if (rank == 0) {
+        for (size_t i = 1; i < this->size; ++i) {
+            sendAll(socketList[i], data, sizeof(double) * size);
+        }
+    }
+    else {
+        receiveAll(socketList[0], data, sizeof(double) * size);
+    }
+}
+
+void UnixSocketCommunicator::reduce(double *data, size_t size) {
+    if (this->size == 1) {
+        return;
+    }
+    if (rank == 0) {
+        buffer.resize(size);
+        for (size_t i = 1; i < this->size; ++i) {
+            receiveAll(socketList[i], buffer.data(), sizeof(double) * size);
+            for (size_t j = 0; j < size; ++j) {
+                data[j] += buffer[j];
+            }
+        }
+    }
+    else {
+        sendAll(socketList[0], data, sizeof(double) * size);
+    }
+}
+
+void UnixSocketCommunicator::allReduce(double *data, size_t size) {
+    reduce(data, size);
+    broadcast(data, size);
+}
+
+// Rank 0 receives the data of the other ranks and sends all of them back,
+// each preceded by its length.
+vector<string> UnixSocketCommunicator::allGather(const string &data) {
+    vector<string> dataList(size);
+    dataList[rank] = data;
+    if (size == 1) {
+        return dataList;
+    }
+    if (rank == 0) {
+        for (size_t i = 1; i < size; ++i) {
+            uint64_t length;
+            receiveAll(socketList[i], &length, sizeof(length));
+            dataList[i].resize(length);
+            receiveAll(socketList[i], &dataList[i][0], length);
+        }
+        for (size_t i = 1; i < size; ++i) {
+            for (const auto &d : dataList) {
+                uint64_t length = d.size();
+                sendAll(socketList[i], &length, sizeof(length));
+                sendAll(socketList[i], d.data(), length);
+            }
+        }
+    }
+    else {
+        uint64_t length = data.size();
+        sendAll(socketList[0], &length, sizeof(length));
+        sendAll(socketList[0], data.data(), length);
+        for (auto &d : dataList) {
+            receiveAll(socketList[0], &length, sizeof(length));
+            d.resize(length);
+            receiveAll(socketList[0], &d[0], length);
+        }
+    }
+    return dataList;
+}
+
+}  // namespace Optimizer
@@ -0,0 +1,41 @@
+#ifndef HOCRF_OPTIMIZER_UNIX_SOCKET_COMMUNICATOR_H_
+#define HOCRF_OPTIMIZER_UNIX_SOCKET_COMMUNICATOR_H_
+
+#include "Communicator.h"
+
+#include <string>
+#include <vector>
+
+namespace Optimizer {
+
+// A communicator for the processes on one host. Rank 0 listens on a Unix
+// domain socket at the path and the other ranks connect to it, so the data
+// are reduced and broadcast through rank 0.
+class UnixSocketCommunicator : public Communicator
+{
+public:
+    UnixSocketCommunicator(const std::string &path, size_t rank, size_t size);
+    ~UnixSocketCommunicator();
+    size_t getRank() const;
+    size_t getSize() const;
+    void broadcast(double *data, size_t size);
+    void reduce(double *data, size_t size);
+    void allReduce(double *data, size_t size);
+    std::vector<std::string> allGather(const std::string &data);
+
+private:
+    UnixSocketCommunicator(const UnixSocketCommunicator &) = delete;
+    UnixSocketCommunicator &operator=(const UnixSocketCommunicator &) = delete;
+    void sendAll(int fd, const void *data, size_t size);
+    void receiveAll(int fd, void *data, size_t size);
+    std::string path;
+    size_t rank;
+    size_t size;
+    // the sockets to the ranks on rank 0, and the socket to rank 0 on the
+    // others
+    std::vector<int> socketList;
+    std::vector<double> buffer;
+};
+
+}  // namespace Optimizer
+#endif  // HOCRF_OPTIMIZER_UNIX_SOCKET_COMMUNICATOR_H_
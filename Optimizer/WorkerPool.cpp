@@ -0,0 +1,166 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Optimizer {
+
+using std::greater;
+using std::lock_guard;
+using std::make_pair;
+using std::mutex;
+using std::pair;
+using std::priority_queue;
+using std::thread;
+using std::unique_lock;
+using std::unique_ptr;
+using std::vector;
+
+WorkerPool::WorkerPool(size_t threadCount) : proc(nullptr), data(nullptr), generation(0), runningThreadCount(0), stopping(false) {
+    threadCount = std::max<size_t>(1, threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workerList.emplace_back(unique_ptr<Worker>(new Worker));
+    }
+    // the thread #0 is the caller of run()
+    for (size_t i = 1; i < threadCount; ++i) {
+        threadList.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> lock(poolMutex);
+        stopping = true;
+    }
+    startCondition.notify_all();
+    for (auto &t : threadList) {
+        t.join();
+    }
+}
+
+size_t WorkerPool::getThreadCount() const {
+    return workerList.size();
+}
+
+void WorkerPool::run(size_t chunkCount, void (*proc)(void *, size_t), void *data) {
+    size_t threadCount = workerList.size();
+    for (size_t i = 0; i < chunkCount; ++i) {
+        workerList[i % threadCount]->chunkQueue.emplace_back(i);
+    }
+    {
+        lock_guard<mutex> lock(poolMutex);
+        this->proc = proc;
+        this->data = data;
+        ++generation;
+        runningThreadCount = threadCount - 1;
+    }
+    startCondition.notify_all();
+
+    runChunks(0);
+
+    unique_lock<mutex> lock(poolMutex);
+    finishCondition.wait(lock, [this] { return runningThreadCount == 0; });
+}
+
+void WorkerPool::workerLoop(size_t threadIndex) {
+    uint64_t lastGeneration = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(poolMutex);
+            startCondition.wait(lock, [this, lastGeneration] { return stopping || generation != lastGeneration; });
+            if (stopping) {
+                return;
+            }
+            lastGeneration = generation;
+        }
+        runChunks(threadIndex);
+        {
+            lock_guard<mutex> lock(poolMutex);
+            if (--runningThreadCount == 0) {
+                finishCondition.notify_one();
+            }
+        }
+    }
+}
+
+void WorkerPool::runChunks(size_t threadIndex) {
+    size_t chunkIndex;
+    while (popChunk(threadIndex, &chunkIndex)) {
+        (*proc)(data, chunkIndex);
+    }
+}
+
+bool WorkerPool::popChunk(size_t threadIndex, size_t *chunkIndex) {
+    {
+        auto &worker = *workerList[threadIndex];
+        lock_guard<mutex> lock(worker.mutex);
+        if (!worker.chunkQueue.empty()) {
+            *chunkIndex = worker.chunkQueue.front();
+            worker.chunkQueue.pop_front();
+            return true;
+        }
+    }
+    size_t threadCount = workerList.size();
+    for (size_t i = 1; i < threadCount; ++i) {
+        auto &victim = *workerList[(threadIndex + i) % threadCount];
+        lock_guard<mutex> lock(victim.mutex);
+        if (!victim.chunkQueue.empty()) {
+            *chunkIndex = victim.chunkQueue.back();
+            victim.chunkQueue.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+vector<vector<size_t>> WorkerPool::makeBalancedChunks(const vector<size_t> &costList, size_t chunkCount) {
+    chunkCount = std::max<size_t>(1, std::min(chunkCount, costList.size()));
+    vector<size_t> itemList(costList.size());
+    for (size_t i = 0; i < itemList.size(); ++i) {
+        itemList[i] = i;
+    }
+    std::stable_sort(itemList.begin(), itemList.end(), [&costList](size_t a, size_t b) {
+        return costList[a] > costList[b];
+    });
+
+    // puts each item into the chunk of the least cost, the most costly first
+    vector<vector<size_t>> chunkList(chunkCount);
+    vector<size_t> chunkCostList(chunkCount);
+    priority_queue<pair<size_t, size_t>, vector<pair<size_t, size_t>>, greater<pair<size_t, size_t>>> queue;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        queue.push(make_pair(0, i));
+    }
+    for (size_t item : itemList) {
+        auto top = queue.top();
+        queue.pop();
+        chunkList[top.second].emplace_back(item);
+        chunkCostList[top.second] = top.first + costList[item];
+        queue.push(make_pair(chunkCostList[top.second], top.second));
+    }
+
+    vector<size_t> orderList(chunkCount);
+    for (size_t i = 0; i < chunkCount; ++i) {
+        orderList[i] = i;
+        std::sort(chunkList[i].begin(), chunkList[i].end());
+    }
+    std::stable_sort(orderList.begin(), orderList.end(), [&chunkCostList](size_t a, size_t b) {
+        return chunkCostList[a] > chunkCostList[b];
+    });
+    vector<vector<size_t>> ret;
+    ret.reserve(chunkCount);
+    for (size_t i : orderList) {
+        if (!chunkList[i].empty()) {
+            ret.emplace_back(std::move(chunkList[i]));
+        }
+    }
+    return ret;
+}
+
+}  // namespace Optimizer
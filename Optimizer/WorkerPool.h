@@ -0,0 +1,55 @@
+#ifndef HOCRF_OPTIMIZER_WORKER_POOL_H_
+#define HOCRF_OPTIMIZER_WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Optimizer {
+
+// A pool of threads that live as long as the pool, so that the objective
+// function can be evaluated many times without spawning threads each time.
+// The calling thread of run() works as one of the threads.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(size_t threadCount);
+    ~WorkerPool();
+    size_t getThreadCount() const;
+    // Calls proc(data, chunkIndex) for every chunk in [0, chunkCount) and
+    // returns when all the calls have finished. The chunks are dealt to the
+    // threads in turn, and a thread that has run out of its own chunks
+    // steals the last ones of the others.
+    void run(size_t chunkCount, void (*proc)(void *, size_t), void *data);
+    // Splits the items into at most chunkCount chunks whose total costs are
+    // close to each other. The most costly chunks come first, and the items
+    // in each chunk are in ascending order.
+    static std::vector<std::vector<size_t>> makeBalancedChunks(const std::vector<size_t> &costList, size_t chunkCount);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<size_t> chunkQueue;
+    };
+    void workerLoop(size_t threadIndex);
+    void runChunks(size_t threadIndex);
+    bool popChunk(size_t threadIndex, size_t *chunkIndex);
+
+    std::vector<std::unique_ptr<Worker>> workerList;
+    std::vector<std::thread> threadList;
+    std::mutex poolMutex;
+    std::condition_variable startCondition;
+    std::condition_variable finishCondition;
+    void (*proc)(void *, size_t);
+    void *data;
+    uint64_t generation;
+    size_t runningThreadCount;
+    bool stopping;
+};
+
+}  // namespace Optimizer
+#endif  // HOCRF_OPTIMIZER_WORKER_POOL_H_
@@ -41,10 +41,18 @@ string CharacterCluster::toString() const {
     return ret;
 }
 
+const vector<UnicodeCharacter> &CharacterCluster::getCharacterList() const {
+    return characters;
+}
+
 string CharacterCluster::getFirstCharacterType() const {
     return characters[0].getCharacterType();
 }
 
+const char *CharacterCluster::getFirstCharacterTypeString() const {
+    return characters[0].getCharacterTypeString();
+}
+
 uint32_t CharacterCluster::getFirstCodePoint() const {
     return characters[0].getCodePoint();
 }
@@ -17,8 +17,10 @@ public:
     CharacterCluster(const std::vector<UnicodeCharacter> &chars);
     CharacterCluster(std::string::const_iterator beginIterator, std::string::const_iterator endIterator);
     std::string toString() const;
+    const std::vector<UnicodeCharacter> &getCharacterList() const;
     uint32_t getFirstCodePoint() const;
     std::string getFirstCharacterType() const;
+    const char *getFirstCharacterTypeString() const;
 private:
     std::vector<UnicodeCharacter> characters;
 };
@@ -0,0 +1,61 @@
+#include "CountMinSketch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace Utility {
+
+using std::memory_order_relaxed;
+using std::min;
+using std::numeric_limits;
+
+CountMinSketch::CountMinSketch(size_t byteSize, size_t depth) : depth(depth) {
+    size_t width = 1;
+    while (width * 2 * depth * sizeof(uint32_t) <= byteSize) {
+        width *= 2;
+    }
+    widthMask = width - 1;
+    // value-initialized to zero
+    counterList = std::vector<std::atomic<uint32_t>>(width * depth);
+}
+
+// The counter of each row is chosen by h1 + row * h2, where h1 and h2 are
+// the halves of the hash.
+void CountMinSketch::add(uint64_t hash) {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    for (size_t row = 0; row < depth; ++row) {
+        counterList[row * (widthMask + 1) + ((h1 + row * h2) & widthMask)].fetch_add(1, memory_order_relaxed);
+    }
+}
+
+uint32_t CountMinSketch::estimate(uint64_t hash) const {
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    uint32_t count = numeric_limits<uint32_t>::max();
+    for (size_t row = 0; row < depth; ++row) {
+        count = min(count, counterList[row * (widthMask + 1) + ((h1 + row * h2) & widthMask)].load(memory_order_relaxed));
+    }
+    return count;
+}
+
+size_t CountMinSketch::getCounterCount() const {
+    return counterList.size();
+}
+
+void CountMinSketch::getCounters(double *counters) const {
+    for (size_t i = 0; i < counterList.size(); ++i) {
+        counters[i] = counterList[i].load(memory_order_relaxed);
+    }
+}
+
+void CountMinSketch::setCounters(const double *counters) {
+    for (size_t i = 0; i < counterList.size(); ++i) {
+        counterList[i].store((uint32_t)min(counters[i], (double)numeric_limits<uint32_t>::max()), memory_order_relaxed);
+    }
+}
+
+}  // namespace Utility
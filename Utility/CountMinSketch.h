@@ -0,0 +1,37 @@
+#ifndef HOCRF_UTILITY_COUNT_MIN_SKETCH_H_
+#define HOCRF_UTILITY_COUNT_MIN_SKETCH_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Utility {
+
+// Counts hashed keys approximately in a fixed amount of memory. The
+// estimate of a key is never less than the number of times it was added,
+// so it can tell the keys that are certainly rarer than a threshold. Keys
+// can be added from many threads at a time.
+class CountMinSketch {
+public:
+    // Uses about byteSize bytes for depth rows of counters.
+    CountMinSketch(size_t byteSize, size_t depth);
+    void add(uint64_t hash);
+    uint32_t estimate(uint64_t hash) const;
+    // The counters as numbers, so that the sketches of the same size made by
+    // many processes can be added up. The sums are capped at UINT32_MAX.
+    size_t getCounterCount() const;
+    void getCounters(double *counters) const;
+    void setCounters(const double *counters);
+
+private:
+    CountMinSketch(const CountMinSketch &) = delete;
+    CountMinSketch &operator=(const CountMinSketch &) = delete;
+    size_t depth;
+    size_t widthMask;
+    std::vector<std::atomic<uint32_t>> counterList;
+};
+
+}  // namespace Utility
+
+#endif  // HOCRF_UTILITY_COUNT_MIN_SKETCH_H_
@@ -0,0 +1,83 @@
+#include "MappedFile.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+using std::endl;
+using std::exit;
+using std::ifstream;
+using std::string;
+
+namespace Utility {
+
+#ifndef _WIN32
+
+MappedFile::MappedFile(const string &filename) : ptr(nullptr), length(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot read from file: " << filename << endl;
+        exit(1);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        cerr << "Cannot get the size of file: " << filename << endl;
+        exit(1);
+    }
+    length = (size_t)st.st_size;
+    if (length > 0) {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            cerr << "Cannot map file: " << filename << endl;
+            exit(1);
+        }
+        ptr = static_cast<const char *>(p);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (ptr) {
+        munmap(const_cast<char *>(ptr), length);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const string &filename) : ptr(nullptr), length(0) {
+    ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        cerr << "Cannot read from file: " << filename << endl;
+        exit(1);
+    }
+    in.seekg(0, std::ios::end);
+    length = (size_t)in.tellg();
+    in.seekg(0, std::ios::beg);
+    buffer.resize(length);
+    in.read(buffer.data(), length);
+    ptr = buffer.data();
+}
+
+MappedFile::~MappedFile() {}
+
+#endif
+
+const char *MappedFile::data() const {
+    return ptr;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+}  // namespace Utility
@@ -0,0 +1,30 @@
+#ifndef HOCRF_UTILITY_MAPPED_FILE_H_
+#define HOCRF_UTILITY_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Utility {
+
+// A read-only view of a whole file. The file is mapped with mmap where
+// available so that processes reading the same file share its pages;
+// otherwise its contents are read into memory.
+class MappedFile {
+public:
+    MappedFile(const std::string &filename);
+    ~MappedFile();
+    const char *data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    const char *ptr;
+    size_t length;
+    std::vector<char> buffer;
+};
+
+}  // namespace Utility
+
+#endif  // HOCRF_UTILITY_MAPPED_FILE_H_
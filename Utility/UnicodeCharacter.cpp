@@ -67,31 +67,47 @@ ERROR:
 }
 
 string UnicodeCharacter::toString() const {
-    string ret;
+    char buffer[4];
+    return string(buffer, toUtf8(buffer));
+}
+
+size_t UnicodeCharacter::toUtf8(char *buffer) const {
     if (codePoint < 0x80) {
-        ret += (char)(codePoint & 0x7f);
+        buffer[0] = (char)(codePoint & 0x7f);
+        return 1;
     } else if (codePoint < 0x800) {
-        ret += (char)((codePoint >> 6) | 0xc0);
-        ret += (char)((codePoint & 0x3f) | 0x80);
+        buffer[0] = (char)((codePoint >> 6) | 0xc0);
+        buffer[1] = (char)((codePoint & 0x3f) | 0x80);
+        return 2;
     } else if (codePoint < 0x10000) {
-        ret += (char)((codePoint >> 12) | 0xe0);
-        ret += (char)(((codePoint >> 6) & 0x3f) | 0x80);
-        ret += (char)((codePoint & 0x3f) | 0x80);
+        buffer[0] = (char)((codePoint >> 12) | 0xe0);
+        buffer[1] = (char)(((codePoint >> 6) & 0x3f) | 0x80);
+        buffer[2] = (char)((codePoint & 0x3f) | 0x80);
+        return 3;
     } else if (codePoint < 0x110000) {
-        ret += (char)((codePoint >> 18) | 0xf0);
-        ret += (char)(((codePoint >> 12) & 0x3f) | 0x80);
-        ret += (char)(((codePoint >> 6) & 0x3f) | 0x80);
-        ret += (char)((codePoint & 0x3f) | 0x80);
+        buffer[0] = (char)((codePoint >> 18) | 0xf0);
+        buffer[1] = (char)(((codePoint >> 12) & 0x3f) | 0x80);
+        buffer[2] = (char)(((codePoint >> 6) & 0x3f) | 0x80);
+        buffer[3] = (char)((codePoint & 0x3f) | 0x80);
+        return 4;
     } else {
-        ret += '?';
+        buffer[0] = '?';
+        return 1;
     }
-    return ret;
 }
 
 string UnicodeCharacter::getCharacterType() const {
     return ScriptData::codePointToScriptString(codePoint);
 }
 
+const char *UnicodeCharacter::getCharacterTypeString() const {
+    auto script = ScriptData::codePointToScript(codePoint);
+    if (script > SEGMENTER_SCRIPT_DATA_MAX_SCRIPT) {
+        return ScriptData::SCRIPT_STRING_TABLE[0];
+    }
+    return ScriptData::SCRIPT_STRING_TABLE[script];
+}
+
 uint32_t UnicodeCharacter::getCodePoint() const {
     return codePoint;
 }
@@ -15,8 +15,11 @@ public:
     UnicodeCharacter(uint32_t codePoint);
     UnicodeCharacter(std::string::const_iterator beginIterator, std::string::const_iterator endIterator, size_t *charCount);
     std::string toString() const;
+    // Writes at most 4 bytes to buffer and returns the number of bytes written.
+    size_t toUtf8(char *buffer) const;
     uint32_t getCodePoint() const;
     std::string getCharacterType() const;
+    const char *getCharacterTypeString() const;
     static std::string unicodeCharacterListToString(const std::vector<UnicodeCharacter> &origChars);
     static std::vector<UnicodeCharacter> stringToUnicodeCharacterList(const std::string &orig);
 private:
@@ -251,6 +251,23 @@ int lbfgs(
     void *instance,
     lbfgs_parameter_t *_param
     )
+{
+    return lbfgs_resume(
+        n, x, ptr_fx, proc_evaluate, proc_progress, NULL, NULL, instance, _param
+        );
+}
+
+int lbfgs_resume(
+    int n,
+    lbfgsfloatval_t *x,
+    lbfgsfloatval_t *ptr_fx,
+    lbfgs_evaluate_t proc_evaluate,
+    lbfgs_progress_t proc_progress,
+    lbfgs_checkpoint_t proc_checkpoint,
+    const lbfgs_state_t *initial_state,
+    void *instance,
+    lbfgs_parameter_t *_param
+    )
 {
     int ret;
     int i, j, k, ls, end, bound;
@@ -269,6 +286,8 @@ int lbfgs(
     lbfgsfloatval_t fx = 0.;
     lbfgsfloatval_t rate = 0.;
     line_search_proc linesearch = line_search_morethuente;
+    lbfgs_state_t state;
+    lbfgsfloatval_t **sp = NULL, **yp = NULL, *ysp = NULL;
 
     /* Construct a callback data. */
     callback_data_t cd;
@@ -408,6 +427,54 @@ int lbfgs(
         pf = (lbfgsfloatval_t*)vecalloc(param.past * sizeof(lbfgsfloatval_t));
     }
 
+    if (proc_checkpoint != NULL) {
+        /* Allocate the views of the limited memory for the checkpoints. */
+        sp = (lbfgsfloatval_t**)vecalloc(m * sizeof(lbfgsfloatval_t*));
+        yp = (lbfgsfloatval_t**)vecalloc(m * sizeof(lbfgsfloatval_t*));
+        ysp = (lbfgsfloatval_t*)vecalloc(m * sizeof(lbfgsfloatval_t));
+        if (sp == NULL || yp == NULL || ysp == NULL) {
+            ret = LBFGSERR_OUTOFMEMORY;
+            goto lbfgs_exit;
+        }
+        for (i = 0;i < m;++i) {
+            sp[i] = lm[i].s;
+            yp[i] = lm[i].y;
+        }
+        state.x = x;
+        state.g = g;
+        state.d = d;
+        state.s = sp;
+        state.y = yp;
+        state.ys = ysp;
+        state.pf = pf;
+    }
+
+    if (initial_state != NULL) {
+        /* Restore the state at the beginning of an iteration. */
+        veccpy(x, initial_state->x, n);
+        veccpy(g, initial_state->g, n);
+        veccpy(d, initial_state->d, n);
+        for (i = 0;i < m;++i) {
+            veccpy(lm[i].s, initial_state->s[i], n);
+            veccpy(lm[i].y, initial_state->y[i], n);
+            lm[i].ys = initial_state->ys[i];
+        }
+        if (pf != NULL) {
+            memcpy(pf, initial_state->pf, param.past * sizeof(lbfgsfloatval_t));
+        }
+        fx = initial_state->fx;
+        step = initial_state->step;
+        k = initial_state->k;
+        end = initial_state->end;
+        if (param.orthantwise_c != 0.) {
+            owlqn_pseudo_gradient(
+                pg, x, g, n,
+                param.orthantwise_c, param.orthantwise_start, param.orthantwise_end
+                );
+        }
+        goto lbfgs_loop;
+    }
+
     /* Evaluate the function value and its gradient. */
     fx = cd.proc_evaluate(cd.instance, x, g, cd.n, 0);
     if (0. != param.orthantwise_c) {
@@ -457,7 +524,20 @@ int lbfgs(
 
     k = 1;
     end = 0;
+lbfgs_loop:
     for (;;) {
+        /* Report the state. */
+        if (proc_checkpoint != NULL) {
+            for (i = 0;i < m;++i) {
+                ysp[i] = lm[i].ys;
+            }
+            state.k = k;
+            state.end = end;
+            state.fx = fx;
+            state.step = step;
+            proc_checkpoint(cd.instance, &state, cd.n);
+        }
+
         /* Store the current position and gradient vectors. */
         veccpy(xp, x, n);
         veccpy(gp, g, n);
@@ -621,6 +701,9 @@ lbfgs_exit:
     }
 
     vecfree(pf);
+    vecfree(ysp);
+    vecfree(yp);
+    vecfree(sp);
 
     /* Free memory blocks used by this function. */
     if (lm != NULL) {
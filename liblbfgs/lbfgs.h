@@ -416,6 +416,57 @@ typedef int (*lbfgs_progress_t)(
     int ls
     );
 
+/**
+ * The state of the optimization process at the beginning of an iteration.
+ *
+ *  The state is enough to continue the optimization process from the
+ *  iteration in the same way as if it had not been interrupted, provided that
+ *  the same parameters and the same objective function are used.
+ */
+typedef struct {
+    /** The iteration count. */
+    int k;
+    /** The index of the slot of the limited memory to be updated next. */
+    int end;
+    /** The current value of the objective function. */
+    lbfgsfloatval_t fx;
+    /** The initial step of the next line search. */
+    lbfgsfloatval_t step;
+    /** The current values of variables [n]. */
+    lbfgsfloatval_t *x;
+    /** The current gradient values of variables [n]. */
+    lbfgsfloatval_t *g;
+    /** The next search direction [n]. */
+    lbfgsfloatval_t *d;
+    /** The differences of the variables in the limited memory [m][n]. */
+    lbfgsfloatval_t **s;
+    /** The differences of the gradients in the limited memory [m][n]. */
+    lbfgsfloatval_t **y;
+    /** The dot products of y and s in the limited memory [m]. */
+    lbfgsfloatval_t *ys;
+    /** The past values of the objective function [past], or \c NULL if
+        lbfgs_parameter_t::past is zero. */
+    lbfgsfloatval_t *pf;
+} lbfgs_state_t;
+
+/**
+ * Callback interface to receive the state of the optimization process.
+ *
+ *  The lbfgs_resume() function calls this function at the beginning of each
+ *  iteration. The arrays of the state belong to the optimization process and
+ *  are only valid during the call.
+ *
+ *  @param  instance    The user data sent for lbfgs_resume() function by the
+ *                      client.
+ *  @param  state       The current state of the optimization process.
+ *  @param  n           The number of variables.
+ */
+typedef void (*lbfgs_checkpoint_t)(
+    void *instance,
+    const lbfgs_state_t *state,
+    int n
+    );
+
 /*
 A user must implement a function compatible with ::lbfgs_evaluate_t (evaluation
 callback) and pass the pointer to the callback function to lbfgs() arguments.
@@ -484,6 +535,33 @@ int lbfgs(
     lbfgs_parameter_t *param
     );
 
+/**
+ * Start or continue a L-BFGS optimization with checkpoints.
+ *
+ *  This function works in the same way as lbfgs(), except that it reports the
+ *  state of the optimization process to \c proc_checkpoint at the beginning of
+ *  each iteration, and that it continues from \c initial_state instead of
+ *  starting from \c x if it is not \c NULL. The state must have been
+ *  reported with the same parameters.
+ *
+ *  @param  proc_checkpoint The callback function to receive the state of the
+ *                          optimization process. This argument can be set to
+ *                          \c NULL.
+ *  @param  initial_state   The state to continue from, or \c NULL to start
+ *                          from \c x.
+ */
+int lbfgs_resume(
+    int n,
+    lbfgsfloatval_t *x,
+    lbfgsfloatval_t *ptr_fx,
+    lbfgs_evaluate_t proc_evaluate,
+    lbfgs_progress_t proc_progress,
+    lbfgs_checkpoint_t proc_checkpoint,
+    const lbfgs_state_t *initial_state,
+    void *instance,
+    lbfgs_parameter_t *param
+    );
+
 /**
  * Initialize L-BFGS parameters to the default values.
  *